@@ -1,13 +1,29 @@
 Import("env")
+import os
+import re
+import sys
 from shutil import copyfile
 
+sys.path.insert(0, os.path.join(env.subst("$PROJECT_DIR"), "tools"))
+from ota_manifest import manifest
+
+def firmware_version():
+    with open(os.path.join(env.subst("$PROJECT_DIR"), "include", "Version.hpp")) as f:
+        return re.search(r'#define FW_VERSION "([^"]+)"', f.read()).group(1)
+
 def move_bin(*args, **kwargs):
     print("Copying bin output to project directory...")
     target = str(kwargs['target'][0])
     if target == ".pio/build/esp32dev_v3/firmware.bin":
-        copyfile(target, 'esp32_air_quality_v3.bin')
+        name = 'esp32_air_quality_v3'
     elif target == ".pio/build/esp32dev_v4/firmware.bin":
-        copyfile(target, 'esp32_air_quality_v4.bin')
+        name = 'esp32_air_quality_v4'
+    else:
+        return
+    copyfile(target, name + '.bin')
+    # The manifest the device's ota_manifest setting points at, published with the .bin
+    with open(name + '.manifest', 'w') as f:
+        f.write(manifest(name + '.bin', firmware_version()))
     print("Done.")
 
-env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", move_bin)   #post action for .bin
\ No newline at end of file
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", move_bin)   #post action for .bin
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Animation {
+
+	struct Color {
+		uint8_t r, g, b;
+	};
+
+	constexpr static const Color OFF	= {0, 0, 0};
+	constexpr static const Color GREEN	= {0, 255, 0};
+	constexpr static const Color YELLOW = {255, 165, 0};
+	constexpr static const Color ORANGE = {255, 127, 0};
+	constexpr static const Color RED	= {255, 0, 0};
+
+	enum Ease : uint8_t {
+		LINEAR,
+		IN_OUT, // smoothstep, slow at both ends
+	};
+
+	// Lookup table built at compile time, maps progress 0..255 to eased progress 0..255
+	struct EaseTable {
+		uint8_t v[256];
+
+		constexpr EaseTable() : v() {
+			for (int i = 0; i < 256; i++) {
+				float x = i / 255.0f;
+				v[i]	= (uint8_t)(255.0f * x * x * (3.0f - 2.0f * x) + 0.5f);
+			}
+		}
+	};
+
+	constexpr static const EaseTable IN_OUT_TABLE;
+
+	// Transition from wherever the LED is to color at intensity (0..255), over duration
+	struct Keyframe {
+		Color	 color;
+		uint8_t	 intensity;
+		uint16_t duration; // ms
+		Ease	 ease;
+	};
+
+	struct Sequence {
+		const Keyframe *frames;
+		uint8_t			count;
+		bool			repeat;
+	};
+
+	template <uint8_t N>
+	constexpr Sequence sequence(const Keyframe (&frames)[N], bool repeat) {
+		return {frames, N, repeat};
+	}
+
+	/**
+	 * Plays keyframe sequences one tick per loop() from the time passed in,
+	 * never sleeps. A new sequence always starts from the colour currently
+	 * shown, so switching animations cross-fades instead of jumping.
+	 * Output intensity is scaled by level, the ambient-light brightness.
+	 */
+	struct Animator {
+		typedef void (*ShowFn)(Color color);
+
+		ShowFn	 show;
+		Sequence seq	   = {nullptr, 0, false};
+		Keyframe single	   = {OFF, 0, 0, LINEAR}; // backing store for fadeTo()
+		uint8_t	 frame	   = 0;
+		uint32_t startedAt = 0;
+		Color	 fromColor = OFF, color = OFF;
+		uint8_t	 fromIntensity = 0, intensity = 0;
+		uint8_t	 level		   = 255;
+		Color	 shown		   = OFF;
+		bool	 dirty		   = true;
+
+		Animator(ShowFn show) : show(show) {}
+
+		void play(const Sequence &s, uint32_t now) {
+			seq	  = s;
+			frame = 0;
+			start(now);
+		}
+
+		void fadeTo(Color target, uint16_t duration, uint32_t now, Ease ease = IN_OUT) {
+			single = {target, 255, duration, ease};
+			play({&single, 1, false}, now);
+		}
+
+		void setLevel(uint8_t l) {
+			dirty |= l != level;
+			level = l;
+		}
+
+		// True while a non-repeating sequence is still running
+		bool busy() const {
+			return seq.count > 0 && !seq.repeat && frame < seq.count;
+		}
+
+		bool playing(const Sequence &s) const {
+			return seq.frames == s.frames && frame < seq.count;
+		}
+
+		void tick(uint32_t now) {
+			while (frame < seq.count) {
+				const Keyframe &kf		= seq.frames[frame];
+				uint32_t		elapsed = now - startedAt;
+
+				if (elapsed < kf.duration) {
+					uint8_t p = (elapsed * 255) / kf.duration;
+					if (kf.ease == IN_OUT) p = IN_OUT_TABLE.v[p];
+					color	  = {lerp(fromColor.r, kf.color.r, p), lerp(fromColor.g, kf.color.g, p), lerp(fromColor.b, kf.color.b, p)};
+					intensity = lerp(fromIntensity, kf.intensity, p);
+					break;
+				}
+
+				// Keyframe done, carry the overshoot into the next one so timing doesn't drift
+				color	  = kf.color;
+				intensity = kf.intensity;
+				startedAt += kf.duration;
+				if (++frame == seq.count && seq.repeat) frame = 0;
+				fromColor	  = color;
+				fromIntensity = intensity;
+			}
+
+			uint16_t scale = (intensity * level) / 255;
+			Color	 out   = {(uint8_t)((color.r * scale) / 255), (uint8_t)((color.g * scale) / 255), (uint8_t)((color.b * scale) / 255)};
+			if (dirty || out.r != shown.r || out.g != shown.g || out.b != shown.b) {
+				shown = out;
+				dirty = false;
+				show(out);
+			}
+		}
+
+	private:
+		void start(uint32_t now) {
+			startedAt	  = now;
+			fromColor	  = color;
+			fromIntensity = intensity;
+		}
+
+		static uint8_t lerp(uint8_t a, uint8_t b, uint8_t p) {
+			return a + ((b - a) * p) / 255;
+		}
+	};
+
+	// Boot sequence: green, yellow, red, yellow, green, one second in and one second out each
+	constexpr static const Keyframe BOOT_FRAMES[] = {
+		{GREEN, 255, 1000, IN_OUT},
+		{GREEN, 0, 1000, IN_OUT},
+		{YELLOW, 255, 1000, IN_OUT},
+		{YELLOW, 0, 1000, IN_OUT},
+		{RED, 255, 1000, IN_OUT},
+		{RED, 0, 1000, IN_OUT},
+		{YELLOW, 255, 1000, IN_OUT},
+		{YELLOW, 0, 1000, IN_OUT},
+		{GREEN, 255, 1000, IN_OUT},
+		{GREEN, 0, 1000, IN_OUT},
+	};
+
+	// Slow orange pulse while the CO2 sensor warms up
+	constexpr static const Keyframe WARMUP_FRAMES[] = {
+		{YELLOW, 255, 400, IN_OUT},
+		{YELLOW, 255, 2100, LINEAR},
+		{YELLOW, 0, 400, IN_OUT},
+		{YELLOW, 0, 2100, LINEAR},
+	};
+
+	constexpr static const Sequence BOOT   = sequence(BOOT_FRAMES, false);
+	constexpr static const Sequence WARMUP = sequence(WARMUP_FRAMES, true);
+
+	constexpr static const uint16_t CROSSFADE_MS = 1500; // level colour changes
+
+	// CO2 indicator: 400 - 800 green, 800 - 1000 orange, 1000+ red
+	inline Color co2Color(float ppm) {
+		if (ppm >= 1000) return RED;
+		if (ppm >= 800) return ORANGE;
+		return GREEN;
+	}
+} // namespace Animation
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include <HomeSpan.h>
+
+/**
+ * Boot-time bring-up. Sensor initialisation runs as deferred, retryable
+ * stages polled from loop() after HomeSpan has started, so pairing and the
+ * web server never wait on a slow or missing sensor. Every milestone is
+ * timestamped into a small profile, printed on the serial log and served
+ * at /debug/boot, to track time-to-first-reading across firmware versions.
+ */
+namespace Boot {
+
+	constexpr static const uint8_t MAX_MARKS  = 24;
+	constexpr static const uint8_t MAX_STAGES = 8;
+
+	struct Mark {
+		const char	 *name;
+		unsigned long ms;
+	};
+
+	struct Stage {
+		const char	 *name;
+		bool		  (*attempt)(); // returns true once the stage succeeded
+		unsigned long retryMs;
+		unsigned long nextAttempt;
+		uint16_t	  attempts;
+		bool		  done;
+	};
+
+	Mark	marks[MAX_MARKS];
+	uint8_t markCount = 0;
+
+	Stage	stages[MAX_STAGES];
+	uint8_t stageCount = 0;
+
+	// Record a milestone, the first occurrence of each name wins
+	void mark(const char *name) {
+		for (uint8_t i = 0; i < markCount; i++) {
+			if (strcmp(marks[i].name, name) == 0) return;
+		}
+		if (markCount >= MAX_MARKS) return;
+
+		marks[markCount++] = {name, millis()};
+		Serial.printf("[boot] %6lu ms  %s\n", marks[markCount - 1].ms, name);
+	}
+
+	bool marked(const char *name) {
+		for (uint8_t i = 0; i < markCount; i++) {
+			if (strcmp(marks[i].name, name) == 0) return true;
+		}
+		return false;
+	}
+
+	// Queue an init stage, it is attempted from poll() until it succeeds
+	void addStage(const char *name, bool (*attempt)(), unsigned long retryMs) {
+		if (stageCount >= MAX_STAGES) return;
+		stages[stageCount++] = {name, attempt, retryMs, 0, 0, false};
+	}
+
+	// Attempt at most one due stage per call, so a slow sensor costs one attempt per loop() at worst
+	void poll() {
+		unsigned long now = millis();
+
+		for (uint8_t i = 0; i < stageCount; i++) {
+			Stage &stage = stages[i];
+			if (stage.done || (long)(now - stage.nextAttempt) < 0) continue;
+
+			stage.attempts++;
+			if (stage.attempt()) {
+				stage.done = true;
+				mark(stage.name);
+			} else {
+				stage.nextAttempt = now + stage.retryMs;
+				LOG1("Init stage %s failed (attempt %d), retrying in %lu ms\n", stage.name, stage.attempts, stage.retryMs);
+			}
+			return;
+		}
+	}
+
+	String report() {
+		String content;
+		char   line[64];
+		for (uint8_t i = 0; i < markCount; i++) {
+			snprintf(line, sizeof(line), "%-24s %8lu ms\n", marks[i].name, marks[i].ms);
+			content += line;
+		}
+		for (uint8_t i = 0; i < stageCount; i++) {
+			snprintf(line, sizeof(line), "stage %-18s %s attempts=%u\n", stages[i].name, stages[i].done ? "ready" : "pending", stages[i].attempts);
+			content += line;
+		}
+		return content;
+	}
+} // namespace Boot
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Hal.hpp"
+
+/**
+ * Record-and-replay of raw sensor traffic. Taps sit between the drivers
+ * and their Hal backends and, while a capture is running, append every
+ * byte, I2C word and ADC sample the firmware actually read to a byte ring,
+ * oldest records are evicted once it is full. The ring is downloaded at
+ * /capture and fed back through the same drivers on the host by
+ * src/native/Replay.hpp.
+ *
+ * Download format:
+ *   "AQC1"   magic
+ *   varint   base time in ms, the first record's delta is relative to it
+ *   varint   length of the record stream in bytes
+ *   records  u8 tag (source << 5 | payload length), varint ms since the
+ *            previous record, payload
+ *
+ * UART bytes read in the same millisecond share one record, so a drained
+ * PM1006 frame costs 22 bytes instead of 60.
+ */
+namespace Capture {
+
+	enum Source : uint8_t {
+		PM1006_RX, // bytes read from the PM1006 UART
+		MHZ19B_RX, // bytes read from the MH-Z19B UART
+		I2C_READ,  // address, then the bytes read, address only on NACK
+		ADC,	   // 16 bit sample, little endian
+		SOURCE_COUNT,
+	};
+
+	constexpr static const char	   MAGIC[4]	   = {'A', 'Q', 'C', '1'};
+	constexpr static const uint8_t MAX_PAYLOAD = 31;
+
+	struct Recorder {
+		uint8_t *buf;
+		uint32_t size;
+		uint32_t head = 0, tail = 0, used = 0;
+		uint32_t baseMs = 0, lastMs = 0;
+		uint32_t open	= UINT32_MAX; // position of the tag of the record still being appended to
+		bool	 active = false;
+		Hal::Lock lock; // the taps record from the acquisition task, start() and stop() come from loop()
+
+		// Stats
+		uint32_t records = 0;
+		uint32_t evicted = 0;
+
+		Recorder(uint8_t *buf, uint32_t size) : buf(buf), size(size) {}
+
+		// Drops whatever was captured before
+		void start(uint32_t now) {
+			lock.lock();
+			head = tail = used = 0;
+			baseMs = lastMs = now;
+			open			= UINT32_MAX;
+			records = evicted = 0;
+			active			  = true;
+			lock.unlock();
+		}
+
+		// Once it returns no add() is under way, the ring can be read
+		void stop() {
+			lock.lock();
+			active = false;
+			lock.unlock();
+		}
+
+		void add(Source source, uint32_t now, const uint8_t *data, uint8_t len) {
+			lock.lock();
+			if (active) append(source, now, data, len);
+			lock.unlock();
+		}
+
+		// Stream the ring in the download format, Out needs write(const char *, size_t)
+		template <typename Out>
+		void write(Out &out) const {
+			out.write(MAGIC, sizeof(MAGIC));
+			putVarint(out, baseMs);
+			putVarint(out, used);
+			uint32_t first = size - tail < used ? size - tail : used;
+			out.write((const char *)buf + tail, first);
+			out.write((const char *)buf, used - first);
+		}
+
+	private:
+		void append(Source source, uint32_t now, const uint8_t *data, uint8_t len) {
+			// Extend the open record when the same source reads again within the same millisecond
+			if (open != UINT32_MAX && now == lastMs && buf[open] >> 5 == source && (buf[open] & MAX_PAYLOAD) + len <= MAX_PAYLOAD && source != I2C_READ) {
+				reserve(len);
+				if (open != UINT32_MAX) {
+					buf[open] += len;
+					for (uint8_t i = 0; i < len; i++) push(data[i]);
+					return;
+				}
+			}
+
+			uint8_t	 varint[5];
+			uint8_t	 n	= 0;
+			uint32_t dt = now - lastMs;
+			while (dt >= 0x80) {
+				varint[n++] = dt | 0x80;
+				dt >>= 7;
+			}
+			varint[n++] = dt;
+
+			if (len > MAX_PAYLOAD) len = MAX_PAYLOAD;
+			if (1u + n + len > size) return;
+			reserve(1 + n + len);
+
+			open = head;
+			push((source << 5) | len);
+			for (uint8_t i = 0; i < n; i++) push(varint[i]);
+			for (uint8_t i = 0; i < len; i++) push(data[i]);
+			lastMs = now;
+			records++;
+		}
+
+		void push(uint8_t b) {
+			buf[head] = b;
+			head	  = (head + 1) % size;
+			used++;
+		}
+
+		uint8_t at(uint32_t i) const {
+			return buf[(tail + i) % size];
+		}
+
+		// Evict the oldest records until len more bytes fit
+		void reserve(uint32_t len) {
+			while (size - used < len) {
+				if (tail == open) open = UINT32_MAX; // never append to an evicted record
+				uint8_t	 tag = at(0);
+				uint32_t dt = 0, i = 1;
+				for (uint8_t shift = 0;; shift += 7) {
+					uint8_t b = at(i++);
+					dt |= (uint32_t)(b & 0x7F) << shift;
+					if (!(b & 0x80)) break;
+				}
+				i += tag & MAX_PAYLOAD;
+				baseMs += dt;
+				tail = (tail + i) % size;
+				used -= i;
+				evicted++;
+			}
+		}
+
+		template <typename Out>
+		static void putVarint(Out &out, uint32_t v) {
+			char	b[5];
+			uint8_t n = 0;
+			while (v >= 0x80) {
+				b[n++] = (char)(v | 0x80);
+				v >>= 7;
+			}
+			b[n++] = (char)v;
+			out.write(b, n);
+		}
+	};
+
+	struct Record {
+		Source		   source;
+		uint32_t	   ms;
+		const uint8_t *data;
+		uint8_t		   len;
+	};
+
+	// Walks a downloaded capture, next() returns false at the end or on a malformed stream
+	struct Reader {
+		const uint8_t *p, *end;
+		uint32_t	   ms = 0;
+		bool		   ok = false;
+
+		Reader(const uint8_t *data, size_t len) : p(data), end(data + len) {
+			uint32_t base, length;
+			if (len < sizeof(MAGIC) || memcmp(data, MAGIC, sizeof(MAGIC))) return;
+			p += sizeof(MAGIC);
+			if (!varint(base) || !varint(length) || length > (size_t)(end - p)) return;
+			ms	= base;
+			end = p + length;
+			ok	= true;
+		}
+
+		bool next(Record &r) {
+			uint32_t dt;
+			if (!ok || p >= end) return false;
+			uint8_t tag = *p++;
+			if (!varint(dt) || (tag >> 5) >= SOURCE_COUNT || (size_t)(end - p) < (tag & MAX_PAYLOAD)) return ok = false;
+			ms += dt;
+			r = {(Source)(tag >> 5), ms, p, (uint8_t)(tag & MAX_PAYLOAD)};
+			p += r.len;
+			return true;
+		}
+
+	private:
+		bool varint(uint32_t &v) {
+			v = 0;
+			for (uint8_t shift = 0; shift < 35; shift += 7) {
+				if (p >= end) return false;
+				uint8_t b = *p++;
+				v |= (uint32_t)(b & 0x7F) << shift;
+				if (!(b & 0x80)) return true;
+			}
+			return false;
+		}
+	};
+
+	// Taps, forward to the real backend and record what came back
+
+	struct StreamTap : Hal::ByteStream {
+		Hal::ByteStream &inner;
+		Recorder		&recorder;
+		Hal::Clock		&clock;
+		Source			 source;
+
+		StreamTap(Hal::ByteStream &inner, Recorder &recorder, Hal::Clock &clock, Source source) : inner(inner), recorder(recorder), clock(clock), source(source) {}
+
+		int available() override {
+			return inner.available();
+		}
+
+		int read() override {
+			int b = inner.read();
+			if (b >= 0 && recorder.active) {
+				uint8_t byte = b;
+				recorder.add(source, clock.millis(), &byte, 1);
+			}
+			return b;
+		}
+
+		size_t write(const uint8_t *data, size_t len) override {
+			return inner.write(data, len);
+		}
+	};
+
+	struct I2CTap : Hal::I2CBus {
+		Hal::I2CBus &inner;
+		Recorder	&recorder;
+		Hal::Clock	&clock;
+
+		I2CTap(Hal::I2CBus &inner, Recorder &recorder, Hal::Clock &clock) : inner(inner), recorder(recorder), clock(clock) {}
+
+		bool write(uint8_t addr, const uint8_t *data, uint8_t len) override {
+			return inner.write(addr, data, len);
+		}
+
+		uint8_t read(uint8_t addr, uint8_t *data, uint8_t len) override {
+			uint8_t n = inner.read(addr, data, len);
+			if (recorder.active) {
+				uint8_t payload[MAX_PAYLOAD];
+				uint8_t copied = n < MAX_PAYLOAD - 1 ? n : MAX_PAYLOAD - 1;
+				payload[0]	   = addr;
+				memcpy(payload + 1, data, copied);
+				recorder.add(I2C_READ, clock.millis(), payload, copied + 1);
+			}
+			return n;
+		}
+	};
+
+	struct AdcTap : Hal::Adc {
+		Hal::Adc   &inner;
+		Recorder   &recorder;
+		Hal::Clock &clock;
+
+		AdcTap(Hal::Adc &inner, Recorder &recorder, Hal::Clock &clock) : inner(inner), recorder(recorder), clock(clock) {}
+
+		uint16_t read() override {
+			uint16_t v = inner.read();
+			if (recorder.active) {
+				uint8_t payload[2] = {(uint8_t)(v & 0xFF), (uint8_t)(v >> 8)};
+				recorder.add(ADC, clock.millis(), payload, sizeof(payload));
+			}
+			return v;
+		}
+	};
+} // namespace Capture
@@ -1,61 +1,127 @@
+#include <atomic>
 #include <HomeSpan.h>
-#include <SoftwareSerial.h>
-#include <ErriezMHZ19B.h>
 #include <Adafruit_NeoPixel.h>
+#include "Animation.hpp"
+#include "Boot.hpp"
+#include "Capture.hpp"
+#include "Events.hpp"
+#include "HalEsp32.hpp"
+#include "History.hpp"
+#include "LoopStats.hpp"
+#include "MHZ19B.hpp"
+#include "Notify.hpp"
+#include "PartitionFlash.hpp"
+#include "Pipeline.hpp"
+#include "Push.hpp"
+#include "Restore.hpp"
+#include "SampleLog.hpp"
 #include "SerialCom.hpp"
-#include "Types.hpp"
-#include <Smoothed.h>
+#include "Settings.hpp"
+#include "SlidingWindow.hpp"
 
 // I2C for temp sensor
-#include <Wire.h>
+#include "Si7021.hpp"
 #define si7021Addr			 0x40 // I2C address for temp sensor
 
-#define MHZ19B_TX_PIN		 19
-#define MHZ19B_RX_PIN		 18
+#define MHZ19B_TX_PIN		 19	  // sensor TX, our RX
+#define MHZ19B_RX_PIN		 18	  // sensor RX, our TX
 #define INTERVAL			 10	  // in seconds
 #define HOMEKIT_CO2_TRIGGER	 1350 // co2 level, at which HomeKit alarm will be triggered
 #define NEOPIXEL_PIN		 16	  // Pin to which NeoPixel strip is connected
 #define NUMPIXELS			 1	  // Number of pixels
-#define BRIGHTNESS_DEFAULT	 9	  // Default (dimmed) brightness
-#define BRIGHTNESS_MAX		 150  // maximum brightness of CO2 indicator led
-#define BRIGHTNESS_THRESHOLD 500  // TODO calibrate Threshold value of dimmed brightness
 #define ANALOG_PIN			 35	  // Analog pin, to which light sensor is connected
-#define SMOOTHING_COEFF		 10	  // Number of elements in the vector of previous values
+#define CAPTURE_SIZE		 32768 // Raw sensor traffic ring for /capture, about half an hour
+#define EVENTS_MAX_SUBSCRIBERS 3   // /events streams, each holds a socket HomeSpan could use
+#define ACQUISITION_CORE	 0	  // sensors are read here, HomeSpan and loop() run on the other core
+#define ACQUISITION_TICK_MS	 10	  // acquisition task period, well within the UART buffers
 
 #ifndef HARDWARE_VER
 #define HARDWARE_VER 4
 #endif
 
-bool				  needToWarmUp	= true;
-bool				  playInitAnim	= true;
-int					  tick			= 0;
-bool				  airQualityAct = false;
-particleSensorState_t state;
-Smoothed<float>		  mySensor_co2;
-Smoothed<float>		  mySensor_air;
-Smoothed<float>		  mySensor_temp;
-Smoothed<float>		  mySensor_hum;
+// The sensor pipeline itself (state, filters, readings ring, history) is in Pipeline.hpp, shared with the host build
+int							   tick			 = 0;
+bool						   airQualityAct = false;
+PartitionFlash				   historyFlash;
+SampleLog::Log<PartitionFlash> sampleLog(historyFlash); // history persisted to the "history" partition, see Pipeline::logSample
+Events::Hub<HalEsp32::EventSocket, EVENTS_MAX_SUBSCRIBERS> events; // filtered samples streamed at /events
+
+// What /metrics reports of the state the acquisition task owns, copied out after every pass so
+// a scrape on the other core never sees a sum without its count
+struct acquisitionStats_t {
+	float				co2 = 0, pm25 = 0, temperature = 0, humidity = 0; // filtered
+	bool				mhzDetected		  = false;
+	int16_t				mhzTemperature	  = 0;
+	uint16_t			mhzUnclamped	  = 0;
+	uint32_t			mhzErrors		  = 0;
+	uint32_t			mhzTimeouts		  = 0;
+	uint32_t			mhzOverflows	  = 0;
+	uint32_t			mhzReplies		  = 0;
+	uint32_t			mhzLatencySumMs	  = 0;
+	uint32_t			mhzLatencyMaxUs	  = 0;
+	HalEsp32::UartStats pmUart, mhzUart;
+};
+
+acquisitionStats_t acquisitionStats; // see publishStats() and statsSnapshot()
+Hal::Lock		   statsLock;
 
 // Declare functions
-void   detect_mhz();
-void   fadeIn(int pixel, int r, int g, int b, int brightnessOverride, double duration);
-void   fadeOut(int pixel, int r, int g, int b, double duration);
-void   initAnimation();
-int	   neopixelAutoBrightness();
-double getBrightness();
+bool     initMHZ();
+bool     initPM1006();
+#if HARDWARE_VER == 4
+bool     initSi7021();
+#endif
+void     showPixel(Animation::Color color);
+void     acquisitionTask(void *);
+void     publishStats();
+acquisitionStats_t statsSnapshot();
+bool     clockSynced();
+uint32_t historyTime();
+bool     initSampleLog();
+double   getBrightness();
 
 ////////////////////////////////////
 //   DEVICE-SPECIFIC LED SERVICES //
 ////////////////////////////////////
 
-// Use software serial
-SoftwareSerial mhzSerial(MHZ19B_TX_PIN, MHZ19B_RX_PIN);
+// Create Neopixel object
+Adafruit_NeoPixel pixels = Adafruit_NeoPixel(NUMPIXELS, NEOPIXEL_PIN, NEO_GRB + NEO_KHZ800);
+
+// Hal backends the drivers run on, src/native/ swaps these for simulated devices
+#ifdef SENSOR_SOFTWARE_SERIAL
+HalEsp32::SoftSerialStream pmStream; // bit-banged fallback, build with -D SENSOR_SOFTWARE_SERIAL
+HalEsp32::SoftSerialStream mhzStream;
+#else
+HalEsp32::UartStream pmStream(UART_NUM_1); // UART0 is the console
+HalEsp32::UartStream mhzStream(UART_NUM_2);
+#endif
+HalEsp32::WireBus	   i2c(Wire);
+HalEsp32::AnalogPin	   lightSensor(ANALOG_PIN);
+HalEsp32::NeoPixelLed  led(pixels);
+HalEsp32::SystemClock  systemClock;
+
+// Raw sensor traffic as the drivers see it, recorded while a capture runs (see /capture)
+uint8_t			   captureBuf[CAPTURE_SIZE];
+Capture::Recorder  capture(captureBuf, sizeof(captureBuf));
+Capture::StreamTap pmTap(pmStream, capture, systemClock, Capture::PM1006_RX);
+Capture::StreamTap mhzTap(mhzStream, capture, systemClock, Capture::MHZ19B_RX);
+Capture::I2CTap	   i2cTap(i2c, capture, systemClock);
+Capture::AdcTap	   lightTap(lightSensor, capture, systemClock);
+
+// Readings queued for the push exporter task, see Push.hpp and /config
+HalEsp32::HttpPoster				 pushPoster(Settings::pushUrl, Settings::pushToken, Settings::pushCa);
+Push::Exporter<HalEsp32::HttpPoster> pusher(pushPoster, systemClock);
 
 // Declare MHZ19B object
-ErriezMHZ19B mhz19b(&mhzSerial);
+MHZ19B mhz19b(mhzTap, systemClock);
 
-// Create Neopixel object
-Adafruit_NeoPixel pixels = Adafruit_NeoPixel(NUMPIXELS, NEOPIXEL_PIN, NEO_GRB + NEO_KHZ800);
+#if HARDWARE_VER == 4
+// Declare Si7021 object, shared by temperature and humidity services
+Si7021 si7021(i2cTap, systemClock, si7021Addr);
+#endif
+
+// Drives the NeoPixel from loop(), see Animation.hpp
+Animation::Animator animator(showPixel);
 
 #if HARDWARE_VER == 4
 // Custom characteristics
@@ -81,114 +147,62 @@ struct DEV_CO2Sensor : Service::CarbonDioxideSensor { // A standalone Temperatur
 
 		Serial.print("Configuring Carbon Dioxide Sensor\n"); // initialization message
 
-		mhzSerial.begin(9600);
-
-#if HARDWARE_VER != 4
-		detect_mhz();
-#endif
-
-		// Enable auto-calibration
-		mhz19b.setAutoCalibration(true);
-
 		pixels.begin();
-		pixels.setBrightness(50);
 		pixels.show();
 
-		mySensor_co2.begin(SMOOTHED_EXPONENTIAL, SMOOTHING_COEFF); // SMOOTHED_AVERAGE, SMOOTHED_EXPONENTIAL options
+		animator.setLevel(BRIGHTNESS_DEFAULT);
+		animator.play(Animation::BOOT, millis());
 	}
 
-	void loop() {
+	// Called from loop() with each reading once Pipeline::drainReadings() has recorded and shared it
+	void publish(float co2_value, float co2) {
+		Boot::mark("first_co2");
+
+		LOG1("CO2: ");
+		LOG1(co2_value);
+		LOG1(" ppm\n");
+
+		LOG1("Carbon Dioxide Update: ");
+		LOG1(co2);
+		LOG1("\n");
 
-		if (playInitAnim) {
-			Serial.println("Init animation");
-			initAnimation();
-			playInitAnim = false;
+		updatePeak();
+
+		// Trigger HomeKit sensor when concentration reaches this level
+		bool detected = co2_value > HOMEKIT_CO2_TRIGGER;
+		if (co2Detected->getVal<bool>() != detected) {
+			co2Detected->setVal(detected);
 		}
+	}
+
+	void loop() {
+		LoopStats::Scope probe(LoopStats::CO2_LOOP);
 
-		if (co2StatusActive->timeVal() > 5 * 1000 && needToWarmUp) {
+		if (co2StatusActive->timeVal() > 5 * 1000 && Pipeline::needToWarmUp && Pipeline::mhzReady) {
 			// Serial.println("Need to warm up");
 
-			if (mhz19b.isWarmingUp()) {
+			if (mhz19b.warmingUp()) {
 				Serial.println("Warming up");
-				pixels.setPixelColor(0, pixels.Color(255, 165, 0));
-				pixels.setBrightness(neopixelAutoBrightness());
-				pixels.show();
-				delay(2.5 * 1000);
-				pixels.setPixelColor(0, pixels.Color(0, 0, 0));
-				pixels.show();
+				if (!animator.busy() && !animator.playing(Animation::WARMUP)) {
+					animator.play(Animation::WARMUP, millis());
+				}
 				tick = tick + 5;
 				Serial.println((String)tick + " ");
 				co2StatusActive->setVal(false);
 			} else {
-				needToWarmUp = false;
+				Pipeline::needToWarmUp = false;
 				co2StatusActive->setVal(true);
 				Serial.println("Is warmed up");
 			}
 		}
+	}
 
-		if (co2Level->timeVal() > INTERVAL * 1000 && !needToWarmUp) { // check time elapsed since last update and proceed only if greater than 5 seconds
-
-			float co2_value;
-
-			if (mhz19b.isReady()) {
-				co2_value = mhz19b.readCO2();
-			}
-
-			if (co2_value >= 400) {
-
-				// Read a sensor value
-				// print co2 value
-				LOG1("CO2: ");
-				LOG1(co2_value);
-				LOG1(" ppm\n");
-
-				mySensor_co2.add(co2_value);
-
-				co2Level->setVal(mySensor_co2.get()); // set the new co value; this generates an Event Notification and also resets the elapsed time
-				LOG1("Carbon Dioxide Update: ");
-				LOG1(co2Level->getVal());
-				LOG1("\n");
-
-				// Set color indicator
-				// 400 - 800    -> green
-				// 800 - 1000   -> yellow
-				// 1000+        -> red
-				if (co2_value >= 1000) {
-					LOG1("Red color\n");
-					pixels.setPixelColor(0, pixels.Color(255, 0, 0)); // red color
-					// pixels.setBrightness(BRIGHTNESS_DEFAULT);
-					pixels.setBrightness(neopixelAutoBrightness());
-					pixels.show();
-				} else if (co2_value >= 800) {
-					LOG1("Yellow color\n");
-					pixels.setPixelColor(0, pixels.Color(255, 127, 0)); // orange color
-					// pixels.setBrightness(BRIGHTNESS_DEFAULT);
-					pixels.setBrightness(neopixelAutoBrightness());
-					pixels.show();
-				} else if (co2_value >= 400) {
-					LOG1("Green color\n");
-					pixels.setPixelColor(0, pixels.Color(0, 255, 0)); // green color
-					// pixels.setBrightness(BRIGHTNESS_DEFAULT);
-					pixels.setBrightness(neopixelAutoBrightness());
-					pixels.show();
-				}
-
-				// Update peak value
-				if (co2_value > co2PeakLevel->getVal()) {
-					co2PeakLevel->setVal(co2_value);
-				}
-
-				// Trigger HomeKit sensor when concentration reaches this level
-				if (co2_value > HOMEKIT_CO2_TRIGGER) {
-					co2Detected->setVal(true);
-				} else {
-					co2Detected->setVal(false);
-				}
-			}
-		}
-
-		if (co2Level->timeVal() > 12 * 60 * 60 * 1000) {
-			co2PeakLevel->setVal(400);
+	// Highest reading of the last 24 hours, see SlidingWindow.hpp
+	void updatePeak() {
+		float low, peak, mean;
+		if (!SlidingWindow::get(History::CO2, SlidingWindow::DAY, historyTime(), low, peak, mean)) return;
+		if (peak != co2PeakLevel->getVal<float>()) {
+			co2PeakLevel->setVal(peak);
 		}
 	}
 };
@@ -211,48 +225,16 @@ struct DEV_AirQualitySensor : Service::AirQualitySensor { // A standalone Air Qu
 		Serial.print("Configuring Air Quality Sensor"); // initialization message
 		Serial.print("\n");
 
-		SerialCom::setup();
-
-		mySensor_air.begin(SMOOTHED_AVERAGE, 4); // SMOOTHED_AVERAGE, SMOOTHED_EXPONENTIAL options
-
 	} // end constructor
 
-	void loop() {
-
-		if (pm25->timeVal() > INTERVAL * 1000) { // modify the Air Quality Characteristic every 5 seconds
-
-			SerialCom::handleUart(state);
-
-			if (state.valid) {
-
-				if (!airQualityAct) {
-					airQualityActive->setVal(true);
-					airQualityAct = true;
-				}
-
-				mySensor_air.add(state.avgPM25);
-
-				pm25->setVal(mySensor_air.get());
-
-				int airQualityVal = 0;
-
-				// Set Air Quality level based on PM2.5 value
-				if (state.avgPM25 >= 150) {
-					airQualityVal = 5;
-				} else if (state.avgPM25 >= 55) {
-					airQualityVal = 4;
-				} else if (state.avgPM25 >= 35) {
-					airQualityVal = 3;
-				} else if (state.avgPM25 >= 12) {
-					airQualityVal = 2;
-				} else if (state.avgPM25 >= 0) {
-					airQualityVal = 1;
-				}
-				airQuality->setVal(airQualityVal);
-			}
+	// Called from loop() every INTERVAL once the PM1006 sends valid frames, after Pipeline::drainReadings()
+	void publish() {
+		if (!airQualityAct) {
+			airQualityActive->setVal(true);
+			airQualityAct = true;
+			Boot::mark("first_pm25");
 		}
-
-	} // loop
+	}
 };
 
 #if HARDWARE_VER == 4
@@ -260,6 +242,7 @@ struct DEV_AirQualitySensor : Service::AirQualitySensor { // A standalone Air Qu
 struct DEV_TemperatureSensor : Service::TemperatureSensor { // A standalone Air Quality sensor
 
 	SpanCharacteristic *temp; // reference to the Temperature Characteristic
+	SpanCharacteristic *tempStatusActive;
 
 	Characteristic::OffsetTemperature offsetTemp{0.0, true};
 
@@ -267,78 +250,45 @@ struct DEV_TemperatureSensor : Service::TemperatureSensor { // A standalone Air
 
 		temp = new Characteristic::CurrentTemperature(-10.0);
 		temp->setRange(-50, 100);
+		tempStatusActive = new Characteristic::StatusActive(false);
 
 		offsetTemp.setUnit("Deg."); // configures custom "Selector" characteristic for use with Eve HomeKit
 		offsetTemp.setDescription("Temperature Offset");
 		offsetTemp.setRange(-5.0, 5.0, 0.2);
 
-		Wire.begin();
-
 		Serial.print("Configuring Temperature Sensor"); // initialization message
 		Serial.print("\n");
 
-		Wire.beginTransmission(si7021Addr);
-		Wire.endTransmission();
-
-		delay(300);
-
-		mySensor_temp.begin(SMOOTHED_EXPONENTIAL, SMOOTHING_COEFF);
-
 	} // end constructor
 
-	void loop() {
-
-		if (temp->timeVal() > INTERVAL * 1000) { // modify the Temperature Characteristic every 10 seconds
-
-			unsigned int data[2];
-
-			Wire.beginTransmission(si7021Addr);
-			// Send temperature measurement command
-			Wire.write(0xF3);
-			Wire.endTransmission();
-			delay(500);
-
-			// Request 2 bytes of data
-			Wire.requestFrom(si7021Addr, 2);
-
-			// Read 2 bytes of data for temperature
-			if (Wire.available() == 2) {
-				data[0] = Wire.read();
-				data[1] = Wire.read();
-			}
-
-			// Convert the data
-			float temperature = ((data[0] * 256.0) + data[1]);
-			temperature		  = ((175.72 * temperature) / 65536.0) - 46.85;
-			mySensor_temp.add(temperature);
-			float offset = offsetTemp.getVal<float>();
-
-			LOG1("Current temperature: ");
-			LOG1(mySensor_temp.get());
-			LOG1("\n");
-
-			LOG1("Offset: ");
-			LOG1(offset);
-			LOG1("\n");
-
-			LOG1("Current corrected temperature: ");
-			LOG1(mySensor_temp.get() + offset);
-			LOG1("\n");
+	// Called from loop() with each Si7021 measurement, after Pipeline::drainReadings() applied the offset
+	void publish(float temperature, float corrected) {
 
-			temp->setVal(mySensor_temp.get() + offset);
+		if (!tempStatusActive->getVal()) {
+			tempStatusActive->setVal(true);
+			Boot::mark("first_temp");
 		}
 
-	} // loop
+		LOG1("Current temperature: ");
+		LOG1(temperature);
+		LOG1("\n");
+
+		LOG1("Current corrected temperature: ");
+		LOG1(corrected);
+		LOG1("\n");
+	}
 };
 
 struct DEV_HumiditySensor : Service::HumiditySensor { // A standalone Air Quality sensor
 
 	SpanCharacteristic			  *hum; // reference to the Temperature Characteristic
+	SpanCharacteristic			  *humStatusActive;
 	Characteristic::OffsetHumidity offsetHum{0, true};
 
 	DEV_HumiditySensor() : Service::HumiditySensor() { // constructor() method
 
-		hum = new Characteristic::CurrentRelativeHumidity();
+		hum				= new Characteristic::CurrentRelativeHumidity();
+		humStatusActive = new Characteristic::StatusActive(false);
 
 		Serial.print("Configuring Humidity Sensor"); // initialization message
 		Serial.print("\n");
@@ -347,146 +297,138 @@ struct DEV_HumiditySensor : Service::HumiditySensor { // A standalone Air Qualit
 		offsetHum.setDescription("Humidity Offset");
 		offsetHum.setRange(-10, 10, 1);
 
-		mySensor_hum.begin(SMOOTHED_EXPONENTIAL, SMOOTHING_COEFF);
-
 	} // end constructor
 
-	void loop() {
-
-		if (hum->timeVal() > INTERVAL * 1000) { // modify the Temperature Characteristic every 10 seconds
-
-			unsigned int data[2];
-
-			Wire.beginTransmission(si7021Addr);
-			// Send humidity measurement command
-			Wire.write(0xF5);
-			Wire.endTransmission();
-			delay(500);
-
-			// Request 2 bytes of data
-			Wire.requestFrom(si7021Addr, 2);
-			// Read 2 bytes of data to get humidity
-			if (Wire.available() == 2) {
-				data[0] = Wire.read();
-				data[1] = Wire.read();
-			}
-
-			// Convert the data
-			float humidity = ((data[0] * 256.0) + data[1]);
-			humidity	   = ((125 * humidity) / 65536.0) - 6;
-			mySensor_hum.add(humidity);
-			float offset = offsetHum.getVal<float>();
-
-			LOG1("Current humidity: ");
-			LOG1(mySensor_hum.get());
-			LOG1("\n");
-
-			LOG1("Offset: ");
-			LOG1(offset);
-			LOG1("\n");
-
-			LOG1("Current corrected humidity: ");
-			LOG1(mySensor_hum.get() + offset);
-			LOG1("\n");
+	// Called from loop() with each Si7021 measurement, after Pipeline::drainReadings() applied the offset
+	void publish(float humidity, float corrected) {
 
-			hum->setVal(mySensor_hum.get() + offset);
+		if (!humStatusActive->getVal()) {
+			humStatusActive->setVal(true);
+			Boot::mark("first_hum");
 		}
 
-	} // loop
+		LOG1("Current humidity: ");
+		LOG1(humidity);
+		LOG1("\n");
+
+		LOG1("Current corrected humidity: ");
+		LOG1(corrected);
+		LOG1("\n");
+	}
 };
 
 #endif
 
 // HELPER FUNCTIONS
 
-void detect_mhz() {
-	// Detect sensor
-	Serial.println("Detecting MH-Z19B");
-	while (!mhz19b.detect()) {
-		pixels.setPixelColor(0, pixels.Color(255, 0, 0));
-		pixels.setBrightness(BRIGHTNESS_DEFAULT);
-		delay(2.5 * 1000);
-		pixels.setPixelColor(0, pixels.Color(0, 0, 0));
-	};
+// Deferred init stages, attempted from loop() by Boot::poll() until they return true
+
+bool initMHZ() {
+	static bool serialStarted = false;
+	if (!serialStarted) {
+		serialStarted = mhzStream.begin(9600, MHZ19B_TX_PIN, MHZ19B_RX_PIN);
+		if (!serialStarted) return false;
+	}
+
+#if HARDWARE_VER != 4
+	// Detect sensor, the stage is retried until a reading comes back
+	mhz19b.poll();
+	if (!mhz19b.detected) {
+		mhz19b.request();
+		return false;
+	}
 	Serial.println("Sensor detected!");
+#endif
+
+	// Enable auto-calibration
+	mhz19b.setAutoCalibration(true);
+	Pipeline::mhzReady = true;
+	return true;
 }
 
-// Fade in to pre-defined color
-void fadeIn(int pixel, int r, int g, int b, double duration) {
-	int brightness = neopixelAutoBrightness();
-	for (int i = 0; i < brightness; i++) {
-		pixels.setPixelColor(pixel, pixels.Color(r, g, b));
-		pixels.setBrightness(i);
-		pixels.show();
-		delay(duration / brightness);
-	}
+bool initPM1006() {
+	if (!pmStream.begin(9600, SerialCom::PIN_UART_RX, SerialCom::PIN_UART_TX)) return false;
+	SerialCom::setup(pmTap);
+	Pipeline::pm1006Ready = true;
+	return true;
 }
 
-// Fade in to pre-defined color
-void fadeIn(int pixel, int r, int g, int b, int brightnessOverride, double duration) {
-	int brightness = brightnessOverride;
-	for (int i = 0; i < brightness; i++) {
-		pixels.setPixelColor(pixel, pixels.Color(r, g, b));
-		pixels.setBrightness(i);
-		pixels.show();
-		delay(duration / brightness);
+// Find the newest page of the flash log, the replay itself waits for NTP (see restoreHistory())
+bool initSampleLog() {
+	if (!historyFlash.begin("history")) {
+		LOG0("No history partition, readings will not survive a reboot\n");
+		return true;
 	}
+	uint32_t pages = sampleLog.recover();
+	LOG0("History log: %lu valid pages, next page %lu\n", (unsigned long)pages, (unsigned long)sampleLog.next);
+	return true;
 }
 
-// Fade out from pre-defined color
-void fadeOut(int pixel, int r, int g, int b, double duration) {
-	int currentBrightness = pixels.getBrightness();
-	for (int i = 0; i < currentBrightness; i++) {
-		pixels.setPixelColor(pixel, pixels.Color(r, g, b));
-		pixels.setBrightness(currentBrightness - i);
-		pixels.show();
-		delay(duration / currentBrightness);
-	}
-	pixels.setPixelColor(pixel, pixels.Color(0, 0, 0));
-	pixels.show();
+#if HARDWARE_VER == 4
+bool initSi7021() {
+	Wire.begin();
+	Pipeline::si7021Ready = si7021.probe();
+	return Pipeline::si7021Ready;
 }
+#endif
 
-void initAnimation() {
-	int duration   = 1000;
-	int brightness = BRIGHTNESS_DEFAULT;
-	// green
-	fadeIn(0, 0, 255, 0, brightness, duration);
-	fadeOut(0, 0, 255, 0, duration);
+// Output stage of the animator, colour already scaled to the wanted brightness
+void showPixel(Animation::Color color) {
+	led.show(color.r, color.g, color.b);
+}
 
-	// yellow
-	fadeIn(0, 255, 165, 0, brightness, duration);
-	fadeOut(0, 255, 165, 0, duration);
+// Acquisition task: drivers, decoders and filters run on ACQUISITION_CORE, so neither HomeSpan nor WiFi
+// can delay a reading, and each result goes to loop() through the readings ring, stamped when it was taken
+void acquisitionTask(void *) {
+	for (;;) {
+		Pipeline::acquire();
+		publishStats();
+		vTaskDelay(pdMS_TO_TICKS(ACQUISITION_TICK_MS));
+	}
+}
 
-	// red
-	fadeIn(0, 255, 0, 0, brightness, duration);
-	fadeOut(0, 255, 0, 0, duration);
+// Copy what /metrics reports, by the acquisition task after each pass
+void publishStats() {
+	acquisitionStats_t s;
+	s.co2			  = Pipeline::co2Filter.get();
+	s.pm25			  = Pipeline::pm25Filter.get();
+	s.temperature	  = Pipeline::temperatureFilter.get();
+	s.humidity		  = Pipeline::humidityFilter.get();
+	s.mhzDetected	  = mhz19b.detected;
+	s.mhzTemperature  = mhz19b.temperature;
+	s.mhzUnclamped	  = mhz19b.co2Unlimited;
+	s.mhzErrors		  = mhz19b.errors;
+	s.mhzTimeouts	  = mhz19b.timeouts;
+	s.mhzOverflows	  = mhz19b.overflows;
+	s.mhzReplies	  = mhz19b.replies;
+	s.mhzLatencySumMs = mhz19b.latencySumMs;
+	s.mhzLatencyMaxUs = mhz19b.latencyMaxUs;
+	s.pmUart		  = pmStream;
+	s.mhzUart		  = mhzStream;
+
+	statsLock.lock();
+	acquisitionStats = s;
+	statsLock.unlock();
+}
 
-	// yellow
-	fadeIn(0, 255, 165, 0, brightness, duration);
-	fadeOut(0, 255, 165, 0, duration);
+// The last copy, for the other core
+acquisitionStats_t statsSnapshot() {
+	statsLock.lock();
+	acquisitionStats_t s = acquisitionStats;
+	statsLock.unlock();
+	return s;
+}
 
-	// green
-	fadeIn(0, 0, 255, 0, brightness, duration);
-	fadeOut(0, 0, 255, 0, duration);
+bool clockSynced() {
+	return time(nullptr) > 1600000000;
 }
 
-// Function for setting brightness based on light sensor values
-int neopixelAutoBrightness() {
-	int sensorValue = analogRead(ANALOG_PIN);
-	// WEBLOG("Lightness: %d", sensorValue);
-	// print the readings in the Serial Monitor
-	Serial.println(sensorValue);
-
-	if (sensorValue < BRIGHTNESS_THRESHOLD) {
-		return BRIGHTNESS_DEFAULT;
-	} else {
-		return BRIGHTNESS_MAX;
-	}
+// History timestamps: unix time once NTP has synced, seconds of uptime before that
+uint32_t historyTime() {
+	return clockSynced() ? time(nullptr) : esp_timer_get_time() / 1000000;
 }
 
 // return raw sensor value
 double getBrightness() {
-	double sensorValue = analogRead(ANALOG_PIN);
-	WEBLOG("Lightness: %f", sensorValue);
-	return sensorValue;
+	return Pipeline::lightLevel;
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Binary delta between two firmware images, made by tools/ota_delta.py.
+ * The new image is rebuilt from three kinds of pieces: bytes copied from
+ * the running image, bytes copied from earlier in the new image (which
+ * is what compresses the patch) and literal bytes carried in the patch.
+ *
+ *   header  "ADP1", old size (u32), old SHA-256, new size (u32), new SHA-256
+ *   op      0x00 LITERAL  length, then the bytes
+ *           0x01 COPY_OLD length, offset in the old image
+ *           0x02 COPY_NEW length, distance back from the end of the output
+ *
+ * Integers in the header are little endian, lengths and offsets in ops
+ * are LEB128 varints. The patch is decoded as it streams in, copies go
+ * through a WINDOW byte buffer, so RAM use doesn't grow with the images.
+ *
+ * Source is the running image, Flash-like with read(addr, buf, len). Out
+ * needs bool emit(data, len), bool readBack(pos, buf, len) for bytes it
+ * was given earlier, and uint32_t produced().
+ */
+namespace DeltaPatch {
+
+	constexpr static const uint8_t	MAGIC[4]	= {'A', 'D', 'P', '1'};
+	constexpr static const size_t	HEADER_SIZE = 4 + 4 + 32 + 4 + 32;
+	constexpr static const uint16_t WINDOW		= 256;
+
+	enum Op : uint8_t {
+		LITERAL,
+		COPY_OLD,
+		COPY_NEW,
+	};
+
+	struct Header {
+		uint32_t oldSize;
+		uint8_t	 oldSha256[32];
+		uint32_t newSize;
+		uint8_t	 newSha256[32];
+	};
+
+	template <typename Source>
+	struct Decoder {
+		Header header;
+		bool   failed = false;
+
+		// The patch must be the one from exactly `expected` old image to the new one
+		void begin(Source &source, const Header &expected) {
+			this->source   = &source;
+			this->expected = expected;
+			failed		   = false;
+			phase		   = HEADER;
+			have		   = 0;
+		}
+
+		// True once the whole new image is out
+		template <typename Out>
+		bool done(Out &out) const {
+			return !failed && phase != HEADER && out.produced() == header.newSize;
+		}
+
+		// Any split of the patch into chunks, false once it can't be applied
+		template <typename Out>
+		bool feed(const uint8_t *data, size_t len, Out &out) {
+			while (len && !failed) {
+				switch (phase) {
+				case HEADER: {
+					size_t n = HEADER_SIZE - have < len ? HEADER_SIZE - have : len;
+					memcpy(window + have, data, n);
+					have += n, data += n, len -= n;
+					if (have == HEADER_SIZE) parseHeader();
+					break;
+				}
+
+				case TAG:
+					if (out.produced() == header.newSize) return fail(); // trailing ops
+					op		 = (Op)*data++, len--;
+					value[0] = value[1] = 0;
+					shift = field = 0;
+					if (op > COPY_NEW) return fail();
+					phase = VARINT;
+					break;
+
+				case VARINT: {
+					uint8_t b = *data++;
+					len--;
+					if (shift > 28) return fail();
+					value[field] |= (uint32_t)(b & 0x7F) << shift;
+					shift += 7;
+					if (b & 0x80) break;
+					shift = 0;
+					if (op == LITERAL) {
+						if (!value[0] || value[0] > header.newSize - out.produced()) return fail();
+						phase = LITERAL_BYTES;
+					} else if (++field == 2) {
+						if (!copy(out)) return fail();
+						phase = TAG;
+					}
+					break;
+				}
+
+				case LITERAL_BYTES: {
+					size_t n = value[0] < len ? value[0] : len;
+					if (!out.emit(data, n)) return fail();
+					value[0] -= n, data += n, len -= n;
+					if (!value[0]) phase = TAG;
+					break;
+				}
+				}
+			}
+			return !failed;
+		}
+
+	private:
+		enum Phase : uint8_t {
+			HEADER,
+			TAG,
+			VARINT,
+			LITERAL_BYTES,
+		};
+
+		Source	*source = nullptr;
+		Header	 expected;
+		Phase	 phase = HEADER;
+		size_t	 have  = 0;
+		Op		 op	   = LITERAL;
+		uint32_t value[2]; // length, then offset or distance
+		uint8_t	 shift = 0, field = 0;
+		uint8_t	 window[HEADER_SIZE > WINDOW ? HEADER_SIZE : WINDOW];
+
+		bool fail() {
+			failed = true;
+			return false;
+		}
+
+		static uint32_t u32(const uint8_t *p) {
+			return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+		}
+
+		void parseHeader() {
+			header.oldSize = u32(window + 4);
+			memcpy(header.oldSha256, window + 8, 32);
+			header.newSize = u32(window + 40);
+			memcpy(header.newSha256, window + 44, 32);
+			bool match = !memcmp(window, MAGIC, 4) && header.oldSize == expected.oldSize && header.newSize == expected.newSize &&
+						 !memcmp(header.oldSha256, expected.oldSha256, 32) && !memcmp(header.newSha256, expected.newSha256, 32);
+			if (!match) fail();
+			phase = TAG;
+		}
+
+		template <typename Out>
+		bool copy(Out &out) {
+			uint32_t length = value[0], at = value[1], produced = out.produced();
+			if (!length || length > header.newSize - produced) return false;
+			if (op == COPY_OLD && (at >= header.oldSize || length > header.oldSize - at)) return false;
+			if (op == COPY_NEW) {
+				if (!at || at > produced) return false;
+				at = produced - at;
+			}
+
+			while (length) {
+				uint32_t n = length < WINDOW ? length : WINDOW;
+				if (op == COPY_NEW && n > out.produced() - at) n = out.produced() - at; // overlapping runs repeat
+				bool read = op == COPY_OLD ? source->read(at, window, n) : out.readBack(at, window, n);
+				if (!read || !out.emit(window, n)) return false;
+				at += n, length -= n;
+			}
+			return true;
+		}
+	};
+} // namespace DeltaPatch
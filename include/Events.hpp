@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "History.hpp"
+
+/**
+ * Server-Sent Events for /events. Published samples go to one shared ring
+ * of RING events and every subscriber keeps a cursor into it, so a
+ * subscriber's backlog is bounded by the ring: one that falls further
+ * behind skips to the oldest event still held and the skipped ones are
+ * counted as dropped. pump() runs from loop() and never blocks, an event
+ * the socket can't take whole stays pending for the next pass.
+ *
+ * accept() answers the GET itself, with the stream's headers or a 503 once
+ * every slot is taken, and keeps the socket. On the wire, one event per
+ * sample, id is a running sequence number a reconnecting client hands back
+ * as Last-Event-ID:
+ *   id: 42
+ *   event: co2
+ *   data: 812
+ *
+ * Client needs int send(const char *, size_t), returning the bytes taken,
+ * 0 when the socket is full and -1 once it is gone, and void close().
+ */
+namespace Events {
+
+	constexpr static const uint32_t HEARTBEAT_MS = 15000; // comment line on idle streams, keeps proxies open and finds dead peers
+
+	constexpr static const char RESPONSE[] = "HTTP/1.1 200 OK\r\n"
+											 "Content-Type: text/event-stream\r\n"
+											 "Cache-Control: no-cache\r\n"
+											 "Connection: keep-alive\r\n"
+											 "Access-Control-Allow-Origin: *\r\n\r\n"
+											 "retry: 5000\n\n"; // reconnect after 5 s
+	constexpr static const char REJECTION[] = "HTTP/1.1 503 Service Unavailable\r\n"
+											  "Content-Type: text/plain\r\n"
+											  "Content-Length: 21\r\n"
+											  "Retry-After: 5\r\n"
+											  "Connection: close\r\n\r\n"
+											  "too many subscribers\n";
+
+	// The Last-Event-ID header of a reconnecting client, 0 (start at the next event) for none or anything but an id
+	inline uint32_t lastEventId(const char *header) {
+		uint64_t id = 0;
+		for (const char *p = header; *p; p++) {
+			if (*p < '0' || *p > '9') return 0;
+			id = id * 10 + (*p - '0');
+			if (id > UINT32_MAX) return 0;
+		}
+		return id;
+	}
+
+	template <typename Client, uint8_t MAX_SUBSCRIBERS = 3, uint8_t RING = 32>
+	struct Hub {
+		struct Event {
+			History::Channel channel;
+			int16_t			 value; // History::scale() units
+		};
+
+		struct Subscriber {
+			Client	 client;
+			bool	 active = false;
+			uint32_t cursor;	 // id of the next event to send
+			uint32_t lastSentMs; // last event or heartbeat
+			char	 pending[64];
+			uint8_t	 len, sent;
+		};
+
+		Event	   ring[RING];
+		uint32_t   nextId = 1;
+		Subscriber subscribers[MAX_SUBSCRIBERS];
+
+		// Stats
+		uint32_t connects	 = 0;
+		uint32_t rejected	 = 0;
+		uint32_t disconnects = 0;
+		uint32_t dropped	 = 0; // events a subscriber fell too far behind to get
+
+		void publish(History::Channel channel, float value) {
+			ring[nextId % RING] = {channel, History::scale(channel, value)};
+			nextId++;
+		}
+
+		uint8_t count() const {
+			uint8_t n = 0;
+			for (const Subscriber &s : subscribers) n += s.active;
+			return n;
+		}
+
+		// A new /events connection: the stream's headers and a subscription, or a 503 and the socket closed when
+		// every slot is taken. The socket is fresh, either response fits its send buffer. false if turned away
+		bool accept(Client client, const char *lastEventIdHeader, uint32_t now) {
+			if (count() == MAX_SUBSCRIBERS) {
+				rejected++;
+				client.send(REJECTION, sizeof(REJECTION) - 1);
+				client.close();
+				return false;
+			}
+			if (client.send(RESPONSE, sizeof(RESPONSE) - 1) != sizeof(RESPONSE) - 1) {
+				client.close();
+				return false;
+			}
+			return subscribe(client, lastEventId(lastEventIdHeader), now);
+		}
+
+		// The response headers are already out, false when every slot is taken
+		bool subscribe(const Client &client, uint32_t lastEventId, uint32_t now) {
+			for (Subscriber &s : subscribers) {
+				if (s.active) continue;
+				s.client	 = client;
+				s.active	 = true;
+				s.cursor	 = lastEventId && lastEventId < nextId ? lastEventId + 1 : nextId;
+				s.lastSentMs = now;
+				s.len = s.sent = 0;
+				connects++;
+				return true;
+			}
+			rejected++;
+			return false;
+		}
+
+		void pump(uint32_t now) {
+			for (Subscriber &s : subscribers) {
+				if (!s.active) continue;
+
+				if (s.sent == s.len) {
+					if (s.cursor != nextId) {
+						if (nextId - s.cursor > RING) {
+							dropped += nextId - s.cursor - RING;
+							s.cursor = nextId - RING;
+						}
+						format(s, s.cursor++);
+					} else if (now - s.lastSentMs >= HEARTBEAT_MS) {
+						s.len  = snprintf(s.pending, sizeof(s.pending), ":\n\n");
+						s.sent = 0;
+					} else {
+						continue;
+					}
+				}
+
+				int n = s.client.send(s.pending + s.sent, s.len - s.sent);
+				if (n < 0) {
+					s.client.close();
+					s.active = false;
+					disconnects++;
+					continue;
+				}
+				s.sent += n;
+				if (n) s.lastSentMs = now;
+			}
+		}
+
+	private:
+		// Subscribers are usually level, the last event formatted is kept for the next one
+		char	 text[64];
+		uint8_t	 textLen = 0;
+		uint32_t textId	 = 0;
+
+		void format(Subscriber &s, uint32_t id) {
+			if (id != textId) {
+				const Event &e		= ring[id % RING];
+				float		 scale	= History::CHANNELS[e.channel].scale;
+				uint8_t		 digits = scale >= 100 ? 2 : scale >= 10 ? 1 : 0;
+				int			 n		= snprintf(text, sizeof(text), "id: %lu\nevent: %s\ndata: %.*f\n\n", (unsigned long)id, History::CHANNELS[e.channel].name, digits, e.value / scale);
+				textLen				= n < (int)sizeof(text) ? n : sizeof(text) - 1;
+				textId				= id;
+			}
+			memcpy(s.pending, text, textLen);
+			s.len  = textLen;
+			s.sent = 0;
+		}
+	};
+} // namespace Events
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Compile-time filter chains for the sensor channels. Every stage works on
+ * int32 fixed-point samples (value * SCALE of the chain) with fixed-size
+ * state, and a Chain composes stages by type, so a channel's whole
+ * smoothing path is inlined: no virtual calls, no heap, no float maths
+ * past the conversion at the chain's input and output.
+ *
+ *   Chain<100, Median<3>, Ema<3>> temperature; // 0.01 deg C steps
+ *   temperature.push(21.37f);
+ *
+ * Every stage has int32_t push(int32_t) returning its output for that
+ * sample and reset(). Before a window has filled, stages work on the
+ * samples seen so far.
+ */
+namespace Filters {
+
+	// Round-to-nearest division, also for negative numerators
+	inline int32_t divRound(int32_t num, int32_t den) {
+		return num >= 0 ? (num + den / 2) / den : (num - den / 2) / den;
+	}
+
+	// Last N samples, oldest overwritten first
+	template <uint8_t N>
+	struct Window {
+		static_assert(N > 0, "empty window");
+
+		int32_t v[N];
+		uint8_t head = 0, count = 0;
+
+		// Returns the sample pushed out of the window, only meaningful when full() was true before
+		int32_t add(int32_t x) {
+			int32_t out = v[head];
+			v[head]		= x;
+			head		= (head + 1) % N;
+			if (count < N) count++;
+			return out;
+		}
+
+		bool full() const {
+			return count == N;
+		}
+
+		// Median of the samples held, the lower one for an even count
+		int32_t median() const {
+			int32_t s[N];
+			for (uint8_t i = 0; i < count; i++) s[i] = v[i];
+			return select(s, count);
+		}
+
+		void reset() {
+			head = count = 0;
+		}
+
+		// Insertion sort, N is a handful of samples
+		static int32_t select(int32_t *s, uint8_t n) {
+			for (uint8_t i = 1; i < n; i++) {
+				int32_t x = s[i];
+				uint8_t j = i;
+				for (; j > 0 && s[j - 1] > x; j--) s[j] = s[j - 1];
+				s[j] = x;
+			}
+			return s[(n - 1) / 2];
+		}
+	};
+
+	// Median of the last N samples, rejects spikes shorter than N / 2 + 1 samples
+	template <uint8_t N>
+	struct Median {
+		Window<N> window;
+
+		int32_t push(int32_t x) {
+			window.add(x);
+			return window.median();
+		}
+
+		void reset() {
+			window.reset();
+		}
+	};
+
+	/**
+	 * Hampel outlier filter: a sample further than K * 1.5 * MAD from the
+	 * median of the last N is replaced by that median. FLOOR is the smallest
+	 * deviation ever treated as an outlier, so a quiet, quantised signal
+	 * (MAD = 0) still passes steps of a count or two.
+	 */
+	template <uint8_t N, uint8_t K = 3, int32_t FLOOR = 2>
+	struct Hampel {
+		Window<N> window;
+		uint32_t  replaced = 0;
+
+		int32_t push(int32_t x) {
+			window.add(x);
+			if (window.count < 3) return x;
+
+			int32_t median = window.median();
+			int32_t dev[N];
+			for (uint8_t i = 0; i < window.count; i++) dev[i] = abs(window.v[i] - median);
+			int32_t mad = Window<N>::select(dev, window.count);
+
+			int32_t d = abs(x - median);
+			if (d > FLOOR && 2 * d > 3 * K * mad) {
+				replaced++;
+				return median;
+			}
+			return x;
+		}
+
+		void reset() {
+			window.reset();
+		}
+	};
+
+	// Exponential moving average with alpha = 1 / 2^SHIFT, 8 extra fraction bits so small steps don't stall
+	template <uint8_t SHIFT>
+	struct Ema {
+		constexpr static const uint8_t FRAC = 8;
+
+		int32_t acc	   = 0;
+		bool	primed = false;
+
+		int32_t push(int32_t x) {
+			int32_t fx = x * (1 << FRAC);
+			if (!primed) {
+				acc	   = fx;
+				primed = true;
+			} else {
+				acc += (fx - acc) >> SHIFT;
+			}
+			return divRound(acc, 1 << FRAC);
+		}
+
+		void reset() {
+			primed = false;
+		}
+	};
+
+	// Mean of the last N samples, running sum so each push is O(1)
+	template <uint8_t N>
+	struct WindowMean {
+		Window<N> window;
+		int32_t	  sum = 0;
+
+		int32_t push(int32_t x) {
+			bool	full = window.full();
+			int32_t out	 = window.add(x);
+			sum += x - (full ? out : 0);
+			return divRound(sum, window.count);
+		}
+
+		void reset() {
+			window.reset();
+			sum = 0;
+		}
+	};
+
+	// Holds the output until the input moves at least D away from it
+	template <int32_t D>
+	struct Deadband {
+		int32_t out	   = 0;
+		bool	primed = false;
+
+		int32_t push(int32_t x) {
+			if (!primed || abs(x - out) >= D) {
+				out	   = x;
+				primed = true;
+			}
+			return out;
+		}
+
+		void reset() {
+			primed = false;
+		}
+	};
+
+	template <typename... Stages>
+	struct Pipeline;
+
+	template <>
+	struct Pipeline<> {
+		int32_t push(int32_t x) {
+			return x;
+		}
+
+		void reset() {}
+	};
+
+	template <typename Stage, typename... Rest>
+	struct Pipeline<Stage, Rest...> {
+		Stage			 stage;
+		Pipeline<Rest...> rest;
+
+		int32_t push(int32_t x) {
+			return rest.push(stage.push(x));
+		}
+
+		void reset() {
+			stage.reset();
+			rest.reset();
+		}
+	};
+
+	// Stages applied in order, samples are value * SCALE
+	template <int32_t SCALE, typename... Stages>
+	struct Chain {
+		Pipeline<Stages...> stages;
+		int32_t				out	  = 0;
+		uint32_t			count = 0;
+
+		int32_t pushFixed(int32_t x) {
+			out = stages.push(x);
+			count++;
+			return out;
+		}
+
+		float push(float x) {
+			float scaled = x * SCALE;
+			return pushFixed((int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f)) / (float)SCALE;
+		}
+
+		float get() const {
+			return out / (float)SCALE;
+		}
+
+		bool ready() const {
+			return count > 0;
+		}
+
+		void reset() {
+			stages.reset();
+			out	  = 0;
+			count = 0;
+		}
+	};
+
+	// Per-channel chains
+
+	// MH-Z19B every 10 s: drop single-reading glitches, then smooth (was Smoothed exponential, 10)
+	using Co2 = Chain<1, Median<3>, Ema<3>>;
+
+	// PM1006 frames every ~2 s: reject fan and UART glitches, then average 5 frames (was parseState's block average)
+	using Pm25Frames = Chain<1, Hampel<7>, WindowMean<5>>;
+
+	// Published PM2.5, mean of the last 4 updates (was Smoothed average, 4)
+	using Pm25 = Chain<1, WindowMean<4>>;
+
+	// Si7021 every 10 s, in 0.01 units: smooth, then ignore last-digit flicker
+	using Temperature = Chain<100, Median<3>, Ema<3>, Deadband<3>>;
+	using Humidity	  = Chain<100, Median<3>, Ema<3>, Deadband<10>>;
+} // namespace Filters
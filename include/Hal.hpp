@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Thin hardware abstraction for the sensor drivers. Drivers only talk to
+ * these interfaces, so the same parsing and timing code runs on the ESP32
+ * (HalEsp32.hpp) and on the host against simulated devices (src/native/).
+ * Calls happen at sensor rates, a virtual call per byte or transfer is noise.
+ */
+namespace Hal {
+
+	// UART-like byte stream, reads never block
+	struct ByteStream {
+		virtual int	   available()							  = 0;
+		virtual int	   read()								  = 0; // -1 when empty
+		virtual size_t write(const uint8_t *data, size_t len) = 0;
+	};
+
+	struct I2CBus {
+		virtual bool	write(uint8_t addr, const uint8_t *data, uint8_t len) = 0; // false on NACK
+		virtual uint8_t read(uint8_t addr, uint8_t *data, uint8_t len)		  = 0; // bytes actually read, 0 on NACK
+	};
+
+	struct Adc {
+		virtual uint16_t read() = 0;
+	};
+
+	struct Led {
+		virtual void show(uint8_t r, uint8_t g, uint8_t b) = 0;
+	};
+
+	struct Clock {
+		virtual uint64_t micros() = 0; // monotonic, since boot
+
+		uint32_t millis() {
+			return micros() / 1000;
+		}
+	};
+} // namespace Hal
+
+// Driver diagnostics, the serial console on the device, stderr with --verbose on the host
+#ifdef ARDUINO
+#include <Arduino.h>
+#define HAL_LOG(...) Serial.printf(__VA_ARGS__)
+#else
+#include <stdio.h>
+namespace Hal {
+	inline bool verbose = false;
+}
+#define HAL_LOG(...) (Hal::verbose ? (void)fprintf(stderr, __VA_ARGS__) : (void)0)
+#endif
+
+// Guards state shared between loop() and a background task, held for a few copies at most
+namespace Hal {
+#ifdef ARDUINO
+	struct Lock {
+		portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+		void lock() {
+			portENTER_CRITICAL(&mux);
+		}
+
+		void unlock() {
+			portEXIT_CRITICAL(&mux);
+		}
+	};
+#else
+	struct Lock { // the host build is single-threaded
+		void lock() {}
+		void unlock() {}
+	};
+#endif
+} // namespace Hal
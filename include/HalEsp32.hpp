@@ -0,0 +1,326 @@
+#pragma once
+
+#include <Adafruit_NeoPixel.h>
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <Wire.h>
+#include <driver/uart.h>
+#include <errno.h>
+#include <limits.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#ifdef SENSOR_SOFTWARE_SERIAL
+#include <SoftwareSerial.h>
+#endif
+
+#include "Hal.hpp"
+#include "Settings.hpp"
+#include "cert.hpp"
+
+// Hal backends for the ESP32 board
+namespace HalEsp32 {
+
+	// Receive errors of a sensor UART, exported at /metrics
+	struct UartStats {
+		uint32_t overruns	   = 0; // times bytes were lost to a full FIFO or buffer
+		uint32_t framingErrors = 0; // characters garbled on the wire
+	};
+
+	// Hardware UART through the IDF driver, whose ISR empties the RX FIFO into a ring buffer, so reads
+	// only copy out of RAM and no byte depends on when the reading task gets to run
+	struct UartStream : Hal::ByteStream, UartStats {
+		uart_port_t	  port;
+		QueueHandle_t events = nullptr; // errors reported by the ISR
+
+		UartStream(uart_port_t port) : port(port) {}
+
+		// 8N1, any pins through the GPIO matrix
+		bool begin(uint32_t baud, int rxPin, int txPin) {
+			uart_config_t config = {};
+			config.baud_rate	 = baud;
+			config.data_bits	 = UART_DATA_8_BITS;
+			config.parity		 = UART_PARITY_DISABLE;
+			config.stop_bits	 = UART_STOP_BITS_1;
+			config.flow_ctrl	 = UART_HW_FLOWCTRL_DISABLE;
+			config.source_clk	 = UART_SCLK_APB;
+			bool installed = uart_is_driver_installed(port) || uart_driver_install(port, 512, 0, 16, &events, 0) == ESP_OK;
+			return installed && uart_param_config(port, &config) == ESP_OK &&
+				   uart_set_pin(port, txPin, rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) == ESP_OK;
+		}
+
+		int available() override {
+			countErrors();
+			size_t n = 0;
+			uart_get_buffered_data_len(port, &n);
+			return n;
+		}
+
+		int read() override {
+			uint8_t b;
+			return uart_read_bytes(port, &b, 1, 0) == 1 ? b : -1;
+		}
+
+		size_t write(const uint8_t *data, size_t len) override {
+			int n = uart_write_bytes(port, (const char *)data, len); // no TX buffer, a command fits the FIFO
+			return n < 0 ? 0 : n;
+		}
+
+	private:
+		void countErrors() {
+			uart_event_t event;
+			while (events && xQueueReceive(events, &event, 0)) {
+				switch (event.type) {
+				case UART_FIFO_OVF:
+				case UART_BUFFER_FULL:
+					overruns++;
+					uart_flush_input(port); // the buffered bytes have a gap, the decoders resync on the next frame
+					xQueueReset(events);
+					return;
+				case UART_FRAME_ERR:
+				case UART_PARITY_ERR:
+					framingErrors++;
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	};
+
+#ifdef SENSOR_SOFTWARE_SERIAL
+	// EspSoftwareSerial fallback, bit-banged from a GPIO interrupt per edge. It can only tell overruns
+	struct SoftSerialStream : Hal::ByteStream, UartStats {
+		SoftwareSerial serial;
+
+		bool begin(uint32_t baud, int rxPin, int txPin) {
+			serial.begin(baud, SWSERIAL_8N1, rxPin, txPin);
+			return true;
+		}
+
+		int available() override {
+			if (serial.overflow()) overruns++;
+			return serial.available();
+		}
+
+		int read() override {
+			return serial.read();
+		}
+
+		size_t write(const uint8_t *data, size_t len) override {
+			return serial.write(data, len);
+		}
+	};
+#endif
+
+	struct WireBus : Hal::I2CBus {
+		TwoWire &wire;
+
+		WireBus(TwoWire &wire) : wire(wire) {}
+
+		bool write(uint8_t addr, const uint8_t *data, uint8_t len) override {
+			wire.beginTransmission(addr);
+			wire.write(data, len);
+			return wire.endTransmission() == 0;
+		}
+
+		uint8_t read(uint8_t addr, uint8_t *data, uint8_t len) override {
+			uint8_t n = wire.requestFrom(addr, len);
+			for (uint8_t i = 0; i < n; i++) data[i] = wire.read();
+			return n;
+		}
+	};
+
+	struct AnalogPin : Hal::Adc {
+		uint8_t pin;
+
+		AnalogPin(uint8_t pin) : pin(pin) {}
+
+		uint16_t read() override {
+			return analogRead(pin);
+		}
+	};
+
+	// First pixel of a NeoPixel strip
+	struct NeoPixelLed : Hal::Led {
+		Adafruit_NeoPixel &pixels;
+
+		NeoPixelLed(Adafruit_NeoPixel &pixels) : pixels(pixels) {}
+
+		void show(uint8_t r, uint8_t g, uint8_t b) override {
+			pixels.setPixelColor(0, pixels.Color(r, g, b));
+			pixels.show();
+		}
+	};
+
+	// Client side of an /events stream for Events::Hub, writes never wait on the TCP window
+	struct EventSocket {
+		WiFiClient client; // a copy keeps the socket open after the WebServer lets go of it
+
+		int send(const char *data, size_t len) {
+			int n = ::send(client.fd(), data, len, MSG_DONTWAIT);
+			if (n >= 0) return n;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+
+		void close() {
+			client.stop();
+		}
+	};
+
+	/**
+	 * HTTP(S) client for one background task. The connection is kept between
+	 * requests when the server allows it, and dropped when a request goes to
+	 * another scheme, host or port; another path on the same server reuses
+	 * it. https is verified against ca, the root certificate in cert.hpp
+	 * unless the owner sets another one; it applies from the next connection.
+	 *
+	 * There is no TLS session cache: WiFiClientSecure keeps its mbedtls
+	 * context to itself. A request that finds the connection closed, which
+	 * is every version check an hour after the last, pays a full handshake.
+	 */
+	struct HttpConnection {
+		constexpr static const size_t URL_SIZE = 160;
+
+		HTTPClient		 http;
+		WiFiClient		 plain;
+		WiFiClientSecure tls;
+		char			 lastOrigin[URL_SIZE + 8] = "";
+		const char		*ca						  = rootCACertificate; // PEM
+
+		HttpConnection(uint16_t timeoutMs) {
+			http.setReuse(true);
+			http.setTimeout(timeoutMs);
+		}
+
+		bool begin(const char *url) {
+			char target[sizeof(lastOrigin)];
+			origin(url, target, sizeof(target));
+			if (strcmp(target, lastOrigin)) { // don't reuse a connection to the old server
+				http.end();
+				plain.stop();
+				tls.stop();
+				strlcpy(lastOrigin, target, sizeof(lastOrigin));
+			}
+			tls.setCACert(ca); // only read while connecting
+			return !strncmp(url, "https:", 6) ? http.begin(tls, url) : http.begin(plain, url);
+		}
+
+		// scheme://host:port of url, with the scheme's default port filled in so http://a and http://a:80 match
+		static void origin(const char *url, char *out, size_t size) {
+			const char *host = strstr(url, "://");
+			host			 = host ? host + 3 : url;
+			size_t		len	 = strcspn(host, "/?#");
+			const char *port = nullptr;
+			for (const char *p = host; p < host + len; p++) {
+				if (*p == ':') port = p;
+				if (*p == ']') port = nullptr; // a colon of an IPv6 literal
+			}
+			const char *fallback = port ? "" : !strncmp(url, "https:", 6) ? ":443" : ":80";
+			snprintf(out, size, "%.*s%.*s%s", (int)(host - url), url, (int)len, host, fallback);
+		}
+	};
+
+	// Push exporter transport, url, token and CA are read at every request so a change at /config applies to the next one.
+	// The push server is the owner's, its https is verified against caPem and only falls back to cert.hpp while that is empty
+	struct HttpPoster {
+		const char	  *url;
+		const char	  *token;
+		const char	  *caPem;
+		HttpConnection conn{5000};
+
+		HttpPoster(const char *url, const char *token, const char *caPem) : url(url), token(token), caPem(caPem) {}
+
+		int post(const char *body, size_t len) {
+			char target[HttpConnection::URL_SIZE];
+			strlcpy(target, url, sizeof(target));
+			strlcpy(ca, caPem, sizeof(ca));
+			conn.ca = *ca ? ca : rootCACertificate;
+			if (!conn.begin(target)) return -1;
+			conn.http.addHeader("Content-Type", "text/plain; charset=utf-8");
+			if (*token) conn.http.addHeader("Authorization", String("Token ") + token);
+			int status = conn.http.POST((uint8_t *)body, len);
+			conn.http.end(); // keeps the socket when reuse is possible
+			return status;
+		}
+
+	private:
+		char ca[sizeof(Settings::pushCa)]; // the copy the handshake reads
+	};
+
+	// GETs for the update task: get() is UpdateCheck's transport, fetch() Updater's
+	struct HttpGetter {
+		HttpConnection conn{10000};
+
+		template <typename Request, typename Response>
+		int get(const char *url, const Request &request, Response &response) {
+			char target[HttpConnection::URL_SIZE];
+			strlcpy(target, url, sizeof(target));
+			if (!conn.begin(target)) return -1;
+			if (*request.etag) conn.http.addHeader("If-None-Match", request.etag);
+			if (*request.lastModified) conn.http.addHeader("If-Modified-Since", request.lastModified);
+			const char *keys[] = {"ETag", "Last-Modified"};
+			conn.http.collectHeaders(keys, 2);
+
+			int status = conn.http.GET();
+			if (status == 200) {
+				strlcpy(response.etag, conn.http.header("ETag").c_str(), sizeof(response.etag));
+				strlcpy(response.lastModified, conn.http.header("Last-Modified").c_str(), sizeof(response.lastModified));
+				strlcpy(response.body, conn.http.getString().c_str(), sizeof(response.body));
+			}
+			conn.http.end();
+			return status;
+		}
+
+		template <typename Sink>
+		int fetch(const char *url, uint32_t from, Sink &sink) {
+			char target[HttpConnection::URL_SIZE];
+			strlcpy(target, url, sizeof(target));
+			if (!conn.begin(target)) return -1;
+			if (from) {
+				char range[24];
+				snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)from);
+				conn.http.addHeader("Range", range);
+			}
+			const char *keys[] = {"Content-Range"};
+			conn.http.collectHeaders(keys, 1);
+
+			int status = conn.http.GET();
+			if (status != 200 && status != 206) {
+				conn.http.end();
+				return status;
+			}
+
+			unsigned long offset = 0;
+			if (status == 206 && sscanf(conn.http.header("Content-Range").c_str(), "bytes %lu-", &offset) != 1) offset = ULONG_MAX;
+			int remaining = conn.http.getSize(); // -1 without a Content-Length
+			if (sink.begin(offset)) {
+				WiFiClient *stream	  = conn.http.getStreamPtr();
+				uint8_t		buf[1024];
+				uint32_t	idleSince = millis();
+				while (remaining && (conn.http.connected() || stream->available())) {
+					size_t n = stream->available();
+					if (!n) {
+						if (millis() - idleSince > 10000) break; // stalled
+						vTaskDelay(1);
+						continue;
+					}
+					n		  = stream->readBytes(buf, n < sizeof(buf) ? n : sizeof(buf));
+					idleSince = millis();
+					if (remaining > 0) remaining -= n;
+					if (!sink.write(buf, n)) break;
+				}
+			}
+			if (remaining) conn.http.getStreamPtr()->stop(); // the rest of the body would be read as the next response
+			conn.http.end();
+			return status;
+		}
+	};
+
+	struct SystemClock : Hal::Clock {
+		uint64_t micros() override {
+			return esp_timer_get_time();
+		}
+	};
+} // namespace HalEsp32
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Fixed-memory, multi-resolution sample history. Every channel keeps
+ * three ring buffers (10 s raw for 1 h, 1 min for 24 h, 15 min for 7 days)
+ * fed directly from ingest(); the coarser tiers accumulate min, max and
+ * mean for the bucket in progress and commit it when time moves into the
+ * next bucket. Ingest is O(1) (amortised over gaps) and all storage is
+ * sized at compile time.
+ *
+ * Times are seconds on a monotonic clock supplied by the caller, values
+ * are stored as int16 scaled per channel.
+ */
+namespace History {
+
+	enum Channel : uint8_t {
+		CO2,
+		PM25,
+		TEMPERATURE,
+		HUMIDITY,
+		LIGHT,
+		CHANNEL_COUNT,
+	};
+
+	struct ChannelInfo {
+		const char *name;
+		float		scale; // stored = value * scale
+	};
+
+	constexpr static const ChannelInfo CHANNELS[CHANNEL_COUNT] = {
+		{"co2", 1},			 // ppm
+		{"pm25", 1},		 // ug/m3
+		{"temperature", 100}, // 0.01 deg C
+		{"humidity", 100},	 // 0.01 %
+		{"light", 1},		 // raw ADC
+	};
+
+	constexpr static const int16_t EMPTY = INT16_MIN; // slot without samples
+
+	struct Bucket {
+		int16_t min, max, mean;
+	};
+
+	// Running aggregate of the bucket in progress
+	struct Accumulator {
+		int16_t min, max;
+		int32_t sum;
+		uint16_t count;
+
+		void reset() {
+			min = INT16_MAX, max = INT16_MIN + 1, sum = 0, count = 0;
+		}
+
+		void add(int16_t v) {
+			if (v < min) min = v;
+			if (v > max) max = v;
+			sum += v;
+			count++;
+		}
+
+		Bucket bucket() const {
+			return {min, max, (int16_t)(sum / count)};
+		}
+	};
+
+	inline Bucket toBucket(int16_t v) { return {v, v, v}; }
+	inline Bucket toBucket(const Bucket &b) { return b; }
+	inline bool	  isEmpty(int16_t v) { return v == EMPTY; }
+	inline bool	  isEmpty(const Bucket &b) { return b.mean == EMPTY; }
+	inline void	  store(int16_t &slot, const Accumulator &acc) { slot = acc.sum / acc.count; }
+	inline void	  store(Bucket &slot, const Accumulator &acc) { slot = acc.bucket(); }
+	inline void	  clear(int16_t &slot) { slot = EMPTY; }
+	inline void	  clear(Bucket &slot) { slot = {EMPTY, EMPTY, EMPTY}; }
+
+	/**
+	 * One resolution. Slot is int16_t for the raw tier (min = max = mean)
+	 * and Bucket for the aggregated ones.
+	 */
+	template <uint32_t PERIOD, uint16_t LEN, typename Slot>
+	struct Tier {
+		constexpr static const uint32_t period = PERIOD;
+		constexpr static const uint16_t length = LEN;
+
+		Slot		ring[LEN];
+		uint32_t	current = 0; // index (time / PERIOD) of the bucket being accumulated
+		bool		started = false;
+		Accumulator acc;
+
+		Tier() {
+			for (uint16_t i = 0; i < LEN; i++) clear(ring[i]);
+			acc.reset();
+		}
+
+		void add(uint32_t t, int16_t v) {
+			uint32_t index = t / PERIOD;
+
+			if (!started) {
+				started = true;
+				current = index;
+			} else if (index != current) {
+				if ((int32_t)(index - current) < 0) return; // clock went backwards, drop
+				commit(index);
+			}
+			acc.add(v);
+		}
+
+		// Oldest index still held in the ring
+		uint32_t oldest() const {
+			return current >= LEN ? current - LEN + 1 : 0;
+		}
+
+		// Call fn(time, bucket) for every non-empty bucket starting at or after from, oldest first.
+		// The bucket in progress is reported last
+		template <typename Fn>
+		void forEach(uint32_t from, Fn fn) const {
+			if (!started) return;
+
+			uint32_t first = from / PERIOD;
+			if (first < oldest()) first = oldest();
+
+			for (uint32_t i = first; i < current; i++) {
+				const Slot &slot = ring[i % LEN];
+				if (!isEmpty(slot)) fn(i * PERIOD, toBucket(slot));
+			}
+			if (acc.count && current >= first) fn(current * PERIOD, acc.bucket());
+		}
+
+	private:
+		void commit(uint32_t next) {
+			if (acc.count) store(ring[current % LEN], acc);
+			else clear(ring[current % LEN]);
+
+			// Blank the buckets skipped by a gap, at most one lap of the ring
+			uint32_t gap = next - current - 1;
+			if (gap > LEN) gap = LEN;
+			for (uint32_t i = 1; i <= gap; i++) clear(ring[(next - i) % LEN]);
+
+			current = next;
+			acc.reset();
+		}
+	};
+
+	struct Series {
+		Tier<10, 360, int16_t>	raw;	// 1 h
+		Tier<60, 1440, Bucket>	minute; // 24 h
+		Tier<900, 672, Bucket>	quarter; // 7 days
+
+		void add(uint32_t t, int16_t v) {
+			raw.add(t, v);
+			minute.add(t, v);
+			quarter.add(t, v);
+		}
+	};
+
+	// Convert to the stored fixed-point representation, rounded and clamped
+	inline int16_t scale(Channel ch, float value) {
+		float scaled = value * CHANNELS[ch].scale;
+		if (scaled > INT16_MAX) scaled = INT16_MAX;
+		if (scaled < INT16_MIN + 1) scaled = INT16_MIN + 1;
+		return (int16_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+	}
+
+	struct Store {
+		Series series[CHANNEL_COUNT];
+
+		void ingest(Channel ch, uint32_t t, float value) {
+			series[ch].add(t, scale(ch, value));
+		}
+
+		// Already scaled, used when replaying persisted samples
+		void ingestRaw(Channel ch, uint32_t t, int16_t value) {
+			series[ch].add(t, value);
+		}
+
+		// Resolution of the tier forEach() picks for res
+		uint32_t period(uint32_t res) const {
+			if (res <= series[0].raw.period) return series[0].raw.period;
+			if (res <= series[0].minute.period) return series[0].minute.period;
+			return series[0].quarter.period;
+		}
+
+		// Call fn(time, bucket) from the finest tier whose resolution is at least res seconds
+		template <typename Fn>
+		uint32_t forEach(Channel ch, uint32_t from, uint32_t res, Fn fn) const {
+			const Series &s = series[ch];
+			if (res <= s.raw.period) {
+				s.raw.forEach(from, fn);
+				return s.raw.period;
+			}
+			if (res <= s.minute.period) {
+				s.minute.forEach(from, fn);
+				return s.minute.period;
+			}
+			s.quarter.forEach(from, fn);
+			return s.quarter.period;
+		}
+
+		static bool channel(const char *name, Channel &ch) {
+			for (uint8_t i = 0; i < CHANNEL_COUNT; i++) {
+				const char *a = name, *b = CHANNELS[i].name;
+				while (*a && *a == *b) a++, b++;
+				if (*a == *b) {
+					ch = (Channel)i;
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+} // namespace History
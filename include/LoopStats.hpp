@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Metrics.hpp"
+
+/**
+ * Loop latency instrumentation. Each subsystem called from loop() (and
+ * the Service::loop() bodies, nested inside homeSpan.poll()) is wrapped in
+ * a Scope that feeds a log2-bucketed latency histogram. Whole iterations
+ * over budgetUs are kept, with every subsystem's share, in a small ring so
+ * a HomeKit hiccup can be traced back to whoever caused it.
+ * All storage is static, a Scope costs two clock reads.
+ */
+namespace LoopStats {
+
+	enum Subsystem : uint8_t {
+		LOOP, // whole loop() iteration
+		BOOT,
+		POLL, // homeSpan.poll(), includes the Service::loop() bodies below
+		HTTP,
+		JOBS, // scheduler.run(), includes OTA
+		OTA,
+		ANIMATION,
+		READINGS, // drainReadings(), publishing what the acquisition task measured
+		CO2_LOOP,
+		SUBSYSTEM_COUNT,
+	};
+
+	constexpr static const char *NAMES[SUBSYSTEM_COUNT] = {"loop", "boot", "poll", "http", "jobs", "ota", "animation", "readings", "co2_loop"};
+
+	// Subsystems called directly from loop(), a stall is blamed on the slowest of these
+	constexpr static const bool TOP_LEVEL[SUBSYSTEM_COUNT] = {false, true, true, true, true, false, true, true, false};
+
+	constexpr static const uint8_t BUCKETS = 24; // bucket i counts durations in [2^i, 2^(i+1)) us, the last one is open
+	constexpr static const uint8_t STALLS  = 8;
+
+	struct Histogram {
+		uint32_t buckets[BUCKETS];
+		uint32_t count;
+		uint64_t sumUs;
+		uint32_t maxUs;
+
+		void add(uint32_t us) {
+			uint8_t i = 0;
+			while (i < BUCKETS - 1 && (us >> (i + 1))) i++;
+			buckets[i]++;
+			count++;
+			sumUs += us;
+			if (us > maxUs) maxUs = us;
+		}
+	};
+
+	struct Stall {
+		uint32_t  atMs;
+		uint32_t  totalUs;
+		Subsystem culprit;
+		uint32_t  us[SUBSYSTEM_COUNT];
+	};
+
+	inline Histogram histograms[SUBSYSTEM_COUNT];
+	inline uint32_t	 iteration[SUBSYSTEM_COUNT]; // time spent per subsystem in the current iteration
+	inline Stall	 stalls[STALLS];
+	inline uint8_t	 stallHead	= 0;
+	inline uint32_t	 stallCount = 0;
+	inline uint32_t	 budgetUs	= 50000;
+
+	inline uint64_t (*clock)() = nullptr; // microseconds since boot, set in setup()
+
+	struct Scope {
+		Subsystem subsystem;
+		uint64_t  start;
+
+		Scope(Subsystem subsystem) : subsystem(subsystem), start(clock()) {}
+
+		~Scope() {
+			uint32_t us = clock() - start;
+			histograms[subsystem].add(us);
+			iteration[subsystem] += us;
+		}
+	};
+
+	// Wraps one loop() iteration, records a stall when it went over budget
+	struct Iteration {
+		uint64_t start;
+
+		Iteration() : start(clock()) {
+			memset(iteration, 0, sizeof(iteration));
+		}
+
+		~Iteration() {
+			uint32_t us = clock() - start;
+			histograms[LOOP].add(us);
+			if (us <= budgetUs) return;
+
+			Stall &stall  = stalls[stallHead];
+			stallHead	  = (stallHead + 1) % STALLS;
+			stall.atMs	  = start / 1000;
+			stall.totalUs = us;
+			stall.culprit = LOOP;
+			memcpy(stall.us, iteration, sizeof(iteration));
+			uint32_t worst = 0;
+			for (uint8_t i = 0; i < SUBSYSTEM_COUNT; i++) {
+				if (TOP_LEVEL[i] && iteration[i] > worst) {
+					worst		  = iteration[i];
+					stall.culprit = (Subsystem)i;
+				}
+			}
+			stallCount++;
+		}
+	};
+
+	// Prometheus histogram, exported at every other log2 boundary (16 us .. 4.2 s) to keep scrapes small
+	inline void collectLatency(Metrics::Writer &w, const Metrics::Family &f) {
+		char labels[64];
+		w.header(f);
+		for (uint8_t s = 0; s < SUBSYSTEM_COUNT; s++) {
+			const Histogram &h	 = histograms[s];
+			uint32_t		 cum = 0;
+			for (uint8_t i = 0; i < BUCKETS - 1; i++) {
+				cum += h.buckets[i];
+				if ((i + 1) % 2 || i + 1 < 4) continue;
+				snprintf(labels, sizeof(labels), "subsystem=\"%s\",le=\"%.10g\"", NAMES[s], (1UL << (i + 1)) / 1e6);
+				w.sample(f, "_bucket", labels, cum);
+			}
+			snprintf(labels, sizeof(labels), "subsystem=\"%s\",le=\"+Inf\"", NAMES[s]);
+			w.sample(f, "_bucket", labels, h.count);
+			snprintf(labels, sizeof(labels), "subsystem=\"%s\"", NAMES[s]);
+			w.sample(f, "_sum", labels, h.sumUs / 1e6);
+			w.sample(f, "_count", labels, h.count);
+		}
+	}
+
+	inline void collectMax(Metrics::Writer &w, const Metrics::Family &f) {
+		char labels[48];
+		w.header(f);
+		for (uint8_t s = 0; s < SUBSYSTEM_COUNT; s++) {
+			snprintf(labels, sizeof(labels), "subsystem=\"%s\"", NAMES[s]);
+			w.sample(f, "", labels, histograms[s].maxUs / 1e6);
+		}
+	}
+
+	// Plain-text summary for /debug/loop, newest stall first
+	template <typename Out>
+	void report(Out &out) {
+		out.printf("budget_us=%lu stalls=%lu\n\n", (unsigned long)budgetUs, (unsigned long)stallCount);
+		out.printf("%-10s %10s %12s %10s\n", "subsystem", "calls", "mean_us", "max_us");
+		for (uint8_t s = 0; s < SUBSYSTEM_COUNT; s++) {
+			const Histogram &h = histograms[s];
+			out.printf("%-10s %10lu %12lu %10lu\n", NAMES[s], (unsigned long)h.count, (unsigned long)(h.count ? h.sumUs / h.count : 0), (unsigned long)h.maxUs);
+		}
+
+		uint8_t n = stallCount < STALLS ? stallCount : STALLS;
+		for (uint8_t k = 0; k < n; k++) {
+			const Stall &stall = stalls[(stallHead + STALLS - 1 - k) % STALLS];
+			out.printf("\nstall at %lu ms: %lu us, culprit %s\n", (unsigned long)stall.atMs, (unsigned long)stall.totalUs, NAMES[stall.culprit]);
+			for (uint8_t s = 1; s < SUBSYSTEM_COUNT; s++) {
+				if (stall.us[s]) out.printf("  %-10s %10lu us\n", NAMES[s], (unsigned long)stall.us[s]);
+			}
+		}
+	}
+} // namespace LoopStats
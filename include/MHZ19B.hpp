@@ -0,0 +1,176 @@
+#pragma once
+
+#include "Hal.hpp"
+
+/**
+ * Non-blocking MH-Z19B driver. Commands go into a small queue and are sent
+ * one at a time, poll() assembles each reply as it trickles in on the UART,
+ * checks it and sends the next command right away. Same request/poll split
+ * as the Si7021 driver, so a slow or absent sensor never stalls the caller.
+ *
+ * A reading is two commands: 0x86 for the CO2 level the sensor reports
+ * (clamped to its range) and its internal temperature, then 0x85 for the
+ * unclamped level. ABC and the zero and span calibrations are written
+ * without waiting for an answer, the sensor may or may not send one.
+ */
+struct MHZ19B {
+
+	constexpr static const uint8_t	FRAME_LEN		   = 9; // 0xFF, command, 6 data bytes, checksum
+	constexpr static const uint8_t	CMD_READ_CO2	   = 0x86;
+	constexpr static const uint8_t	CMD_READ_UNLIMITED = 0x85;
+	constexpr static const uint8_t	CMD_ABC			   = 0x79;
+	constexpr static const uint8_t	CMD_ZERO		   = 0x87; // after 20 minutes in 400 ppm fresh air
+	constexpr static const uint8_t	CMD_SPAN		   = 0x88; // after zero, in a known concentration
+	constexpr static const uint32_t WARMUP_MS		   = 3 * 60 * 1000; // readings are meaningless before that
+	constexpr static const uint16_t TIMEOUT_MS		   = 200;			// ~20 ms on the wire, the rest is sensor latency
+	constexpr static const uint8_t	QUEUE			   = 4;
+
+	enum State : uint8_t {
+		IDLE,
+		WAITING,
+	};
+
+	struct Command {
+		uint8_t cmd;
+		uint8_t arg[2];
+	};
+
+	Hal::ByteStream &stream;
+	Hal::Clock		&clock;
+	State			 state	 = IDLE;
+	uint8_t			 pending = 0; // command whose reply is awaited
+	uint64_t		 sentUs	 = 0;
+	Command			 queue[QUEUE];
+	uint8_t			 queued = 0;
+	uint8_t			 frame[FRAME_LEN];
+	uint8_t			 idx = 0;
+
+	// Readings
+	bool	 detected	  = false; // set by the first valid reply
+	uint32_t seq		  = 0;	   // incremented on every completed CO2 reading
+	uint16_t co2		  = 0;	   // ppm
+	int16_t	 temperature  = 0;	   // C, the sensor's own, a few degrees above the air
+	uint16_t co2Unlimited = 0;	   // ppm, not clamped to the range, from the last 0x85 reply
+
+	// Stats
+	uint32_t errors		  = 0; // replies with a bad checksum
+	uint32_t timeouts	  = 0;
+	uint32_t overflows	  = 0; // commands refused with the queue full
+	uint32_t replies	  = 0; // valid replies, the latency counts these
+	uint32_t latencySumMs = 0; // command sent to reply checked
+	uint32_t latencyMaxUs = 0;
+
+	MHZ19B(Hal::ByteStream &stream, Hal::Clock &clock) : stream(stream), clock(clock) {}
+
+	static uint8_t checksum(const uint8_t *frame) {
+		uint8_t sum = 0;
+		for (uint8_t i = 1; i < FRAME_LEN - 1; i++) sum += frame[i];
+		return 0xFF - sum + 1;
+	}
+
+	bool warmingUp() {
+		return clock.millis() < WARMUP_MS;
+	}
+
+	// Start a CO2 reading, ignored while the previous one is still outstanding
+	void request() {
+		if (outstanding(CMD_READ_CO2)) return;
+		enqueue({CMD_READ_CO2, {0, 0}});
+		enqueue({CMD_READ_UNLIMITED, {0, 0}});
+	}
+
+	// Collect the reply to the command in flight and send the next one, never waits for bytes that have not arrived yet
+	void poll() {
+		if (state == WAITING) collect();
+		if (state == IDLE && queued) sendNext();
+	}
+
+	void setAutoCalibration(bool on) {
+		enqueue({CMD_ABC, {(uint8_t)(on ? 0xA0 : 0x00), 0}});
+	}
+
+	// Whatever the air is now becomes 400 ppm
+	void calibrateZero() {
+		enqueue({CMD_ZERO, {0, 0}});
+	}
+
+	void calibrateSpan(uint16_t ppm) {
+		enqueue({CMD_SPAN, {(uint8_t)(ppm >> 8), (uint8_t)ppm}});
+	}
+
+private:
+	static bool expectsReply(uint8_t cmd) {
+		return cmd == CMD_READ_CO2 || cmd == CMD_READ_UNLIMITED;
+	}
+
+	bool outstanding(uint8_t cmd) const {
+		if (state == WAITING && pending == cmd) return true;
+		for (uint8_t i = 0; i < queued; i++) {
+			if (queue[i].cmd == cmd) return true;
+		}
+		return false;
+	}
+
+	void enqueue(const Command &command) {
+		if (queued == QUEUE) {
+			overflows++;
+			return;
+		}
+		queue[queued++] = command;
+		if (state == IDLE) sendNext();
+	}
+
+	void sendNext() {
+		Command command = queue[0];
+		for (uint8_t i = 1; i < queued; i++) queue[i - 1] = queue[i];
+		queued--;
+
+		while (stream.available()) stream.read(); // stale bytes would misalign the reply
+		uint8_t out[FRAME_LEN] = {0xFF, 0x01, command.cmd, command.arg[0], command.arg[1], 0, 0, 0, 0};
+		out[FRAME_LEN - 1]	   = checksum(out);
+		stream.write(out, sizeof(out));
+		if (!expectsReply(command.cmd)) return;
+
+		idx		= 0;
+		pending = command.cmd;
+		sentUs	= clock.micros();
+		state	= WAITING;
+	}
+
+	void collect() {
+		while (stream.available()) {
+			uint8_t b = stream.read();
+			if (idx == 0 && b != 0xFF) continue; // hunt for the start byte
+			frame[idx++] = b;
+			if (idx < FRAME_LEN) continue;
+
+			idx = 0;
+			if (frame[1] != pending) continue; // reply to a fire-and-forget command
+			state = IDLE;					   // the reply is in, usable or not
+			if (frame[FRAME_LEN - 1] != checksum(frame)) {
+				errors++;
+				return;
+			}
+
+			uint32_t us = clock.micros() - sentUs;
+			replies++;
+			latencySumMs += (us + 500) / 1000;
+			if (us > latencyMaxUs) latencyMaxUs = us;
+
+			if (pending == CMD_READ_CO2) {
+				co2			= (frame[2] << 8) | frame[3];
+				temperature = frame[4] - 40;
+				detected	= true;
+				seq++;
+			} else {
+				co2Unlimited = (frame[4] << 8) | frame[5];
+			}
+			return;
+		}
+
+		if (clock.micros() - sentUs >= TIMEOUT_MS * 1000ULL) {
+			timeouts++;
+			state = IDLE;
+		}
+	}
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * OpenMetrics text renderer. Metric families are declared once in a const
+ * table with their name, type and help text, and scrapes are rendered into
+ * a fixed buffer that is handed to a sink (the HTTP socket) whenever it
+ * fills up, so a scrape never touches the heap. A line that doesn't fit
+ * the line buffer is dropped and counted rather than cut, a cut line
+ * would fail the parse of the whole scrape.
+ */
+namespace Metrics {
+
+	enum Type : uint8_t {
+		GAUGE,
+		COUNTER,
+		HISTOGRAM,
+		SUMMARY,
+	};
+
+	constexpr static const char *TYPE_NAMES[] = {"gauge", "counter", "histogram", "summary"};
+
+	constexpr static const char *CONTENT_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+	// Labels attached to every sample
+	constexpr static const char *DEFAULT_LABELS = "device=\"air_sensor\",location=\"home\"";
+
+	struct Writer;
+
+	struct Family {
+		const char *name;
+		Type		type;
+		const char *help;
+		bool		(*value)(double &out);					   // single-sample families, false skips the family
+		void		(*collect)(Writer &w, const Family &family); // anything else, writes its own samples
+	};
+
+	struct Writer {
+		typedef void (*Sink)(const char *data, size_t len);
+
+		constexpr static const size_t LINE = 192; // longest line printf() formats, a /config line is up to 176
+
+		char	*buf;
+		size_t	 size;
+		size_t	 len = 0;
+		Sink	 sink;
+		uint32_t dropped = 0; // lines longer than LINE
+
+		Writer(char *buf, size_t size, Sink sink) : buf(buf), size(size), sink(sink) {}
+
+		void flush() {
+			if (len) sink(buf, len);
+			len = 0;
+		}
+
+		void write(const char *s, size_t n) {
+			while (n) {
+				if (len == size) flush();
+				size_t chunk = size - len < n ? size - len : n;
+				memcpy(buf + len, s, chunk);
+				len += chunk;
+				s += chunk;
+				n -= chunk;
+			}
+		}
+
+		void write(const char *s) {
+			write(s, strlen(s));
+		}
+
+		// One line, or nothing if it comes out longer than LINE
+		__attribute__((format(printf, 2, 3))) void printf(const char *fmt, ...) {
+			char	line[LINE];
+			va_list args;
+			va_start(args, fmt);
+			int n = vsnprintf(line, sizeof(line), fmt, args);
+			va_end(args);
+			if (n >= (int)sizeof(line)) dropped++;
+			else if (n > 0) write(line, n);
+		}
+
+		void header(const Family &f) {
+			printf("# TYPE %s %s\n", f.name, TYPE_NAMES[f.type]);
+			printf("# HELP %s %s\n", f.name, f.help);
+		}
+
+		// name{DEFAULT_LABELS,labels} value, suffix is appended to the family name (_total, _bucket, ...)
+		void sample(const Family &f, const char *suffix, const char *labels, double value) {
+			char number[24];
+			printf("%s%s{%s%s%s} %s\n", f.name, suffix, DEFAULT_LABELS, labels[0] ? "," : "", labels, format(number, value));
+		}
+
+		void sample(const Family &f, double value) {
+			sample(f, f.type == COUNTER ? "_total" : "", "", value);
+		}
+
+		// OpenMetrics spells the non-finite values +Inf, -Inf and NaN, printf would give inf and nan
+		static const char *format(char (&out)[24], double value) {
+			if (isnan(value)) return "NaN";
+			if (isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+			snprintf(out, sizeof(out), "%.10g", value);
+			return out;
+		}
+	};
+
+	template <size_t N>
+	void render(const Family (&families)[N], Writer &w) {
+		for (size_t i = 0; i < N; i++) {
+			const Family &f = families[i];
+			if (f.collect) {
+				f.collect(w, f);
+				continue;
+			}
+
+			double value;
+			if (!f.value(value)) continue;
+			w.header(f);
+			w.sample(f, value);
+		}
+		w.write("# EOF\n");
+		w.flush();
+	}
+} // namespace Metrics
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Metrics.hpp"
+
+/**
+ * Notification policy for the value characteristics. Every setVal() sends
+ * an encrypted event to each paired controller, so readings are offered
+ * to a Gate first, which only lets them through when they moved past the
+ * deadband (the larger of an absolute and a relative step), no sooner than
+ * minMs after the last event, and at least every heartbeatMs regardless.
+ */
+namespace Notify {
+
+	enum Characteristic : uint8_t {
+		CO2,
+		PM25,
+		AIR_QUALITY,
+		TEMPERATURE,
+		HUMIDITY,
+		CHARACTERISTIC_COUNT,
+	};
+
+	struct Policy {
+		const char *name;
+		float		absolute;	 // deadband in the characteristic's unit
+		float		relative;	 // deadband as a fraction of the last sent value
+		uint32_t	minMs;		 // events never come closer than this
+		uint32_t	heartbeatMs; // an event is sent at least this often
+	};
+
+	// HomeKit shows temperature in 0.1 and humidity in 1 % steps, anything finer is noise to a controller
+	constexpr static const Policy POLICIES[CHARACTERISTIC_COUNT] = {
+		{"co2", 10, 0.02f, 20000, 600000},
+		{"pm25", 2, 0.05f, 20000, 600000},
+		{"air_quality", 1, 0, 0, 1800000},
+		{"temperature", 0.1f, 0, 30000, 600000},
+		{"humidity", 1, 0, 30000, 600000},
+	};
+
+	struct Gate {
+		const Policy &policy;
+		float		  last	 = 0;
+		uint32_t	  lastMs = 0;
+		bool		  primed = false;
+
+		// Stats
+		uint32_t sent		= 0;
+		uint32_t suppressed = 0;
+
+		explicit Gate(const Policy &policy) : policy(policy) {}
+
+		// True when value should be sent now, the caller then calls setVal()
+		bool offer(float value, uint32_t now) {
+			uint32_t elapsed = now - lastMs;
+			float	 band	 = fmaxf(policy.absolute, policy.relative * fabsf(last));
+
+			if (primed && (elapsed < policy.minMs || (elapsed < policy.heartbeatMs && fabsf(value - last) < band))) {
+				suppressed++;
+				return false;
+			}
+
+			last   = value;
+			lastMs = now;
+			primed = true;
+			sent++;
+			return true;
+		}
+	};
+
+	inline Gate gates[CHARACTERISTIC_COUNT] = {
+		Gate(POLICIES[CO2]),
+		Gate(POLICIES[PM25]),
+		Gate(POLICIES[AIR_QUALITY]),
+		Gate(POLICIES[TEMPERATURE]),
+		Gate(POLICIES[HUMIDITY]),
+	};
+
+	inline bool offer(Characteristic c, float value, uint32_t now) {
+		return gates[c].offer(value, now);
+	}
+
+	// homekit_notifications_total{characteristic, result="sent"|"suppressed"}
+	inline void collect(Metrics::Writer &w, const Metrics::Family &f) {
+		char labels[64];
+		w.header(f);
+		for (uint8_t c = 0; c < CHARACTERISTIC_COUNT; c++) {
+			snprintf(labels, sizeof(labels), "characteristic=\"%s\",result=\"sent\"", POLICIES[c].name);
+			w.sample(f, "_total", labels, gates[c].sent);
+			snprintf(labels, sizeof(labels), "characteristic=\"%s\",result=\"suppressed\"", POLICIES[c].name);
+			w.sample(f, "_total", labels, gates[c].suppressed);
+		}
+	}
+} // namespace Notify
@@ -1,106 +1,66 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
-#include <HTTPUpdate.h>
 #include <WiFiClientSecure.h>
+#include "Version.hpp"
 #include "cert.hpp"
+#include "HalEsp32.hpp"
+#include "Settings.hpp"
+#include "PartitionFlash.hpp"
+#include "UpdateCheck.hpp"
+#include "UpdateFlow.hpp"
+#include "Updater.hpp"
+#include <atomic>
 #include <HomeSpan.h>
 
-#define URL_fw_Version "https://raw.githubusercontent.com/oleksiikutuzov/esp32-homekit-air-quality/V4.0/bin_version.txt"
-
-#if HARDWARE_VER == 4
-#define URL_fw_Bin "https://raw.githubusercontent.com/oleksiikutuzov/esp32-homekit-air-quality/V4.0/esp32_air_quality_v4.bin"
-#else
-#define URL_fw_Bin "https://raw.githubusercontent.com/oleksiikutuzov/esp32-homekit-air-quality/V4.0/esp32_air_quality_v3.bin"
-#endif
-#define FW_VERSION "1.4.3"
-
 String FirmwareVer = {
 	FW_VERSION};
 
-void firmwareUpdate();
-int	 FirmwareVersionCheck();
-
-unsigned long previousMillis = 0;			   // will store last time LED was updated
-const long	  interval		 = 60 * 60 * 1000; // 1 hour in ms
-
-void repeatedCall() {
-	static int	  num			= 0;
-	unsigned long currentMillis = millis();
-
-	if ((currentMillis - previousMillis) >= interval) {
-		// save the last time you blinked the LED
-		previousMillis = currentMillis;
-		if (FirmwareVersionCheck()) {
-			firmwareUpdate();
-		}
-	}
+#define OTA_WRITE_PAUSE_MS 20 // after every 4 KB sector, so loop() gets the flash back
+
+// Version check against Settings::updateUrl, see UpdateCheck.hpp; the download against Settings::otaManifestUrl, see Updater.hpp
+HalEsp32::HttpGetter								updateGetter; // one connection for both
+UpdateCheck::Checker<HalEsp32::HttpGetter>			updateChecker(updateGetter, systemClock);
+PartitionFlash										otaSlot;
+PartitionFlash										runningSlot;
+Updater::Job<HalEsp32::HttpGetter, PartitionFlash> updater(updateGetter, otaSlot, systemClock);
+std::atomic<bool>									updatePending(false); // set by updateTask once the new image boots next
+
+// Called by the scheduler, reboots into a verified update. Runs on loop() because sampleLog isn't shared with other tasks
+void checkForUpdate() {
+	if (!updatePending.exchange(false)) return;
+	sampleLog.flush(); // don't lose the batched samples
+	LOG0("Rebooting into firmware %s\n", updater.manifest.version);
+	ESP.restart();
 }
 
-void firmwareUpdate(void) {
-	WiFiClientSecure client;
-	client.setCACert(rootCACertificate);
-	t_httpUpdate_return ret = httpUpdate.update(client, URL_fw_Bin);
-
-	switch (ret) {
-	case HTTP_UPDATE_FAILED:
-		LOG1("HTTP_UPDATE_FAILED Error (%d): %s\n", httpUpdate.getLastError(), httpUpdate.getLastErrorString().c_str());
-		break;
-
-	case HTTP_UPDATE_NO_UPDATES:
-		LOG1("HTTP_UPDATE_NO_UPDATES");
-		break;
-
-	case HTTP_UPDATE_OK:
-		LOG1("HTTP_UPDATE_OK");
-		break;
-	}
+// The update task's side of UpdateFlow::Task, see updateTask()
+bool prepareUpdate() {
+	if (!otaSlot.beginNextApp()) return false;
+	updater.throttle = []() { vTaskDelay(pdMS_TO_TICKS(OTA_WRITE_PAUSE_MS)); };
+	updater.running	 = runningSlot.beginRunningApp() ? &runningSlot : nullptr; // a delta if the manifest has one for this build
+	return true;
 }
 
-int FirmwareVersionCheck(void) {
-	String payload;
-	int	   httpCode;
-	String fwurl = "";
-	fwurl += URL_fw_Version;
-	fwurl += "?";
-	fwurl += String(rand());
-	Serial.println(fwurl);
-	WiFiClientSecure *client = new WiFiClientSecure;
-
-	if (client) {
-		client->setCACert(rootCACertificate);
-
-		// Add a scoping block for HTTPClient https to make sure it is destroyed before WiFiClientSecure *client is
-		HTTPClient https;
+void logCheck(UpdateCheck::Result result) {
+	LOG1("Version check: %s (HTTP %d, %lu ms, latest %s)\n", UpdateCheck::RESULT_NAMES[result], updateChecker.lastStatus, (unsigned long)updateChecker.lastMs, updateChecker.latest);
+}
 
-		if (https.begin(*client, fwurl)) { // HTTPS
-			Serial.print("[HTTPS] GET...\n");
-			// start connection and send HTTP header
-			delay(100);
-			httpCode = https.GET();
-			delay(100);
-			if (httpCode == HTTP_CODE_OK) // if version received
-			{
-				payload = https.getString(); // save received version
-			} else {
-				Serial.print("error in downloading version file:");
-				Serial.println(httpCode);
-			}
-			https.end();
-		}
-		delete client;
-	}
+void logUpdate() {
+	LOG1("Firmware update %s: %s, %lu bytes from %s, %lu resumes, %lu ms\n", updater.manifest.version, Updater::STATE_NAMES[updater.state],
+		 (unsigned long)updater.written, updater.delta ? "a delta" : "the full image", (unsigned long)updater.resumes, (unsigned long)updater.lastMs);
+	if (updater.state == Updater::READY) updatePending = true;
+}
 
-	if (httpCode == HTTP_CODE_OK) // if version received
-	{
-		payload.trim();
-		if (payload.equals(FirmwareVer)) {
-			Serial.printf("\nDevice already on latest firmware version:%s\n", FirmwareVer);
-			return 0;
-		} else {
-			Serial.println(payload);
-			Serial.println("New firmware detected");
-			return 1;
-		}
+// Checks and downloads in the background, loop() carries on meanwhile. A TLS handshake takes seconds
+void updateTask(void *) {
+	static UpdateFlow::Task<UpdateCheck::Checker<HalEsp32::HttpGetter>, Updater::Job<HalEsp32::HttpGetter, PartitionFlash>> flow(updateChecker, updater, systemClock, FW_VERSION);
+	flow.prepare  = prepareUpdate;
+	flow.activate = []() { return otaSlot.activate(); };
+	flow.checked  = logCheck;
+	flow.finished = logUpdate;
+	for (;;) {
+		uint32_t waitMs = flow.step();
+		if (!updater.busy() && waitMs > 1000) waitMs = 1000; // picks up /config changes within a second, a download's backoff stands
+		if (waitMs) vTaskDelay(pdMS_TO_TICKS(waitMs));
 	}
-	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace PM1006 {
+	constexpr static const uint8_t FRAME_LEN = 20; // 3 header bytes + 16 data bytes + checksum
+	constexpr static const uint8_t HEADER[3] = {0x16, 0x11, 0x0B};
+
+	/**
+	 * Byte-at-a-time decoder for the PM1006 frames sent by the VINDRIKTNING
+	 * board. Hunts for the header, keeps a running checksum and resyncs on
+	 * the next header candidate when a frame turns out to be corrupt.
+	 * Never blocks and never needs the frame to be aligned to a read() burst.
+	 */
+	struct FrameDecoder {
+		uint8_t frame[FRAME_LEN];
+		uint8_t idx		 = 0;
+		uint8_t checksum = 0;
+
+		uint32_t framesOk		= 0;
+		uint32_t checksumErrors = 0;
+		uint32_t bytesDiscarded = 0;
+
+		void reset() {
+			idx		 = 0;
+			checksum = 0;
+		}
+
+		// Feed one byte, returns true when frame[] holds a complete frame with a valid checksum
+		bool push(uint8_t b) {
+			if (idx < sizeof(HEADER) && b != HEADER[idx]) {
+				bytesDiscarded += idx + 1;
+				reset();
+				if (b != HEADER[0]) return false;
+				bytesDiscarded--; // this byte may start the next frame
+			}
+
+			frame[idx++] = b;
+			checksum += b;
+
+			if (idx < FRAME_LEN) return false;
+
+			if (checksum == 0) {
+				framesOk++;
+				reset();
+				return true;
+			}
+
+			// Corrupt frame: a real header may be hidden in the bytes we already consumed
+			checksumErrors++;
+			resync();
+			return false;
+		}
+
+		// PM2.5 in ug/m3, DF3 (MSB) and DF4 (LSB)
+		uint16_t pm25() const {
+			return (frame[5] << 8) | frame[6];
+		}
+
+	private:
+		void resync() {
+			uint8_t tail[FRAME_LEN - 1];
+			memcpy(tail, frame + 1, sizeof(tail));
+			reset();
+			bytesDiscarded++;
+			// Fewer than FRAME_LEN bytes are replayed, so this can never complete (or fail) a frame
+			for (uint8_t i = 0; i < sizeof(tail); i++) {
+				push(tail[i]);
+			}
+		}
+	};
+
+	// HomeKit AirQuality level (1 excellent .. 5 poor) for a PM2.5 density in ug/m3
+	inline uint8_t airQuality(float pm25) {
+		if (pm25 >= 150) return 5;
+		if (pm25 >= 55) return 4;
+		if (pm25 >= 35) return 3;
+		if (pm25 >= 12) return 2;
+		return 1;
+	}
+} // namespace PM1006
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+// Flash backend for SampleLog on a raw data partition from partitions.csv, and for Updater on an app slot
+struct PartitionFlash {
+	const esp_partition_t *partition = nullptr;
+
+	bool begin(const char *label) {
+		partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+		return partition != nullptr;
+	}
+
+	// The app slot not running now, where an update goes
+	bool beginNextApp() {
+		partition = esp_ota_get_next_update_partition(nullptr);
+		return partition != nullptr;
+	}
+
+	// The app slot running now, what deltas apply to
+	bool beginRunningApp() {
+		partition = esp_ota_get_running_partition();
+		return partition != nullptr;
+	}
+
+	// Boots the slot next time, the bootloader checks the image first
+	bool activate() {
+		return partition && esp_ota_set_boot_partition(partition) == ESP_OK;
+	}
+
+	uint32_t size() const {
+		return partition ? partition->size : 0;
+	}
+
+	bool read(uint32_t addr, void *dst, size_t len) {
+		return esp_partition_read(partition, addr, dst, len) == ESP_OK;
+	}
+
+	bool write(uint32_t addr, const void *src, size_t len) {
+		return esp_partition_write(partition, addr, src, len) == ESP_OK;
+	}
+
+	bool erase(uint32_t addr, size_t len) {
+		return esp_partition_erase_range(partition, addr, len) == ESP_OK;
+	}
+};
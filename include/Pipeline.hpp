@@ -0,0 +1,257 @@
+#pragma once
+
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+
+#include "Animation.hpp"
+#include "Filters.hpp"
+#include "Hal.hpp"
+#include "History.hpp"
+#include "MHZ19B.hpp"
+#include "Notify.hpp"
+#include "PM1006.hpp"
+#include "Restore.hpp"
+#include "Scheduler.hpp"
+#include "ScrapeWindow.hpp"
+#include "SerialCom.hpp"
+#include "Si7021.hpp"
+#include "SlidingWindow.hpp"
+#include "SpscRing.hpp"
+#include "Types.hpp"
+
+#define BRIGHTNESS_DEFAULT	 9	 // Default (dimmed) brightness
+#define BRIGHTNESS_MAX		 150 // maximum brightness of CO2 indicator led
+#define BRIGHTNESS_THRESHOLD 500 // TODO calibrate Threshold value of dimmed brightness
+
+/**
+ * The sensor pipeline from the drivers to the services, the same code on
+ * the device (DEV_Sensors.hpp, main.cpp) and in the host build
+ * (src/native/Simulation.hpp). The acquisition task runs the sensor jobs,
+ * decoders and filters in acquire() and hands each reading to loop()
+ * through the readings ring; drainReadings() records it (RAM history,
+ * scrape and rolling windows, flash log, push queue), streams it to
+ * /events, offers it to HomeKit through Notify and drives the LED.
+ *
+ * What differs between the boards goes through the hooks below, set in
+ * setup() before setupJobs(). The drivers are the board's, and so are the
+ * flash log, the push queue and the /events hub, whose types depend on it.
+ */
+namespace Pipeline {
+
+	constexpr static const uint8_t READINGS_SIZE = 64; // readings in flight to loop(), a few INTERVALs worth
+
+	// Board, set in setup()
+	inline Hal::Clock		   *clock	 = nullptr;
+	inline MHZ19B			   *mhz19b	 = nullptr;
+	inline Si7021			   *si7021	 = nullptr; // none on V3
+	inline Hal::Adc			   *light	 = nullptr;
+	inline Animation::Animator *animator = nullptr;
+	inline bool (*clockSynced)()		 = nullptr;
+	inline uint32_t (*historyTime)()	 = nullptr; // unix time once synced, uptime before that
+
+	inline void (*logSample)(History::Channel channel, uint32_t t, int16_t value)  = nullptr; // flash log append
+	inline Restore::Result (*replayLog)(History::Store &history, uint32_t now)	   = nullptr; // see Restore::replay()
+	inline void (*pushSample)(uint32_t t, History::Channel channel, float value)	= nullptr; // push queue, nullptr for none
+	inline void (*streamSample)(History::Channel channel, float value)			   = nullptr; // /events
+	inline float (*offset)(History::Channel channel)								   = nullptr; // user correction of temperature and humidity, nullptr for none
+	inline void (*show)(Notify::Characteristic c, float value)					   = nullptr; // HomeKit, once Notify lets a value through
+	inline void (*published)(History::Channel channel, float raw, float shown)		= nullptr; // after each reading, for the services' own state
+	inline void (*restored)(const Restore::Result &result)							   = nullptr; // after the replay
+
+	// Acquisition task side
+	inline std::atomic<bool>	 needToWarmUp{true};
+	inline std::atomic<bool>	 mhzReady{false}; // set by the board's init stages, the acquisition task waits for them
+	inline std::atomic<bool>	 pm1006Ready{false};
+	inline std::atomic<bool>	 si7021Ready{false};
+	inline std::atomic<uint32_t> mhzCalibration{0}; // from /co2/calibrate, command << 16 | argument
+	inline particleSensorState_t state;
+	inline Filters::Co2			 co2Filter; // chains are declared in Filters.hpp
+	inline Filters::Pm25		 pm25Filter;
+	inline Filters::Temperature	 temperatureFilter;
+	inline Filters::Humidity	 humidityFilter;
+	inline Scheduler<4>			 acquisition; // sensor jobs, run by acquire()
+	inline SpscRing<sensorReading_t, READINGS_SIZE> readings; // acquisition task to loop()
+	inline float								   filterSeeds[History::CHANNEL_COUNT]; // last logged values, NAN if none, see restoreHistory()
+	inline std::atomic<bool>					   filterSeedsReady{false};
+
+	// loop() side
+	inline History::Store history;				   // raw readings of every channel, served at /history
+	inline bool			  historyRestored = false; // set once the log was replayed, appends start after that
+	inline float		  lightLevel	  = 0;	   // last raw light sensor reading
+	inline uint8_t		  airQuality	  = 0;
+
+	// What the user set to correct a channel by, on top of the sensor's reading in the history and in HomeKit
+	inline float offsetOf(History::Channel channel) {
+		if (!offset || (channel != History::TEMPERATURE && channel != History::HUMIDITY)) return 0;
+		return offset(channel);
+	}
+
+	inline void emitReading(History::Channel channel, float raw, float filtered) {
+		readings.push({channel, raw, filtered}, clock->micros());
+	}
+
+	// Start a CO2 reading, acquire() picks up the reply
+	inline void requestCo2() {
+		if (needToWarmUp || !mhzReady) return;
+		mhz19b->request();
+	}
+
+	inline void samplePm25() {
+		if (!state.valid) return;
+		emitReading(History::PM25, state.avgPM25, pm25Filter.push(state.avgPM25));
+	}
+
+	// Temperature and humidity come from one measurement
+	inline void requestSi7021() {
+		if (si7021Ready) si7021->request();
+	}
+
+	inline void sampleLight() {
+		float level = light->read();
+		emitReading(History::LIGHT, level, level);
+	}
+
+	// Jobs share the period but are spread evenly across it, so their work never lands in the same pass
+	inline void setupJobs(uint32_t period, uint32_t now) {
+		acquisition.add("co2", requestCo2, period, 0, now);
+		acquisition.add("pm25", samplePm25, period, period / 4, now);
+		if (si7021) acquisition.add("si7021", requestSi7021, period, period / 2, now);
+		acquisition.add("light", sampleLight, period, period * 3 / 4, now);
+	}
+
+	template <typename Chain>
+	void seedFilter(Chain &filter, History::Channel channel) {
+		if (!isnan(filterSeeds[channel]) && !filter.ready()) filter.push(filterSeeds[channel]);
+	}
+
+	// Smoothing picks up where it was before the reboot, in a filter that has no live reading yet. By the
+	// acquisition task, the filters are its own
+	inline void seedFilters() {
+		if (!filterSeedsReady.exchange(false)) return;
+		seedFilter(co2Filter, History::CO2);
+		seedFilter(pm25Filter, History::PM25);
+		seedFilter(temperatureFilter, History::TEMPERATURE);
+		seedFilter(humidityFilter, History::HUMIDITY);
+	}
+
+	// One pass of the acquisition task
+	inline void acquire() {
+		static uint32_t co2Seq = 0; // last reading emitted
+		static uint32_t siSeq  = 0;
+
+		seedFilters();
+
+		acquisition.run(clock->millis());
+
+		if (pm1006Ready) {
+			SerialCom::handleUart(state); // cheap, keeps the UART buffer drained between samples
+		}
+
+		if (mhzReady) {
+			uint32_t calibration = mhzCalibration.exchange(0);
+			if (calibration >> 16 == MHZ19B::CMD_ZERO) mhz19b->calibrateZero();
+			if (calibration >> 16 == MHZ19B::CMD_SPAN) mhz19b->calibrateSpan(calibration & 0xFFFF);
+			if (calibration >> 16 == MHZ19B::CMD_ABC) mhz19b->setAutoCalibration(calibration & 1);
+
+			mhz19b->poll();
+			if (mhz19b->seq != co2Seq) { // a new reading is available
+				co2Seq = mhz19b->seq;
+				if (!needToWarmUp && mhz19b->co2 >= 400) emitReading(History::CO2, mhz19b->co2, co2Filter.push(mhz19b->co2)); // the V3 detection reading comes in during warm-up
+			}
+		}
+
+		if (si7021 && si7021Ready) {
+			si7021->poll(); // collects the measurement requested by the job once converted
+			if (si7021->seq != siSeq) {
+				siSeq = si7021->seq;
+				emitReading(History::TEMPERATURE, si7021->temperature, temperatureFilter.push(si7021->temperature));
+				emitReading(History::HUMIDITY, si7021->humidity, humidityFilter.push(si7021->humidity));
+			}
+		}
+	}
+
+	// Replay the flash log into the RAM history once the clock has synced, the log is timestamped in unix time.
+	// Also brings back the smoothing state and the rolling windows, so a reboot or OTA doesn't reset them.
+	// recordSample() calls this before the first synced sample goes in, the board schedules it as well for
+	// a device that has no readings yet
+	inline void restoreHistory() {
+		if (historyRestored || !clockSynced()) return;
+
+		Restore::Result result = replayLog(history, historyTime());
+		for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) { // the log has the offset on top, the filters run on the sensor's values
+			filterSeeds[ch] = result.last[ch] - offsetOf((History::Channel)ch);
+		}
+		filterSeedsReady = true; // the filters belong to the acquisition task, see seedFilters()
+		historyRestored	 = true;
+		if (restored) restored(result);
+	}
+
+	// Every sensor reading goes through here, into the RAM history and the flash log
+	inline void recordSample(History::Channel channel, float value) {
+		if (!historyRestored) restoreHistory(); // before the first synced sample, see Restore.hpp
+		uint32_t t = historyTime();
+		history.ingest(channel, t, value);
+		ScrapeWindow::add(channel, value);
+		SlidingWindow::add(channel, t, value);
+		if (historyRestored && clockSynced()) {
+			logSample(channel, t, History::scale(channel, value));
+		}
+		if (clockSynced() && pushSample) {
+			pushSample(t, channel, value);
+		}
+	}
+
+	// Brightness for the last light sensor reading
+	inline uint8_t brightness() {
+		return lightLevel < BRIGHTNESS_THRESHOLD ? BRIGHTNESS_DEFAULT : BRIGHTNESS_MAX;
+	}
+
+	// A filtered value the way the services hand it out: to /events, and to HomeKit unless Notify holds it back
+	inline float share(History::Channel channel, Notify::Characteristic c, float value, uint32_t now) {
+		value += offsetOf(channel);
+		streamSample(channel, value);
+		if (Notify::offer(c, value, now)) show(c, value);
+		return value;
+	}
+
+	// Hand what the acquisition task measured to the services, from loop()
+	inline void drainReadings() {
+		sensorReading_t r;
+		while (readings.pop(r, clock->micros())) {
+			uint32_t ms	   = clock->millis();
+			float	 shown = r.filtered;
+			switch (r.channel) {
+			case History::CO2:
+				recordSample(History::CO2, r.raw);
+				shown = share(History::CO2, Notify::CO2, r.filtered, ms);
+				if (!animator->busy()) { // colour indicator, cross-fading from the previous one
+					animator->fadeTo(Animation::co2Color(r.raw), Animation::CROSSFADE_MS, ms);
+				}
+				break;
+			case History::PM25:
+				recordSample(History::PM25, r.raw);
+				shown	   = share(History::PM25, Notify::PM25, r.filtered, ms);
+				airQuality = PM1006::airQuality(r.raw);
+				if (Notify::offer(Notify::AIR_QUALITY, airQuality, ms)) show(Notify::AIR_QUALITY, airQuality);
+				break;
+			case History::TEMPERATURE:
+				recordSample(History::TEMPERATURE, r.raw + offsetOf(History::TEMPERATURE));
+				shown = share(History::TEMPERATURE, Notify::TEMPERATURE, r.filtered, ms);
+				break;
+			case History::HUMIDITY:
+				recordSample(History::HUMIDITY, r.raw + offsetOf(History::HUMIDITY));
+				shown = share(History::HUMIDITY, Notify::HUMIDITY, r.filtered, ms);
+				break;
+			case History::LIGHT:
+				lightLevel = r.raw;
+				recordSample(History::LIGHT, r.raw);
+				animator->setLevel(brightness());
+				break;
+			default:
+				continue;
+			}
+			if (published) published(r.channel, r.raw, shown);
+		}
+	}
+} // namespace Pipeline
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Hal.hpp"
+#include "History.hpp"
+
+/**
+ * Push exporter for devices that can't be scraped. Readings are queued by
+ * recordSample() on the loop task and a background task POSTs them as
+ * InfluxDB line protocol, one line per sample:
+ *
+ *   co2,device=air_sensor,location=home value=812 1700000000
+ *
+ * A batch goes out once pushBatchLines samples are queued or pushFlushSecs
+ * passed since the last one, at most MAX_LINES per request. The queue
+ * holds QUEUE_LEN samples (a bit over an hour of every channel), the
+ * oldest are dropped when an outage outlasts it. Failed requests are
+ * retried with exponential backoff, a backlog is sent back to back once
+ * the server answers again. Requests the server rejects outright (4xx,
+ * except 408 and 429) are dropped so one bad batch can't block the queue.
+ *
+ * Transport needs int post(const char *body, size_t len), returning the
+ * HTTP status or a negative value when there was no response.
+ */
+namespace Push {
+
+	constexpr static const uint16_t QUEUE_LEN	   = 2048;
+	constexpr static const uint8_t	MAX_LINES	   = 64;
+	constexpr static const size_t	LINE_LEN	   = 72; // longest line: a negative temperature
+	constexpr static const uint32_t BACKOFF_MIN_MS = 5000;
+	constexpr static const uint32_t BACKOFF_MAX_MS = 300000;
+
+	constexpr static const char *TAGS = "device=air_sensor,location=home"; // same as Metrics::DEFAULT_LABELS
+
+	struct Sample {
+		uint32_t t; // unix seconds
+		int16_t	 value; // History::scale() units
+		uint8_t	 channel;
+	};
+
+	// One line, values printed with as many decimals as the channel stores
+	inline size_t line(const Sample &s, char *out, size_t size) {
+		const History::ChannelInfo &c	  = History::CHANNELS[s.channel];
+		int32_t						scale = c.scale;
+		int							n;
+		if (scale == 1) {
+			n = snprintf(out, size, "%s,%s value=%d %lu\n", c.name, TAGS, s.value, (unsigned long)s.t);
+		} else {
+			int32_t v	   = abs(s.value);
+			uint8_t digits = scale >= 100 ? 2 : 1;
+			n			   = snprintf(out, size, "%s,%s value=%s%ld.%0*ld %lu\n", c.name, TAGS, s.value < 0 ? "-" : "", (long)(v / scale), digits, (long)(v % scale), (unsigned long)s.t);
+		}
+		return n > 0 && (size_t)n < size ? n : 0;
+	}
+
+	template <typename Transport, uint16_t N = QUEUE_LEN>
+	struct Exporter {
+		Transport  &transport;
+		Hal::Clock &clock;
+		Hal::Lock	lock;
+
+		Sample	 queue[N];
+		uint32_t head = 0, tail = 0; // running sample numbers, head - tail are queued
+
+		uint32_t lastFlushMs = 0;
+		uint32_t failedAt	 = 0;
+		uint32_t backoffMs	 = 0; // 0 while the server is reachable
+		bool	 backlog	 = false;
+
+		// Stats
+		uint32_t sent		= 0; // samples the server accepted
+		uint32_t dropped	= 0; // queue overflow
+		uint32_t rejected	= 0; // samples in batches the server refused
+		uint32_t failures	= 0; // requests without a 2xx answer
+		int		 lastStatus = 0;
+		uint32_t lastMs		= 0; // duration of the last request
+
+		char body[MAX_LINES * LINE_LEN];
+
+		Exporter(Transport &transport, Hal::Clock &clock) : transport(transport), clock(clock) {}
+
+		// Any task, overwrites the oldest sample when full
+		void add(uint32_t t, History::Channel channel, float value) {
+			lock.lock();
+			if (head - tail == N) {
+				tail++;
+				dropped++;
+			}
+			queue[head++ % N] = {t, History::scale(channel, value), channel};
+			lock.unlock();
+		}
+
+		uint32_t queued() {
+			lock.lock();
+			uint32_t n = head - tail;
+			lock.unlock();
+			return n;
+		}
+
+		// One pass of the push task, returns how long it may sleep
+		uint32_t step(uint32_t flushMs, uint32_t batch) {
+			uint32_t now = clock.millis();
+			if (backoffMs && now - failedAt < backoffMs) return backoffMs - (now - failedAt);
+
+			Sample	 lines[MAX_LINES];
+			uint32_t first, n;
+			lock.lock();
+			first = tail;
+			n	  = head - tail;
+			if (n > MAX_LINES) n = MAX_LINES;
+			for (uint32_t i = 0; i < n; i++) lines[i] = queue[(first + i) % N];
+			uint32_t waiting = head - tail;
+			lock.unlock();
+
+			if (!backlog && !backoffMs && waiting < batch && now - lastFlushMs < flushMs) return flushMs - (now - lastFlushMs);
+			if (!n) {
+				lastFlushMs = now;
+				return flushMs;
+			}
+
+			size_t len = 0;
+			for (uint32_t i = 0; i < n; i++) len += line(lines[i], body + len, sizeof(body) - len);
+
+			int status = transport.post(body, len);
+			lastMs	   = clock.millis() - now;
+			lastStatus = status;
+
+			bool accepted = status >= 200 && status < 300;
+			bool refused  = status >= 400 && status < 500 && status != 408 && status != 429;
+			if (!accepted && !refused) {
+				failures++;
+				backoffMs = backoffMs ? (backoffMs * 2 < BACKOFF_MAX_MS ? backoffMs * 2 : BACKOFF_MAX_MS) : BACKOFF_MIN_MS;
+				failedAt  = clock.millis();
+				return backoffMs;
+			}
+
+			if (accepted) sent += n;
+			else {
+				failures++;
+				rejected += n;
+			}
+
+			// Samples evicted while the request was out made it after all
+			lock.lock();
+			uint32_t evicted = (int32_t)(tail - first) > 0 ? tail - first : 0;
+			dropped -= evicted < n ? evicted : n;
+			if ((int32_t)(first + n - tail) > 0) tail = first + n;
+			backlog = head - tail >= MAX_LINES || head - tail >= batch;
+			lock.unlock();
+
+			backoffMs	= 0;
+			lastFlushMs = clock.millis();
+			return backlog ? 0 : flushMs;
+		}
+	};
+} // namespace Push
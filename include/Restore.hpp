@@ -0,0 +1,41 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "History.hpp"
+#include "SlidingWindow.hpp"
+
+/**
+ * Brings the RAM history and the rolling windows back from the flash log
+ * after a reboot. Has to run before the first sample timed by the synced
+ * clock goes in: a tier drops anything older than what it already holds,
+ * so a replay after that would leave every channel with a reading empty.
+ */
+namespace Restore {
+
+	struct Result {
+		uint32_t records = 0;
+		float	 last[History::CHANNEL_COUNT]; // last logged value of each channel, NAN if none
+	};
+
+	// Log is a SampleLog::Log, records timed after now are skipped
+	template <typename Log>
+	Result replay(Log &log, History::Store &history, uint32_t now) {
+		Result	r;
+		bool	seen[History::CHANNEL_COUNT] = {};
+		int16_t last[History::CHANNEL_COUNT];
+
+		SlidingWindow::reset(); // what came in before NTP was timed by uptime
+		r.records = log.replay([&](uint8_t ch, uint32_t t, int16_t value) {
+			if (ch >= History::CHANNEL_COUNT || (int32_t)(now - t) < 0) return;
+			history.ingestRaw((History::Channel)ch, t, value);
+			SlidingWindow::channels[ch].add(t, value);
+			seen[ch] = true;
+			last[ch] = value;
+		});
+
+		for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) r.last[ch] = seen[ch] ? last[ch] / History::CHANNELS[ch].scale : NAN;
+		return r;
+	}
+} // namespace Restore
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Append-only, log-structured sample store for a raw flash region.
+ *
+ * Samples are batched in RAM and written one 256 byte page at a time, the
+ * region is used as a ring so every sector is erased once per lap (wear is
+ * spread evenly without a mapping table). Each page carries a sequence
+ * number and a CRC, so a page torn by power loss is simply skipped.
+ * Recovery reads page headers to find the newest page, O(pages), then
+ * moves the write position past any page that isn't blank: a write cut
+ * short may have left too little of its header to be recognised, and NOR
+ * flash can't be programmed again without an erase.
+ *
+ * Flash must provide size(), read(addr, buf, len), write(addr, buf, len)
+ * and erase(addr, len) on a region whose size is a multiple of SECTOR.
+ */
+namespace SampleLog {
+
+	constexpr static const uint32_t SECTOR			 = 4096;
+	constexpr static const uint32_t PAGE			 = 256;
+	constexpr static const uint32_t PAGES_PER_SECTOR = SECTOR / PAGE;
+	constexpr static const uint32_t MAGIC			 = 0x31475153; // "SQG1"
+
+	struct PageHeader {
+		uint32_t magic;
+		uint32_t seq;
+		uint32_t base; // time of the first record, records hold an offset from it
+		uint16_t count;
+		uint16_t crc; // CRC-16/CCITT over the header (crc = 0) and the records
+	};
+
+	// 3 bit channel + 13 bit time offset, then the value
+	struct Record {
+		uint16_t tag;
+		int16_t	 value;
+	};
+
+	constexpr static const uint16_t RECORDS_PER_PAGE = (PAGE - sizeof(PageHeader)) / sizeof(Record);
+	constexpr static const uint16_t MAX_OFFSET		 = 0x1FFF;
+	constexpr static const uint8_t	MAX_CHANNEL		 = 7;
+
+	struct Page {
+		PageHeader header;
+		Record	   records[RECORDS_PER_PAGE];
+	};
+
+	static_assert(sizeof(Page) <= PAGE, "page layout does not fit a flash page");
+
+	inline uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+		while (len--) {
+			crc ^= *data++ << 8;
+			for (uint8_t i = 0; i < 8; i++) {
+				crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+			}
+		}
+		return crc;
+	}
+
+	inline uint16_t pageCrc(const Page &page) {
+		PageHeader header = page.header;
+		header.crc		  = 0;
+		uint16_t crc	  = crc16((const uint8_t *)&header, sizeof(header));
+		return crc16((const uint8_t *)page.records, page.header.count * sizeof(Record), crc);
+	}
+
+	template <typename Flash>
+	struct Log {
+		Flash	&flash;
+		uint32_t pages	  = 0;
+		uint32_t next	  = 0; // page index the next batch goes to
+		uint32_t seq	  = 0; // sequence number of the next page
+		bool	 ready	  = false;
+		Page	 pending; // batch being filled in RAM
+
+		// Stats
+		uint32_t pagesWritten  = 0;
+		uint32_t sectorsErased = 0;
+		uint32_t tornPages	   = 0;
+		uint32_t dropped	   = 0;
+
+		Log(Flash &flash) : flash(flash) {
+			resetPending();
+		}
+
+		// Find the newest page by reading page headers. Returns the number of valid pages found
+		uint32_t recover() {
+			pages = flash.size() / PAGE;
+			ready = pages >= 2 * PAGES_PER_SECTOR;
+			if (!ready) return 0;
+
+			bool	 found = false;
+			uint32_t head = 0, headSeq = 0, valid = 0;
+			for (uint32_t i = 0; i < pages; i++) {
+				PageHeader h;
+				if (!flash.read(i * PAGE, &h, sizeof(h)) || h.magic != MAGIC) continue;
+				valid++;
+				if (!found || (int32_t)(h.seq - headSeq) > 0) {
+					found	= true;
+					head	= i;
+					headSeq = h.seq;
+				}
+			}
+
+			if (found) {
+				// The newest page may be torn, it is never rewritten without an erase either way
+				next = (head + 1) % pages;
+				seq	 = headSeq + 1;
+			} else {
+				next = 0;
+				seq	 = 0;
+			}
+
+			// Past a write torn before its magic was in. A sector start is erased before use anyway
+			while (next % PAGES_PER_SECTOR && !blank(next)) next = (next + 1) % pages;
+			return valid;
+		}
+
+		// Queue one sample, written to flash once a page worth of samples is batched
+		void append(uint8_t channel, uint32_t time, int16_t value) {
+			if (!ready || channel > MAX_CHANNEL) {
+				dropped++;
+				return;
+			}
+
+			PageHeader &h = pending.header;
+			if (h.count && (h.count == RECORDS_PER_PAGE || (int32_t)(time - h.base) < 0 || time - h.base > MAX_OFFSET)) {
+				flush();
+			}
+			if (h.count == 0) h.base = time;
+
+			pending.records[h.count++] = {(uint16_t)((channel << 13) | (time - h.base)), value};
+			if (h.count == RECORDS_PER_PAGE) flush();
+		}
+
+		// Write the pending batch, even if the page is not full
+		void flush() {
+			if (!ready || pending.header.count == 0) return;
+
+			if (next % PAGES_PER_SECTOR == 0) {
+				flash.erase(next * PAGE, SECTOR); // drops the oldest sector once the log has wrapped
+				sectorsErased++;
+			}
+
+			pending.header.seq = seq++;
+			pending.header.crc = pageCrc(pending);
+			flash.write(next * PAGE, &pending, sizeof(PageHeader) + pending.header.count * sizeof(Record));
+			pagesWritten++;
+
+			next = (next + 1) % pages;
+			resetPending();
+		}
+
+		// Call fn(channel, time, value) for every stored record, oldest first. Skips torn pages
+		template <typename Fn>
+		uint32_t replay(Fn fn) {
+			if (!ready) return 0;
+
+			uint32_t records = 0;
+			Page	 page;
+			for (uint32_t n = 0; n < pages; n++) {
+				uint32_t i = (next + n) % pages; // oldest surviving page follows the write position
+				if (!flash.read(i * PAGE, &page.header, sizeof(PageHeader)) || page.header.magic != MAGIC) continue;
+				if (page.header.count > RECORDS_PER_PAGE ||
+					!flash.read(i * PAGE + sizeof(PageHeader), page.records, page.header.count * sizeof(Record)) ||
+					pageCrc(page) != page.header.crc) {
+					tornPages++;
+					continue;
+				}
+				for (uint16_t r = 0; r < page.header.count; r++) {
+					const Record &rec = page.records[r];
+					fn(rec.tag >> 13, page.header.base + (rec.tag & MAX_OFFSET), rec.value);
+				}
+				records += page.header.count;
+			}
+			return records;
+		}
+
+	private:
+		bool blank(uint32_t page) {
+			uint8_t buf[32];
+			for (uint32_t at = 0; at < PAGE; at += sizeof(buf)) {
+				if (!flash.read(page * PAGE + at, buf, sizeof(buf))) return false;
+				for (uint8_t b : buf) {
+					if (b != 0xFF) return false;
+				}
+			}
+			return true;
+		}
+
+		void resetPending() {
+			memset(&pending, 0xFF, sizeof(pending));
+			pending.header.magic = MAGIC;
+			pending.header.count = 0;
+		}
+	};
+} // namespace SampleLog
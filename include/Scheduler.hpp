@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Cooperative deadline scheduler. Jobs run periodically from a min-heap
+ * ordered by their next deadline, with an optional phase offset so jobs
+ * sharing a period can be staggered instead of firing in the same loop()
+ * iteration. The caller passes the current time to run(), which keeps the
+ * scheduler independent from millis() and usable with a fake clock.
+ */
+template <uint8_t CAPACITY>
+struct Scheduler {
+
+	typedef void (*JobFn)();
+
+	struct Job {
+		const char *name;
+		JobFn		fn;
+		uint32_t	period;
+		uint32_t	jitter;	  // random extra delay added to each deadline, 0 to disable
+		uint32_t	grid;	  // next deadline before jitter, advances by whole periods
+		uint32_t	due;	  // next deadline
+		uint32_t	lastDue;  // deadline of the last run
+		uint32_t	lastRun;  // time the last run actually started
+		uint32_t	lastLate; // lastRun - lastDue
+		uint32_t	maxLate;
+		uint32_t	runs;
+		uint32_t	skipped; // whole periods missed because the job ran too late
+	};
+
+	Job		 jobs[CAPACITY];
+	uint8_t	 heap[CAPACITY]; // indices into jobs[], earliest deadline first
+	uint8_t	 count = 0;
+	uint32_t rng   = 0x9E3779B9;
+
+	// Register a job, first run is due at now + phase. Returns the job index or -1 when full
+	int add(const char *name, JobFn fn, uint32_t period, uint32_t phase, uint32_t now, uint32_t jitter = 0) {
+		if (count >= CAPACITY || period == 0) return -1;
+
+		Job &job	= jobs[count];
+		job			= Job();
+		job.name	= name;
+		job.fn		= fn;
+		job.period	= period;
+		job.jitter	= jitter;
+		job.grid	= now + phase;
+		job.due		= job.grid;
+		heap[count] = count;
+		siftUp(count);
+		return count++;
+	}
+
+	// Run every job whose deadline has passed, in deadline order. Returns the number of jobs run
+	uint8_t run(uint32_t now) {
+		uint8_t ran = 0;
+
+		while (count > 0 && ran < count) {
+			Job &job = jobs[heap[0]];
+			if (before(now, job.due)) break;
+
+			job.lastDue	 = job.due;
+			job.lastRun	 = now;
+			job.lastLate = now - job.due;
+			if (job.lastLate > job.maxLate) job.maxLate = job.lastLate;
+			job.runs++;
+
+			// Keep the phase: the next deadline stays on the job's grid even if this run was late
+			uint32_t missed = (now - job.grid) / job.period;
+			job.skipped += missed;
+			job.grid += (missed + 1) * job.period;
+			job.due = job.grid;
+			if (job.jitter) job.due += nextRandom() % job.jitter;
+			siftDown(0);
+
+			job.fn();
+			ran++;
+		}
+
+		return ran;
+	}
+
+	// Time until the earliest deadline, 0 if something is already due
+	uint32_t idleFor(uint32_t now) const {
+		if (count == 0) return UINT32_MAX;
+		const Job &job = jobs[heap[0]];
+		return before(now, job.due) ? job.due - now : 0;
+	}
+
+private:
+	// Wraparound-safe a < b, so millis() rolling over after ~49 days is harmless
+	static bool before(uint32_t a, uint32_t b) {
+		return (int32_t)(a - b) < 0;
+	}
+
+	bool earlier(uint8_t i, uint8_t j) const {
+		return before(jobs[heap[i]].due, jobs[heap[j]].due);
+	}
+
+	void swap(uint8_t i, uint8_t j) {
+		uint8_t tmp = heap[i];
+		heap[i]		= heap[j];
+		heap[j]		= tmp;
+	}
+
+	void siftUp(uint8_t i) {
+		while (i > 0) {
+			uint8_t parent = (i - 1) / 2;
+			if (!earlier(i, parent)) break;
+			swap(i, parent);
+			i = parent;
+		}
+	}
+
+	void siftDown(uint8_t i) {
+		for (;;) {
+			uint8_t left = 2 * i + 1, right = left + 1, smallest = i;
+			if (left < count && earlier(left, smallest)) smallest = left;
+			if (right < count && earlier(right, smallest)) smallest = right;
+			if (smallest == i) break;
+			swap(i, smallest);
+			i = smallest;
+		}
+	}
+
+	// xorshift32, deterministic so host runs are reproducible
+	uint32_t nextRandom() {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng;
+	}
+};
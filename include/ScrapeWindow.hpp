@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "History.hpp"
+#include "Metrics.hpp"
+
+/**
+ * Per-channel aggregates of the raw readings since the previous /metrics
+ * scrape: count, sum, min, max and a fixed-bucket quantile sketch. Spikes
+ * between two scrapes show up in max and the upper quantiles however long
+ * the scrape interval is.
+ *
+ * Two sets are kept. rotate(), called once per scrape, clears the idle set
+ * and makes it the one readings go to, so the set being rendered is frozen
+ * and starting the next window is a single byte store. Every scrape starts
+ * a new window, so only one Prometheus server should scrape a device.
+ */
+namespace ScrapeWindow {
+
+	constexpr static const uint8_t BINS = 64;
+
+	// Sketch bucket i covers [lo + i * step, lo + (i + 1) * step) in History's stored units, the end buckets are open
+	struct Layout {
+		int16_t lo;
+		int16_t step;
+	};
+
+	constexpr static const Layout LAYOUTS[History::CHANNEL_COUNT] = {
+		{400, 25}, // co2: 400 - 2000 ppm
+		{0, 2},	   // pm25: 0 - 128 ug/m3
+		{0, 50},   // temperature: 0 - 32 deg C
+		{0, 200},  // humidity: 0 - 128 %
+		{0, 64},   // light: the 12 bit ADC range
+	};
+
+	/**
+	 * Linear histogram over the channel's usual range. Sketches with the
+	 * same layout merge by adding counts, quantiles are interpolated inside
+	 * a bucket, so they are off by at most one step (and clamped to the
+	 * exact min and max).
+	 */
+	struct Sketch {
+		uint16_t counts[BINS];
+
+		void add(const Layout &layout, int16_t v) {
+			int32_t i = (v - layout.lo) / layout.step;
+			if (i < 0) i = 0;
+			if (i >= BINS) i = BINS - 1;
+			if (counts[i] < UINT16_MAX) counts[i]++;
+		}
+
+		void merge(const Sketch &other) {
+			for (uint8_t i = 0; i < BINS; i++) {
+				uint32_t sum = counts[i] + other.counts[i];
+				counts[i]	 = sum < UINT16_MAX ? sum : UINT16_MAX;
+			}
+		}
+
+		float quantile(const Layout &layout, float q, uint32_t total) const {
+			float	 rank = q * total;
+			uint32_t seen = 0;
+			for (uint8_t i = 0; i < BINS; i++) {
+				if (!counts[i]) continue;
+				if (seen + counts[i] >= rank) return layout.lo + layout.step * (i + (rank - seen) / counts[i]);
+				seen += counts[i];
+			}
+			return layout.lo + layout.step * BINS;
+		}
+	};
+
+	struct Aggregate {
+		uint32_t count;
+		int64_t	 sum;
+		int16_t	 min, max;
+		Sketch	 sketch;
+
+		void reset() {
+			*this = {};
+		}
+
+		void add(const Layout &layout, int16_t v) {
+			if (!count || v < min) min = v;
+			if (!count || v > max) max = v;
+			sum += v;
+			count++;
+			sketch.add(layout, v);
+		}
+
+		void merge(const Aggregate &other) {
+			if (!other.count) return;
+			if (!count || other.min < min) min = other.min;
+			if (!count || other.max > max) max = other.max;
+			sum += other.sum;
+			count += other.count;
+			sketch.merge(other.sketch);
+		}
+
+		// In stored units, clamped to what was actually seen
+		float quantile(const Layout &layout, float q) const {
+			float v = sketch.quantile(layout, q, count);
+			return v < min ? min : v > max ? max : v;
+		}
+	};
+
+	inline Aggregate sets[2][History::CHANNEL_COUNT];
+	inline uint8_t	 active = 0;
+
+	inline void add(History::Channel ch, float value) {
+		sets[active][ch].add(LAYOUTS[ch], History::scale(ch, value));
+	}
+
+	// Starts a new window, the one just closed is what scraped() returns until the next rotate()
+	inline void rotate() {
+		uint8_t idle = active ^ 1;
+		for (Aggregate &a : sets[idle]) a.reset();
+		active = idle;
+	}
+
+	inline const Aggregate &scraped(uint8_t ch) {
+		return sets[active ^ 1][ch];
+	}
+
+	constexpr static const float QUANTILES[] = {0.5f, 0.9f, 0.99f};
+
+	// homekit_reading{channel,quantile} plus _sum and _count, in the channel's unit
+	inline void collectSummary(Metrics::Writer &w, const Metrics::Family &f) {
+		char labels[48];
+		w.header(f);
+		for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) {
+			const Aggregate &a	   = scraped(ch);
+			double			 scale = History::CHANNELS[ch].scale;
+			if (a.count) {
+				for (float q : QUANTILES) {
+					snprintf(labels, sizeof(labels), "channel=\"%s\",quantile=\"%g\"", History::CHANNELS[ch].name, q);
+					w.sample(f, "", labels, a.quantile(LAYOUTS[ch], q) / scale);
+				}
+			}
+			snprintf(labels, sizeof(labels), "channel=\"%s\"", History::CHANNELS[ch].name);
+			w.sample(f, "_sum", labels, a.sum / scale);
+			w.sample(f, "_count", labels, a.count);
+		}
+	}
+
+	// Gauges, channels without readings in the window are left out
+	inline void collectExtreme(Metrics::Writer &w, const Metrics::Family &f, bool max) {
+		char labels[32];
+		w.header(f);
+		for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) {
+			const Aggregate &a = scraped(ch);
+			if (!a.count) continue;
+			snprintf(labels, sizeof(labels), "channel=\"%s\"", History::CHANNELS[ch].name);
+			w.sample(f, "", labels, (max ? a.max : a.min) / (double)History::CHANNELS[ch].scale);
+		}
+	}
+
+	inline void collectMin(Metrics::Writer &w, const Metrics::Family &f) {
+		collectExtreme(w, f, false);
+	}
+
+	inline void collectMax(Metrics::Writer &w, const Metrics::Family &f) {
+		collectExtreme(w, f, true);
+	}
+} // namespace ScrapeWindow
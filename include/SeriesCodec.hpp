@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "History.hpp"
+
+/**
+ * Compact columnar encoding of a history series, roughly 1-3 bytes per
+ * bucket instead of ~25 for CSV.
+ *
+ *   "AQH1"           magic
+ *   u8               channel
+ *   u8               flags, bit 0: min/max columns present (aggregated tier)
+ *   varint           period in seconds
+ *   varint           scale, values are value * scale as integers
+ *   varint           count
+ *   timestamps       varint t0, zigzag delta t1 - t0, then zigzag delta-of-delta
+ *   mean column      zigzag first value, then zigzag deltas
+ *   min, max columns same as mean, only with flag bit 0
+ *
+ * The encoder streams straight from the history store with one pass per
+ * column, so it needs no buffer beyond the output writer.
+ */
+namespace SeriesCodec {
+
+	constexpr static const char	   MAGIC[4]		= {'A', 'Q', 'H', '1'};
+	constexpr static const uint8_t FLAG_MIN_MAX = 0x01;
+
+	inline uint32_t zigzag(int32_t v) {
+		return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+	}
+
+	template <typename Out>
+	void putVarint(Out &out, uint32_t v) {
+		char	buf[5];
+		uint8_t n = 0;
+		while (v >= 0x80) {
+			buf[n++] = (char)(v | 0x80);
+			v >>= 7;
+		}
+		buf[n++] = (char)v;
+		out.write(buf, n);
+	}
+
+	// forEach(fn) must call fn(time, const History::Bucket &) for every bucket, oldest first, and be repeatable
+	template <typename Out, typename ForEach>
+	uint32_t encode(Out &out, History::Channel ch, uint32_t period, bool minMax, ForEach forEach) {
+		uint32_t count = 0;
+		forEach([&](uint32_t, const History::Bucket &) { count++; });
+
+		out.write(MAGIC, sizeof(MAGIC));
+		char head[2] = {(char)ch, (char)(minMax ? FLAG_MIN_MAX : 0)};
+		out.write(head, sizeof(head));
+		putVarint(out, period);
+		putVarint(out, (uint32_t)History::CHANNELS[ch].scale);
+		putVarint(out, count);
+
+		uint32_t n = 0, prevT = 0;
+		int32_t	 prevDelta = 0;
+		forEach([&](uint32_t t, const History::Bucket &) {
+			if (n == 0) {
+				putVarint(out, t);
+			} else {
+				int32_t delta = t - prevT;
+				putVarint(out, zigzag(n == 1 ? delta : delta - prevDelta));
+				prevDelta = delta;
+			}
+			prevT = t;
+			n++;
+		});
+
+		auto column = [&](int16_t History::Bucket::*field) {
+			int32_t prev = 0;
+			forEach([&](uint32_t, const History::Bucket &b) {
+				putVarint(out, zigzag(b.*field - prev));
+				prev = b.*field;
+			});
+		};
+		column(&History::Bucket::mean);
+		if (minMax) {
+			column(&History::Bucket::min);
+			column(&History::Bucket::max);
+		}
+		return count;
+	}
+} // namespace SeriesCodec
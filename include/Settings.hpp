@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Preferences.h>
+#endif
+
+/**
+ * Runtime settings, kept in the "settings" NVS namespace and changed over
+ * HTTP at /config without a rebuild. Every setting is a plain global with
+ * its default, listed once in FIELDS; load() overwrites the defaults with
+ * whatever was stored. Readers on other tasks copy a TEXT value before
+ * using it, a write racing the copy at worst costs one failed attempt.
+ *
+ * /config takes no credentials, so the URLs firmware comes from only take
+ * https: anyone on the network could otherwise point them at a server of
+ * their own and have the device flash what it serves.
+ */
+namespace Settings {
+
+	// Push exporter (Push.hpp), disabled while the URL is empty
+	inline char		pushUrl[160]   = ""; // e.g. http://influx:8086/api/v2/write?org=home&bucket=air&precision=s
+	inline char		pushToken[96]  = ""; // sent as "Authorization: Token ..." when set
+	inline char		pushCa[2560]   = ""; // PEM root certificate for an https push server, cert.hpp's while empty
+	inline uint32_t pushFlushSecs  = 60; // a batch goes out at least this often
+	inline uint32_t pushBatchLines = 50; // or as soon as this many samples are queued
+
+	// Firmware version check (OTA.hpp)
+	inline char		updateUrl[160]	 = "https://raw.githubusercontent.com/oleksiikutuzov/esp32-homekit-air-quality/V4.0/bin_version.txt";
+	inline uint32_t updateCheckSecs = 3600;
+#if HARDWARE_VER == 4
+	inline char otaManifestUrl[160] = "https://raw.githubusercontent.com/oleksiikutuzov/esp32-homekit-air-quality/V4.0/esp32_air_quality_v4.manifest";
+#else
+	inline char otaManifestUrl[160] = "https://raw.githubusercontent.com/oleksiikutuzov/esp32-homekit-air-quality/V4.0/esp32_air_quality_v3.manifest";
+#endif
+
+	enum Type : uint8_t {
+		TEXT,
+		UINT,
+	};
+
+	struct Field {
+		const char *key; // also the NVS key, at most 15 characters
+		Type		type;
+		void	   *value;
+		size_t		size; // TEXT buffer size
+		uint32_t	min, max;
+		bool		secret; // never shown by /config
+		bool		https;	// a URL that has to be https, or empty
+	};
+
+	inline const Field FIELDS[] = {
+		{"push_url", TEXT, pushUrl, sizeof(pushUrl), 0, 0, false, false},
+		{"push_token", TEXT, pushToken, sizeof(pushToken), 0, 0, true, false},
+		{"push_ca", TEXT, pushCa, sizeof(pushCa), 0, 0, false, false},
+		{"push_flush_s", UINT, &pushFlushSecs, 0, 5, 86400, false, false},
+		{"push_batch", UINT, &pushBatchLines, 0, 1, 500, false, false},
+		{"update_url", TEXT, updateUrl, sizeof(updateUrl), 0, 0, false, true},
+		{"update_check_s", UINT, &updateCheckSecs, 0, 60, 604800, false, false},
+		{"ota_manifest", TEXT, otaManifestUrl, sizeof(otaManifestUrl), 0, 0, false, true},
+	};
+
+	inline const Field *find(const char *key) {
+		for (const Field &f : FIELDS)
+			if (!strcmp(f.key, key)) return &f;
+		return nullptr;
+	}
+
+	// Parses and applies one value, false if it doesn't fit the field
+	inline bool set(const Field &f, const char *text) {
+		if (f.type == TEXT) {
+			if (strlen(text) >= f.size) return false;
+			if (f.https && *text && strncmp(text, "https://", 8)) return false;
+			strcpy((char *)f.value, text);
+			return true;
+		}
+
+		char		 *end;
+		unsigned long v = strtoul(text, &end, 10);
+		if (!*text || *end || v < f.min || v > f.max) return false;
+		*(uint32_t *)f.value = v;
+		return true;
+	}
+
+	// key=value lines, secrets masked, a multi-line value (a PEM) up to its first line
+	template <typename Out>
+	void report(Out &out) {
+		for (const Field &f : FIELDS) {
+			const char *text = (const char *)f.value;
+			if (f.secret) out.printf("%s=%s\n", f.key, *text ? "***" : "");
+			else if (f.type == TEXT) out.printf("%s=%.*s\n", f.key, (int)strcspn(text, "\r\n"), text);
+			else out.printf("%s=%lu\n", f.key, (unsigned long)*(const uint32_t *)f.value);
+		}
+	}
+
+#ifdef ARDUINO
+	inline void load() {
+		Preferences prefs;
+		if (!prefs.begin("settings", true)) return; // nothing stored yet
+		for (const Field &f : FIELDS) {
+			if (!prefs.isKey(f.key)) continue;
+			if (f.type == TEXT) set(f, prefs.getString(f.key).c_str()); // an http update URL stored by an older firmware keeps the default
+			else *(uint32_t *)f.value = prefs.getUInt(f.key, *(uint32_t *)f.value);
+		}
+		prefs.end();
+	}
+
+	inline bool save(const Field &f) {
+		Preferences prefs;
+		if (!prefs.begin("settings", false)) return false;
+		size_t n = f.type == TEXT ? prefs.putString(f.key, (const char *)f.value) : prefs.putUInt(f.key, *(const uint32_t *)f.value);
+		prefs.end();
+		return n > 0 || (f.type == TEXT && !*(const char *)f.value);
+	}
+#endif
+} // namespace Settings
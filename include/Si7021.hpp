@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Hal.hpp"
+
+/**
+ * Non-blocking Si7021 driver. A measurement is started with a no-hold RH
+ * command and collected on a later poll() once the conversion is done.
+ * The temperature is read back from the RH conversion (0xE0), so one
+ * measurement yields both values without a second conversion.
+ */
+struct Si7021 {
+
+	constexpr static const uint8_t CMD_MEASURE_RH_NO_HOLD = 0xF5;
+	constexpr static const uint8_t CMD_READ_TEMP_FROM_RH  = 0xE0;
+	constexpr static const uint8_t CONVERSION_MS		  = 25;	 // 12 ms RH + 10.8 ms temperature, worst case
+	constexpr static const uint8_t TIMEOUT_MS			  = 100; // give up if the sensor keeps NACKing
+
+	enum State : uint8_t {
+		IDLE,
+		MEASURING,
+	};
+
+	Hal::I2CBus &bus;
+	Hal::Clock	&clock;
+	uint8_t		 addr;
+	State		 state		 = IDLE;
+	uint32_t	 startedAt	 = 0;
+	uint32_t	 seq		 = 0; // incremented on every completed measurement
+	uint32_t	 errors		 = 0;
+	float		 humidity	 = 0;
+	float		 temperature = 0;
+
+	Si7021(Hal::I2CBus &bus, Hal::Clock &clock, uint8_t addr) : bus(bus), clock(clock), addr(addr) {}
+
+	// True if the sensor ACKs its address
+	bool probe() {
+		return bus.write(addr, nullptr, 0);
+	}
+
+	// Start a new measurement, ignored while the previous one is still converting
+	void request() {
+		if (state != IDLE) return;
+
+		startedAt = clock.millis();
+
+		if (!bus.write(addr, &CMD_MEASURE_RH_NO_HOLD, 1)) {
+			errors++;
+			return;
+		}
+		state = MEASURING;
+	}
+
+	// Collect a finished measurement, never waits on the bus for the conversion
+	void poll() {
+		if (state == IDLE) return;
+
+		uint32_t now = clock.millis();
+
+		if (now - startedAt < CONVERSION_MS) return;
+
+		uint16_t rh;
+		if (!readWord(rh)) {
+			if (now - startedAt >= TIMEOUT_MS) fail();
+			return; // conversion not finished yet, try again on next poll
+		}
+
+		uint16_t t;
+		if (!bus.write(addr, &CMD_READ_TEMP_FROM_RH, 1) || !readWord(t)) {
+			fail();
+			return;
+		}
+
+		humidity	= toHumidity(rh);
+		temperature = toTemperature(t);
+		seq++;
+		state = IDLE;
+	}
+
+	// Datasheet conversions of the raw 16 bit words, status bits already masked
+	static float toHumidity(uint16_t rh) {
+		float v = ((125.0 * rh) / 65536.0) - 6;
+		return v < 0 ? 0 : v > 100 ? 100 : v;
+	}
+
+	static float toTemperature(uint16_t t) {
+		return ((175.72 * t) / 65536.0) - 46.85;
+	}
+
+private:
+	bool readWord(uint16_t &word) {
+		uint8_t data[2];
+		if (bus.read(addr, data, sizeof(data)) != sizeof(data)) return false;
+		word = ((data[0] << 8) | data[1]) & 0xFFFC; // two LSBs are status bits
+		return true;
+	}
+
+	void fail() {
+		errors++;
+		state = IDLE;
+	}
+};
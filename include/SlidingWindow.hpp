@@ -0,0 +1,217 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "History.hpp"
+#include "Metrics.hpp"
+
+/**
+ * Rolling min, max and mean of every channel over the last hour, day and
+ * week, in fixed memory. A window is SLOTS slots of SLOT_SECS wide and
+ * moves on a slot at a time. Each slot keeps the sum and count of its
+ * samples for the mean, and two monotonic deques hold the only samples
+ * that can still become the min or max, at most one per slot. A sample
+ * costs O(1) amortised: every deque entry is pushed and popped once, every
+ * slot cleared once per pass over the ring.
+ *
+ * Times are seconds, non-decreasing; a sample older than the newest slot
+ * counts toward that slot. Values are int16 scaled per channel, as in
+ * History.hpp.
+ */
+namespace SlidingWindow {
+
+	struct Summary {
+		int16_t	 min, max;
+		float	 mean;
+		uint32_t count; // 0 when the window is empty, min and max are meaningless then
+	};
+
+	template <uint16_t SLOTS, uint32_t SLOT_SECS>
+	struct Window {
+		struct Entry {
+			uint16_t slot; // low bits of the slot number, SLOTS is far below 2^15
+			int16_t	 value;
+		};
+
+		// Ring-backed deque, holds at most one entry per slot in the window
+		struct Deque {
+			Entry	 entries[SLOTS];
+			uint16_t head = 0, size = 0;
+
+			Entry &front() {
+				return entries[head];
+			}
+
+			Entry &back() {
+				return entries[(head + size - 1) % SLOTS];
+			}
+
+			void popFront() {
+				head = (head + 1) % SLOTS;
+				size--;
+			}
+
+			void pushBack(const Entry &e) {
+				entries[(head + size++) % SLOTS] = e;
+			}
+		};
+
+		Deque	 lows, highs; // values rising, falling from the front
+		int32_t	 sums[SLOTS];
+		uint16_t counts[SLOTS];
+		int64_t	 total	= 0;
+		uint32_t count	= 0;
+		uint32_t newest = 0; // slot number of the last sample or query
+		bool	 started = false;
+
+		Window() {
+			reset();
+		}
+
+		void reset() {
+			lows.head = lows.size = highs.head = highs.size = 0;
+			for (uint16_t i = 0; i < SLOTS; i++) sums[i] = counts[i] = 0;
+			total = count = newest = 0;
+			started			  = false;
+		}
+
+		void add(uint32_t t, int16_t value) {
+			uint32_t slot = advance(t);
+			sums[slot % SLOTS] += value;
+			counts[slot % SLOTS]++;
+			total += value;
+			count++;
+			offer(lows, slot, value, false);
+			offer(highs, slot, value, true);
+		}
+
+		// Everything in the window ending at t
+		Summary summary(uint32_t t) {
+			advance(t);
+			if (!count) return {0, 0, NAN, 0};
+			return {lows.front().value, highs.front().value, (float)total / count, count};
+		}
+
+	private:
+		// Move the window on to the slot of t, expiring the slots and candidates that fall out of it
+		uint32_t advance(uint32_t t) {
+			uint32_t slot = t / SLOT_SECS;
+			if (!started) {
+				started = true;
+				newest	= slot;
+			}
+			if (slot <= newest) return newest;
+
+			uint32_t steps = slot - newest < SLOTS ? slot - newest : SLOTS;
+			for (uint32_t i = 1; i <= steps; i++) {
+				uint16_t reused = (newest + i) % SLOTS; // held slot newest + i - SLOTS
+				total -= sums[reused];
+				count -= counts[reused];
+				sums[reused] = counts[reused] = 0;
+			}
+			newest = slot;
+			expire(lows);
+			expire(highs);
+			return newest;
+		}
+
+		void expire(Deque &d) {
+			while (d.size && (uint16_t)((uint16_t)newest - d.front().slot) >= SLOTS) d.popFront();
+		}
+
+		// Candidates the new value beats can never be the extreme again, they leave the window first
+		static void offer(Deque &d, uint32_t slot, int16_t value, bool highest) {
+			while (d.size && (highest ? d.back().value <= value : d.back().value >= value)) d.size--;
+			if (d.size && d.back().slot == (uint16_t)slot) return; // this slot already holds a better one
+			d.pushBack({(uint16_t)slot, value});
+		}
+	};
+
+	enum Span : uint8_t {
+		HOUR,
+		DAY,
+		WEEK,
+		SPAN_COUNT,
+	};
+
+	constexpr static const char *SPAN_NAMES[SPAN_COUNT] = {"1h", "24h", "7d"};
+
+	// The three windows of one channel, about 3.4 KB
+	struct Channel {
+		Window<60, 60>	  hour; // 1 min slots
+		Window<96, 900>	  day;	// 15 min slots
+		Window<84, 7200> week; // 2 h slots
+
+		void add(uint32_t t, int16_t value) {
+			hour.add(t, value);
+			day.add(t, value);
+			week.add(t, value);
+		}
+
+		Summary summary(Span span, uint32_t t) {
+			switch (span) {
+			case HOUR:
+				return hour.summary(t);
+			case DAY:
+				return day.summary(t);
+			default:
+				return week.summary(t);
+			}
+		}
+
+		void reset() {
+			hour.reset();
+			day.reset();
+			week.reset();
+		}
+	};
+
+	inline Channel channels[History::CHANNEL_COUNT];
+	inline uint32_t (*clock)() = nullptr; // seconds, the same clock as the samples, set in setup()
+
+	inline void add(History::Channel ch, uint32_t t, float value) {
+		channels[ch].add(t, History::scale(ch, value));
+	}
+
+	// Unscaled min, max and mean, false while the window is empty
+	inline bool get(History::Channel ch, Span span, uint32_t t, float &min, float &max, float &mean) {
+		Summary s = channels[ch].summary(span, t);
+		if (!s.count) return false;
+		float scale = History::CHANNELS[ch].scale;
+		min = s.min / scale, max = s.max / scale, mean = s.mean / scale;
+		return true;
+	}
+
+	inline void reset() {
+		for (Channel &c : channels) c.reset();
+	}
+
+	// One sample per channel and window, empty windows are left out
+	inline void collect(Metrics::Writer &w, const Metrics::Family &f, uint8_t which) {
+		char	 labels[48];
+		uint32_t now = clock();
+		w.header(f);
+		for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) {
+			for (uint8_t span = 0; span < SPAN_COUNT; span++) {
+				float v[3];
+				if (!get((History::Channel)ch, (Span)span, now, v[0], v[1], v[2])) continue;
+				snprintf(labels, sizeof(labels), "channel=\"%s\",window=\"%s\"", History::CHANNELS[ch].name, SPAN_NAMES[span]);
+				w.sample(f, "", labels, v[which]);
+			}
+		}
+	}
+
+	inline void collectMin(Metrics::Writer &w, const Metrics::Family &f) {
+		collect(w, f, 0);
+	}
+
+	inline void collectMax(Metrics::Writer &w, const Metrics::Family &f) {
+		collect(w, f, 1);
+	}
+
+	inline void collectMean(Metrics::Writer &w, const Metrics::Family &f) {
+		collect(w, f, 2);
+	}
+} // namespace SlidingWindow
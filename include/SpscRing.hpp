@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Wait-free ring between exactly one producer task and one consumer task,
+ * e.g. sensor acquisition on one core and HomeSpan on the other. Each
+ * side only writes its own index, the other one is read with acquire
+ * ordering, so neither ever blocks or retries. A full ring drops the new
+ * item rather than overwrite one the consumer may be reading.
+ *
+ * Items are stamped with the producer's clock; pop() takes the consumer's
+ * and keeps the latency stats, both clocks must be the same microsecond
+ * counter. Every stat is written by one side only.
+ */
+template <typename T, uint16_t N>
+struct SpscRing {
+	static_assert(N && !(N & (N - 1)), "N must be a power of two");
+
+	struct Slot {
+		T		 item;
+		uint32_t stampUs;
+	};
+
+	Slot				  slots[N];
+	std::atomic<uint32_t> head{0}; // next slot to fill, producer only
+	std::atomic<uint32_t> tail{0}; // next slot to read, consumer only
+
+	// Producer stats
+	std::atomic<uint32_t> pushed{0};
+	std::atomic<uint32_t> dropped{0};
+
+	// Consumer stats
+	uint32_t highWater		 = 0; // deepest the ring was seen
+	uint32_t latencyCount	 = 0;
+	uint64_t latencySumUs	 = 0;
+	uint32_t latencyMaxUs	 = 0;
+
+	// Producer, false when full
+	bool push(const T &item, uint32_t nowUs) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == N) {
+			dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		slots[h % N] = {item, nowUs};
+		head.store(h + 1, std::memory_order_release);
+		pushed.store(pushed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Consumer, false when empty
+	bool pop(T &item, uint32_t nowUs) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t h = head.load(std::memory_order_acquire);
+		if (t == h) return false;
+		if (h - t > highWater) highWater = h - t;
+
+		const Slot &slot = slots[t % N];
+		item			 = slot.item;
+		uint32_t latency = nowUs - slot.stampUs;
+		tail.store(t + 1, std::memory_order_release);
+
+		latencyCount++;
+		latencySumUs += latency;
+		if (latency > latencyMaxUs) latencyMaxUs = latency;
+		return true;
+	}
+
+	// Either side, a snapshot
+	uint32_t depth() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+};
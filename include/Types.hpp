@@ -1,8 +1,17 @@
 #pragma once
 
+#include "Filters.hpp"
+#include "History.hpp"
+
 struct particleSensorState_t {
-	unsigned short avgPM25		   = 0;
-	unsigned short measurements[5] = {0, 0, 0, 0, 0};
-	unsigned char  measurementIdx  = 0;
-	bool		   valid		   = false;
+	unsigned short		avgPM25 = 0;
+	Filters::Pm25Frames frames;
+	bool				valid = false;
+};
+
+// A reading on its way from the acquisition task to the HomeKit services, see SpscRing.hpp
+struct sensorReading_t {
+	History::Channel channel;
+	float			 raw;	   // as the sensor reported it, goes to the history
+	float			 filtered; // what HomeKit and /events get
 };
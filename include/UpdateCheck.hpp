@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Hal.hpp"
+#include "Metrics.hpp"
+
+/**
+ * Firmware version check. The version file is fetched conditionally: the
+ * ETag and Last-Modified of the last answer go back as If-None-Match and
+ * If-Modified-Since, so an unchanged file costs a 304 and no body, and no
+ * cache-busting query is needed. The last version seen is kept, so a 304
+ * still says whether it differs from the running firmware.
+ *
+ * Transport needs int get(const char *url, const Request &, Response &),
+ * returning the HTTP status or a negative value when there was no answer.
+ */
+namespace UpdateCheck {
+
+	enum Result : uint8_t {
+		CURRENT,	  // fetched, same as the running firmware
+		AVAILABLE,	  // fetched, differs
+		NOT_MODIFIED, // 304, the last version seen stands
+		FAILED,
+		RESULT_COUNT,
+	};
+
+	constexpr static const char *RESULT_NAMES[RESULT_COUNT] = {"current", "available", "not_modified", "failed"};
+
+	struct Request {
+		const char *etag;		  // empty for an unconditional request
+		const char *lastModified; // empty for an unconditional request
+	};
+
+	struct Response {
+		char etag[72]		  = "";
+		char lastModified[40] = "";
+		char body[32]		  = ""; // the version string, truncated
+	};
+
+	template <typename Transport>
+	struct Checker {
+		Transport  &transport;
+		Hal::Clock &clock;
+
+		char etag[72]		  = "";
+		char lastModified[40] = "";
+		char latest[32]		  = ""; // last version the server reported
+
+		// Stats
+		uint32_t results[RESULT_COUNT] = {};
+		int		 lastStatus			   = 0;
+		uint32_t lastMs				   = 0; // duration of the last check
+		bool	 available			   = false;
+
+		Checker(Transport &transport, Hal::Clock &clock) : transport(transport), clock(clock) {}
+
+		Result check(const char *url, const char *running) {
+			uint32_t start = clock.millis();
+			Response response;
+			int		 status = transport.get(url, {etag, lastModified}, response);
+			lastMs			= clock.millis() - start;
+			lastStatus		= status;
+
+			Result result;
+			if (status == 304 && latest[0]) {
+				result = NOT_MODIFIED;
+			} else if (status == 200) {
+				strcpy(etag, response.etag);
+				strcpy(lastModified, response.lastModified);
+				trim(response.body);
+				strcpy(latest, response.body);
+				result = strcmp(latest, running) ? AVAILABLE : CURRENT;
+			} else {
+				result = FAILED;
+			}
+
+			if (result != FAILED) available = latest[0] && strcmp(latest, running);
+			results[result]++;
+			return result;
+		}
+
+		// homekit_update_checks_total{result}
+		void collect(Metrics::Writer &w, const Metrics::Family &f) const {
+			char labels[32];
+			w.header(f);
+			for (uint8_t r = 0; r < RESULT_COUNT; r++) {
+				snprintf(labels, sizeof(labels), "result=\"%s\"", RESULT_NAMES[r]);
+				w.sample(f, "_total", labels, results[r]);
+			}
+		}
+
+	private:
+		static void trim(char *s) {
+			char *start = s;
+			while (*start == ' ' || *start == '\t' || *start == '\r' || *start == '\n') start++;
+			size_t n = strlen(start);
+			while (n && (start[n - 1] == ' ' || start[n - 1] == '\t' || start[n - 1] == '\r' || start[n - 1] == '\n')) n--;
+			memmove(s, start, n);
+			s[n] = 0;
+		}
+	};
+} // namespace UpdateCheck
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "Hal.hpp"
+#include "Settings.hpp"
+#include "UpdateCheck.hpp"
+#include "Updater.hpp"
+
+/**
+ * When to check for a new firmware and when to fetch it, the same on the
+ * device (the update task in OTA.hpp) and in the host build. A check runs
+ * every Settings::updateCheckSecs, the first one an interval after the
+ * first step. Once a check reports another version the download job starts
+ * against Settings::otaManifestUrl, for the version the check reported, and
+ * is stepped until it is READY or FAILED; a failed one is tried again at
+ * the next check, a READY one waits for the reboot.
+ *
+ * Checker is an UpdateCheck::Checker, Job an Updater::Job. step() returns
+ * how long the caller may sleep.
+ */
+namespace UpdateFlow {
+
+	template <typename Checker, typename Job>
+	struct Task {
+		Checker	   &checker;
+		Job		   &job;
+		Hal::Clock &clock;
+		const char *version; // running firmware
+
+		bool (*prepare)()						 = nullptr; // before a download, false skips it
+		bool (*activate)()						 = nullptr; // once READY, false fails the job with Updater::FLASH
+		void (*checked)(UpdateCheck::Result)	 = nullptr; // after every check
+		void (*finished)()						 = nullptr; // after every download, READY or not
+
+		bool pending = false; // READY and activated, the next boot runs it
+
+		Task(Checker &checker, Job &job, Hal::Clock &clock, const char *version) : checker(checker), job(job), clock(clock), version(version) {}
+
+		uint32_t step() {
+			uint32_t now = clock.millis();
+			if (!started) lastCheckMs = now, started = true;
+
+			if (job.busy()) {
+				uint32_t waitMs = job.step();
+				if (job.busy()) return waitMs;
+				if (job.state == Updater::READY && activate && !activate()) job.fail(Updater::FLASH);
+				pending = job.state == Updater::READY;
+				if (finished) finished();
+				return 0;
+			}
+
+			const uint32_t intervalMs = Settings::updateCheckSecs * 1000;
+			if (!Settings::updateUrl[0]) return intervalMs;
+			if (now - lastCheckMs < intervalMs) return intervalMs - (now - lastCheckMs);
+			lastCheckMs = now;
+
+			char url[sizeof(Settings::updateUrl)];
+			snprintf(url, sizeof(url), "%s", Settings::updateUrl);
+			UpdateCheck::Result result = checker.check(url, version);
+			if (checked) checked(result);
+			if (job.state == Updater::READY || !checker.available || result == UpdateCheck::FAILED) return intervalMs;
+
+			snprintf(url, sizeof(url), "%s", Settings::otaManifestUrl);
+			if ((!prepare || prepare()) && job.start(url, checker.latest, version)) return 0;
+			return intervalMs;
+		}
+
+	private:
+		uint32_t lastCheckMs = 0;
+		bool	 started	 = false;
+	};
+} // namespace UpdateFlow
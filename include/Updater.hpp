@@ -0,0 +1,417 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DeltaPatch.hpp"
+#include "Hal.hpp"
+#include "Metrics.hpp"
+#include "Sha256.hpp"
+
+/**
+ * Firmware download into the inactive app slot, run step by step from a
+ * background task. A manifest next to the image says what to expect:
+ *
+ *   version=4.1.0
+ *   size=1253376
+ *   sha256=<64 hex digits>
+ *   url=esp32_air_quality_v4.bin   (absolute, or relative to the manifest)
+ *
+ * and optionally a delta from the previous release (see DeltaPatch.hpp):
+ *
+ *   delta_url=esp32_air_quality_v4.delta
+ *   delta_base_size=1249280
+ *   delta_base_sha256=<64 hex digits of the image it applies to>
+ *
+ * The image is streamed a sector at a time: erased, written, then
+ * throttle() so the loop task gets the flash back in between. A dropped
+ * connection resumes with a Range request from the last whole sector, and
+ * a server that ignores Range starts the image over. Once all of it is in
+ * flash it is read back and hashed, the job is READY only if the SHA-256
+ * matches the manifest; switching the boot partition is up to the caller.
+ * A manifest for the running version, or for another version than the
+ * check reported, is refused before anything is downloaded: a manifest
+ * that trails the version file would otherwise reinstall the old image.
+ *
+ * With a `running` image and a delta whose base matches it, the delta is
+ * fetched instead and applied on the fly: the old image is read from the
+ * running slot, the new one written to the target as above. A delta isn't
+ * resumed (it is small), a delta that fails to apply or verify falls back
+ * to the full image.
+ *
+ * Transport needs template <typename Sink> int fetch(const char *url,
+ * uint32_t from, Sink &) that asks for the bytes from `from` on and
+ * returns the HTTP status or a negative value when there was no answer.
+ * Before the body it calls sink.begin(offset) with where the body starts
+ * (0 for a 200), then sink.write(data, len) until either returns false.
+ * Flash is SampleLog's: size(), read(), write() and erase().
+ */
+namespace Updater {
+
+	constexpr static const uint32_t SECTOR		 = 4096;
+	constexpr static const uint8_t	MAX_ATTEMPTS = 6; // in a row without progress
+	constexpr static const uint32_t RETRY_MIN_MS = 5000;
+	constexpr static const uint32_t RETRY_MAX_MS = 120000;
+
+	enum State : uint8_t {
+		IDLE,
+		MANIFEST,
+		DOWNLOADING,
+		VERIFYING,
+		READY, // verified, waiting for the caller to switch over
+		FAILED,
+		STATE_COUNT,
+	};
+
+	constexpr static const char *STATE_NAMES[STATE_COUNT] = {"idle", "manifest", "downloading", "verifying", "ready", "failed"};
+
+	enum Failure : uint8_t { // full image, a delta falls back instead
+		BAD_MANIFEST,
+		NETWORK,
+		FLASH,
+		DIGEST,
+		VERSION, // the manifest is for the running or an unexpected version
+		FAILURE_COUNT,
+	};
+
+	constexpr static const char *FAILURE_NAMES[FAILURE_COUNT] = {"manifest", "network", "flash", "digest", "version"};
+
+	struct Manifest {
+		char	 version[32];
+		uint32_t size;
+		uint8_t	 sha256[32];
+		char	 url[160];
+		bool	 delta; // the three below are set
+		char	 deltaUrl[160];
+		uint32_t deltaBaseSize;
+		uint8_t	 deltaBaseSha256[32];
+	};
+
+	inline bool parseHex(const char *text, uint8_t out[32]) {
+		if (strlen(text) != 64) return false;
+		for (uint8_t i = 0; i < 32; i++) {
+			char hex[3] = {text[2 * i], text[2 * i + 1], 0}, *stop;
+			out[i]		= strtoul(hex, &stop, 16);
+			if (*stop) return false;
+		}
+		return true;
+	}
+
+	inline bool parseSize(const char *text, uint32_t &out) {
+		char *stop;
+		out = strtoul(text, &stop, 10);
+		return *text && !*stop && out;
+	}
+
+	// Absolute, or relative to the manifest's directory
+	inline bool resolve(const char *url, const char *manifestUrl, char *out, size_t size) {
+		if (strstr(url, "://")) return snprintf(out, size, "%s", url) < (int)size;
+		const char *slash = strrchr(manifestUrl, '/');
+		int			dir	  = slash ? slash - manifestUrl + 1 : 0;
+		return snprintf(out, size, "%.*s%s", dir, manifestUrl, url) < (int)size;
+	}
+
+	// False unless every field is there and fits, a partial delta is ignored
+	inline bool parseManifest(const char *text, const char *manifestUrl, Manifest &m) {
+		memset(&m, 0, sizeof(m));
+		bool haveSize = false, haveHash = false, haveDeltaSize = false, haveDeltaHash = false;
+		char image[sizeof(m.url)] = "", delta[sizeof(m.deltaUrl)] = "";
+
+		for (const char *line = text; *line;) {
+			const char *end = strchr(line, '\n');
+			size_t		len = end ? end - line : strlen(line);
+			char		buf[sizeof(m.url) + 24];
+			if (len >= sizeof(buf)) return false;
+			memcpy(buf, line, len);
+			line += end ? len + 1 : len;
+			while (len && (buf[len - 1] == '\r' || buf[len - 1] == ' ')) len--;
+			buf[len]  = 0;
+			char *key = buf, *value = strchr(buf, '=');
+			if (!value) continue;
+			*value++ = 0;
+
+			if (!strcmp(key, "version")) {
+				if (strlen(value) >= sizeof(m.version)) return false;
+				strcpy(m.version, value);
+			} else if (!strcmp(key, "size")) {
+				haveSize = parseSize(value, m.size);
+			} else if (!strcmp(key, "sha256")) {
+				haveHash = parseHex(value, m.sha256);
+			} else if (!strcmp(key, "url")) {
+				if (strlen(value) >= sizeof(image)) return false;
+				strcpy(image, value);
+			} else if (!strcmp(key, "delta_url")) {
+				if (strlen(value) < sizeof(delta)) strcpy(delta, value);
+			} else if (!strcmp(key, "delta_base_size")) {
+				haveDeltaSize = parseSize(value, m.deltaBaseSize);
+			} else if (!strcmp(key, "delta_base_sha256")) {
+				haveDeltaHash = parseHex(value, m.deltaBaseSha256);
+			}
+		}
+		if (!haveSize || !haveHash || !image[0] || !resolve(image, manifestUrl, m.url, sizeof(m.url))) return false;
+		m.delta = delta[0] && haveDeltaSize && haveDeltaHash && resolve(delta, manifestUrl, m.deltaUrl, sizeof(m.deltaUrl));
+		return true;
+	}
+
+	// Collects the manifest
+	struct TextSink {
+		char   text[512];
+		size_t len = 0;
+
+		bool begin(uint32_t offset) {
+			return offset == 0;
+		}
+
+		bool write(const uint8_t *data, size_t n) {
+			if (len + n >= sizeof(text)) return false;
+			memcpy(text + len, data, n);
+			len += n;
+			text[len] = 0;
+			return true;
+		}
+	};
+
+	template <typename Transport, typename Flash>
+	struct Job {
+		Transport  &transport;
+		Flash	   &slot;
+		Hal::Clock &clock;
+		Flash	   *running = nullptr; // the image deltas apply to, none without it
+		void (*throttle)() = nullptr; // after every sector written
+
+		State	 state = IDLE;
+		Manifest manifest;
+		uint32_t written = 0;	  // bytes in flash, a resumed request starts here
+		bool	 delta	 = false; // applying the manifest's delta
+
+		// Stats
+		uint32_t received				 = 0; // bytes fetched for the current image, repeated ones included
+		uint32_t resumes				 = 0;
+		uint32_t restarts				 = 0; // the server ignored Range
+		uint32_t failures[FAILURE_COUNT] = {};
+		uint32_t deltas					 = 0; // updates built from a delta
+		uint32_t deltaFallbacks			 = 0; // deltas given up for the full image
+		uint32_t lastMs					 = 0; // duration of the last finished update
+
+		Job(Transport &transport, Flash &slot, Hal::Clock &clock) : transport(transport), slot(slot), clock(clock) {}
+
+		bool busy() const {
+			return state == MANIFEST || state == DOWNLOADING || state == VERIFYING;
+		}
+
+		// False while an update is under way. With expected, the manifest has to be for that version,
+		// with current (the running one) it must not be for that
+		bool start(const char *url, const char *expected = nullptr, const char *current = nullptr) {
+			if (busy()) return false;
+			snprintf(manifestUrl, sizeof(manifestUrl), "%s", url);
+			snprintf(expectedVersion, sizeof(expectedVersion), "%s", expected ? expected : "");
+			snprintf(currentVersion, sizeof(currentVersion), "%s", current ? current : "");
+			state	  = MANIFEST;
+			written	  = 0;
+			received  = 0;
+			attempts  = 0;
+			startedMs = clock.millis();
+			return true;
+		}
+
+		// One pass of the update task, returns how long it may sleep
+		uint32_t step() {
+			switch (state) {
+			case MANIFEST: {
+				TextSink text;
+				int		 status = transport.fetch(manifestUrl, 0, text);
+				if (status != 200) return retry(NETWORK);
+				if (!parseManifest(text.text, manifestUrl, manifest) || manifest.size > slot.size()) return fail(BAD_MANIFEST);
+				if ((expectedVersion[0] && strcmp(manifest.version, expectedVersion)) || (currentVersion[0] && !strcmp(manifest.version, currentVersion))) {
+					return fail(VERSION); // not the update that was announced, tried again after the next check
+				}
+				delta	 = manifest.delta && running && baseMatches();
+				state	 = DOWNLOADING;
+				attempts = 0;
+				return 0;
+			}
+
+			case DOWNLOADING: {
+				if (delta) return stepDelta();
+				uint32_t before = received;
+				fill			= 0; // a partial sector is fetched again
+				flashError		= false;
+				if (written) resumes++;
+				transport.fetch(manifest.url, written, *this);
+				if (flashError) return fail(FLASH);
+				if (written == manifest.size) {
+					state = VERIFYING;
+					return 0;
+				}
+				if (received != before) attempts = 0; // only attempts in a row without progress count
+				return retry(NETWORK);
+			}
+
+			case VERIFYING: {
+				Sha256 sha;
+				for (uint32_t at = 0; at < manifest.size; at += SECTOR) {
+					uint32_t n = manifest.size - at < SECTOR ? manifest.size - at : SECTOR;
+					if (!slot.read(at, block, n)) return fail(FLASH);
+					sha.update(block, n);
+				}
+				uint8_t digest[32];
+				sha.finish(digest);
+				if (memcmp(digest, manifest.sha256, sizeof(digest))) return delta ? fallBack() : fail(DIGEST);
+				state = READY;
+				deltas += delta;
+				lastMs = clock.millis() - startedMs;
+				return 0;
+			}
+
+			default:
+				return 0;
+			}
+		}
+
+		// Gives up on the current update
+		uint32_t fail(Failure failure) {
+			failures[failure]++;
+			state  = FAILED;
+			lastMs = clock.millis() - startedMs;
+			return 0;
+		}
+
+		// Sink for the image or the delta
+		bool begin(uint32_t offset) {
+			if (delta) return offset == 0;
+			if (offset == written) return true;
+			if (offset) return false; // not where we asked for
+			written = 0;
+			restarts++;
+			return true;
+		}
+
+		bool write(const uint8_t *data, size_t len) {
+			received += len;
+			return delta ? decoder.feed(data, len, *this) : emit(data, len);
+		}
+
+		// The new image in order, whole sectors go to flash
+		bool emit(const uint8_t *data, size_t len) {
+			while (len) {
+				uint32_t left = manifest.size - written - fill;
+				if (!left) return false; // longer than the manifest says
+				size_t n = SECTOR - fill;
+				if (n > len) n = len;
+				if (n > left) n = left;
+				memcpy(block + fill, data, n);
+				fill += n;
+				data += n;
+				len -= n;
+
+				if (fill == SECTOR || written + fill == manifest.size) {
+					if (!slot.erase(written, SECTOR) || !slot.write(written, block, fill)) {
+						flashError = true;
+						return false;
+					}
+					written += fill;
+					fill = 0;
+					if (throttle) throttle();
+				}
+			}
+			return true;
+		}
+
+		// Bytes of the new image emitted before, for DeltaPatch
+		bool readBack(uint32_t at, uint8_t *out, size_t len) {
+			if (at < written) {
+				size_t n = written - at < len ? written - at : len;
+				if (!slot.read(at, out, n)) return false;
+				at += n, out += n, len -= n;
+			}
+			memcpy(out, block + (at - written), len);
+			return true;
+		}
+
+		uint32_t produced() const {
+			return written + fill;
+		}
+
+		// homekit_ota_state{state}, 1 for the current one
+		void collectState(Metrics::Writer &w, const Metrics::Family &f) const {
+			char labels[32];
+			w.header(f);
+			for (uint8_t s = 0; s < STATE_COUNT; s++) {
+				snprintf(labels, sizeof(labels), "state=\"%s\"", STATE_NAMES[s]);
+				w.sample(f, "", labels, state == s);
+			}
+		}
+
+		// homekit_ota_failures_total{reason}
+		void collectFailures(Metrics::Writer &w, const Metrics::Family &f) const {
+			char labels[32];
+			w.header(f);
+			for (uint8_t r = 0; r < FAILURE_COUNT; r++) {
+				snprintf(labels, sizeof(labels), "reason=\"%s\"", FAILURE_NAMES[r]);
+				w.sample(f, "_total", labels, failures[r]);
+			}
+		}
+
+	private:
+		char	 manifestUrl[160];
+		char	 expectedVersion[32] = "";
+		char	 currentVersion[32]	 = "";
+		uint8_t	 attempts			 = 0;
+		uint32_t startedMs			 = 0;
+		uint8_t	 block[SECTOR];
+		uint16_t fill		= 0;
+		bool	 flashError = false;
+
+		DeltaPatch::Decoder<Flash> decoder;
+
+		uint32_t retry(Failure failure) {
+			if (++attempts >= MAX_ATTEMPTS) return delta ? fallBack() : fail(failure);
+			uint32_t wait = RETRY_MIN_MS << (attempts - 1);
+			return wait < RETRY_MAX_MS ? wait : RETRY_MAX_MS;
+		}
+
+		// Whether the running image is the one the delta was made from
+		bool baseMatches() {
+			if (manifest.deltaBaseSize > running->size()) return false;
+			Sha256 sha;
+			for (uint32_t at = 0; at < manifest.deltaBaseSize; at += SECTOR) {
+				uint32_t n = manifest.deltaBaseSize - at < SECTOR ? manifest.deltaBaseSize - at : SECTOR;
+				if (!running->read(at, block, n)) return false;
+				sha.update(block, n);
+			}
+			uint8_t digest[32];
+			sha.finish(digest);
+			return !memcmp(digest, manifest.deltaBaseSha256, sizeof(digest));
+		}
+
+		// A delta is fetched whole each time, a broken one means the full image
+		uint32_t stepDelta() {
+			DeltaPatch::Header expected = {manifest.deltaBaseSize, {}, manifest.size, {}};
+			memcpy(expected.oldSha256, manifest.deltaBaseSha256, 32);
+			memcpy(expected.newSha256, manifest.sha256, 32);
+			decoder.begin(*running, expected);
+			written = fill = 0;
+			flashError	   = false;
+
+			int status = transport.fetch(manifest.deltaUrl, 0, *this);
+			if (flashError) return fail(FLASH);
+			if (decoder.done(*this)) {
+				state = VERIFYING;
+				return 0;
+			}
+			if (decoder.failed || (status >= 400 && status < 500)) return fallBack();
+			return retry(NETWORK);
+		}
+
+		uint32_t fallBack() {
+			deltaFallbacks++;
+			delta	 = false;
+			state	 = DOWNLOADING;
+			written	 = 0;
+			attempts = 0;
+			return 0;
+		}
+	};
+} // namespace Updater
@@ -0,0 +1,4 @@
+#pragma once
+
+// Firmware version, compared against bin_version.txt by the OTA check and stamped into benchmark results
+#define FW_VERSION "1.4.3"
@@ -51,16 +51,18 @@
 
 #define REQUIRED VERSION(1, 6, 0)
 
+#include "Boot.hpp"
 #include "DEV_Sensors.hpp"
+#include "Metrics.hpp"
 #include "SerialCom.hpp"
+#include "Scheduler.hpp"
+#include "SeriesCodec.hpp"
 #include "Types.hpp"
 #include <Adafruit_NeoPixel.h>
 #include <WiFiClient.h>
 #include <WebServer.h>
 #include <ElegantOTA.h>
-#include <ErriezMHZ19B.h>
 #include <HomeSpan.h>
-#include <SoftwareSerial.h>
 #include "OTA.hpp"
 
 #define BUTTON_PIN	   0
@@ -68,12 +70,18 @@
 
 WebServer server(80);
 
+Scheduler<8> scheduler; // periodic jobs on loop(), the sensor jobs run on the acquisition task (see setupJobs())
+
 DEV_CO2Sensor		 *CO2; // GLOBAL POINTER TO STORE SERVICE
 DEV_AirQualitySensor *AQI; // GLOBAL POINTER TO STORE SERVICE
 
-extern "C++" bool needToWarmUp;
-
 void setupWeb();
+void pushTask(void *);
+void setupPipeline();
+void setupJobs();
+void showValue(Notify::Characteristic c, float value);
+void publishReading(History::Channel channel, float raw, float shown);
+void onHistoryRestored(const Restore::Result &restored);
 
 #if HARDWARE_VER == 4
 DEV_TemperatureSensor *TEMP;
@@ -83,6 +91,10 @@ DEV_HumiditySensor	  *HUM;
 void setup() {
 
 	Serial.begin(115200);
+	Boot::mark("setup");
+	Settings::load();
+	LoopStats::clock = []() { return systemClock.micros(); };
+	SlidingWindow::clock = historyTime;
 
 	Serial.print("Active firmware version: ");
 	Serial.println(FirmwareVer);
@@ -115,6 +127,7 @@ void setup() {
 	homeSpan.setSketchVersion(fw_ver);
 
 	homeSpan.begin(Category::Bridges, "HomeSpan Air Sensor Bridge");
+	Boot::mark("homespan_begin");
 
 	new SpanAccessory();
 	new Service::AccessoryInformation();
@@ -146,59 +159,411 @@ void setup() {
 	new Characteristic::Name("Humidity Sensor");
 	HUM = new DEV_HumiditySensor(); // Create a Temperature Sensor (see DEV_Sensors.h for definition)
 #endif
+	Boot::mark("accessories");
+
+	// Sensors come up after HomeSpan, each accessory reports StatusActive=false until its sensor is ready
+	Boot::addStage("sample_log_ready", initSampleLog, 1000);
+	Boot::addStage("pm1006_ready", initPM1006, 1000);
+	Boot::addStage("mhz19b_ready", initMHZ, 2500);
+#if HARDWARE_VER == 4
+	Boot::addStage("si7021_ready", initSi7021, 2500);
+#endif
+
+	setupPipeline();
+	setupJobs();
 }
 
 void loop() {
-	homeSpan.poll();
-	server.handleClient();
-	repeatedCall();
-}
+	LoopStats::Iteration iteration; // records a stall if this pass goes over budget
 
-void setupWeb() {
-	LOG0("Starting Air Quality Sensor Server Hub...\n\n");
+	{
+		LoopStats::Scope probe(LoopStats::BOOT);
+		Boot::poll();
+	}
+	{
+		LoopStats::Scope probe(LoopStats::READINGS);
+		Pipeline::drainReadings();
+	}
+	{
+		LoopStats::Scope probe(LoopStats::POLL);
+		homeSpan.poll();
+	}
+	{
+		LoopStats::Scope probe(LoopStats::HTTP);
+		server.handleClient();
+		events.pump(millis());
+	}
+	{
+		LoopStats::Scope probe(LoopStats::JOBS);
+		scheduler.run(millis());
+	}
+	{
+		LoopStats::Scope probe(LoopStats::ANIMATION);
+		animator.tick(millis());
+	}
+}
 
-	server.on("/metrics", HTTP_GET, []() {
-		float airQuality = AQI->pm25->getVal();
-		float co2		 = CO2->co2Level->getVal();
+// The board side of Pipeline.hpp, the services are already created
+void setupPipeline() {
+	Pipeline::clock		  = &systemClock;
+	Pipeline::mhz19b	  = &mhz19b;
 #if HARDWARE_VER == 4
-		float temp = TEMP->temp->getVal<float>();
-		float hum  = HUM->hum->getVal<float>();
+	Pipeline::si7021 = &si7021;
 #endif
-		int	   lightness		= neopixelAutoBrightness();
-		float  uptime			= esp_timer_get_time() / (6 * 10e6);
-		float  heap				= esp_get_free_heap_size();
-		String airQualityMetric = "# HELP air_quality PM2.5 Density\nhomekit_air_quality{device=\"air_sensor\",location=\"home\"} " + String(airQuality);
-		String CO2Metric		= "# HELP co2 Carbon Dioxide\nhomekit_carbon_dioxide{device=\"air_sensor\",location=\"home\"} " + String(co2);
-		String uptimeMetric		= "# HELP uptime Sensor uptime\nhomekit_uptime{device=\"air_sensor\",location=\"home\"} " + String(int(uptime));
-		String heapMetric		= "# HELP heap Available heap memory\nhomekit_heap{device=\"air_sensor\",location=\"home\"} " + String(int(heap));
-		String lightnessMetric	= "# HELP lightness Lightness\nhomekit_lightness{device=\"air_sensor\",location=\"home\"} " + String(lightness);
+	Pipeline::light		  = &lightTap;
+	Pipeline::animator	  = &animator;
+	Pipeline::clockSynced = clockSynced;
+	Pipeline::historyTime = historyTime;
+	Pipeline::logSample	  = [](History::Channel channel, uint32_t t, int16_t value) { sampleLog.append(channel, t, value); };
+	Pipeline::replayLog	  = [](History::Store &history, uint32_t now) { return Restore::replay(sampleLog, history, now); };
+	Pipeline::pushSample  = [](uint32_t t, History::Channel channel, float value) { if (Settings::pushUrl[0]) pusher.add(t, channel, value); };
+	Pipeline::streamSample = [](History::Channel channel, float value) { events.publish(channel, value); };
 #if HARDWARE_VER == 4
-		String tempMetric = "# HELP temp Temperature\nhomekit_temperature{device=\"air_sensor\",location=\"home\"} " + String(temp);
-		String humMetric  = "# HELP hum Relative Humidity\nhomekit_humidity{device=\"air_sensor\",location=\"home\"} " + String(hum);
+	Pipeline::offset = [](History::Channel channel) {
+		if (channel == History::TEMPERATURE) return TEMP->offsetTemp.getVal<float>();
+		if (channel == History::HUMIDITY) return HUM->offsetHum.getVal<float>();
+		return 0.0f;
+	};
 #endif
-		LOG1(airQualityMetric);
-		LOG1(CO2Metric);
-		LOG1(uptimeMetric);
-		LOG1(heapMetric);
-		LOG1(lightnessMetric);
+	Pipeline::show		= showValue;
+	Pipeline::published = publishReading;
+	Pipeline::restored	= onHistoryRestored;
+}
+
+// Jobs share INTERVAL but are spread evenly across it, so their work never lands in the same iteration.
+// Sensor jobs go to the acquisition task, which starts here once they are all registered
+void setupJobs() {
+	const uint32_t period = INTERVAL * 1000;
+	const uint32_t now	  = millis();
+
+	Pipeline::setupJobs(period, now);
+	scheduler.add("restore", Pipeline::restoreHistory, period, period * 7 / 8, now);
+	scheduler.add("ota", []() { LoopStats::Scope probe(LoopStats::OTA); checkForUpdate(); }, period, period * 5 / 8, now); // reboots once updateTask has a verified image
+
+	xTaskCreatePinnedToCore(acquisitionTask, "sensors", 4096, nullptr, 2, nullptr, ACQUISITION_CORE);
+}
+
+// A value Notify let through, this generates an Event Notification and also resets the elapsed time
+void showValue(Notify::Characteristic c, float value) {
+	switch (c) {
+	case Notify::CO2:
+		CO2->co2Level->setVal(value);
+		break;
+	case Notify::PM25:
+		AQI->pm25->setVal(value);
+		break;
+	case Notify::AIR_QUALITY:
+		AQI->airQuality->setVal((uint8_t)value);
+		break;
 #if HARDWARE_VER == 4
-		LOG1(tempMetric);
-		LOG1(humMetric);
+	case Notify::TEMPERATURE:
+		TEMP->temp->setVal(value);
+		break;
+	case Notify::HUMIDITY:
+		HUM->hum->setVal(value);
+		break;
 #endif
-		if (needToWarmUp == 0) { // exclude co2 and air quality if it is still warming up
+	default:
+		break;
+	}
+}
+
+// What the services keep of each reading beyond the value, see Pipeline::drainReadings()
+void publishReading(History::Channel channel, float raw, float shown) {
+	switch (channel) {
+	case History::CO2:
+		CO2->publish(raw, shown);
+		break;
+	case History::PM25:
+		AQI->publish();
+		break;
 #if HARDWARE_VER == 4
-			server.send(200, "text/plain", airQualityMetric + "\n" + CO2Metric + "\n" + uptimeMetric + "\n" + heapMetric + "\n" + lightnessMetric + "\n" + tempMetric + "\n" + humMetric);
-#else
-			server.send(200, "text/plain", airQualityMetric + "\n" + CO2Metric + "\n" + uptimeMetric + "\n" + heapMetric + "\n" + lightnessMetric);
+	case History::TEMPERATURE:
+		TEMP->publish(raw, shown);
+		break;
+	case History::HUMIDITY:
+		HUM->publish(raw, shown);
+		break;
 #endif
-		} else {
-#if HARDWARE_VER == 4
-			server.send(200, "text/plain", uptimeMetric + "\n" + heapMetric + "\n" + lightnessMetric + "\n" + tempMetric + "\n" + humMetric);
-#else
-			server.send(200, "text/plain", uptimeMetric + "\n" + heapMetric + "\n" + lightnessMetric);
+	case History::LIGHT:
+		LOG2("Lightness: %d\n", (int)raw);
+		break;
+	default:
+		break;
+	}
+}
 
+// One sample per sensor port
+void collectUart(Metrics::Writer &w, const Metrics::Family &f, uint32_t HalEsp32::UartStats::*counter) {
+	acquisitionStats_t s = statsSnapshot();
+	w.header(f);
+	w.sample(f, "_total", "port=\"pm1006\"", s.pmUart.*counter);
+	w.sample(f, "_total", "port=\"mhz19b\"", s.mhzUart.*counter);
+}
+
+// Fixed buffer for chunked responses (/metrics, /history), flushed to the client as one chunk when full
+char			httpBuf[512];
+Metrics::Writer httpWriter(httpBuf, sizeof(httpBuf), [](const char *data, size_t len) { server.sendContent(data, len); });
+
+// Metrics exported at /metrics, one entry per family. What the acquisition task owns comes from statsSnapshot()
+// clang-format off
+const Metrics::Family metricFamilies[] = {
+	{"homekit_air_quality", Metrics::GAUGE, "PM2.5 density in ug/m3", [](double &v) {
+		if (Pipeline::needToWarmUp) return false; // exclude co2 and air quality while the sensors warm up
+		v = statsSnapshot().pm25; // the characteristic only moves past the notification deadband
+		return true; }, nullptr},
+	{"homekit_carbon_dioxide", Metrics::GAUGE, "Carbon dioxide level in ppm", [](double &v) {
+		if (Pipeline::needToWarmUp) return false;
+		v = statsSnapshot().co2;
+		return true; }, nullptr},
+	{"homekit_uptime", Metrics::GAUGE, "Sensor uptime in minutes", [](double &v) {
+		v = (uint32_t)(esp_timer_get_time() / 60000000);
+		return true; }, nullptr},
+	{"homekit_heap", Metrics::GAUGE, "Available heap memory in bytes", [](double &v) {
+		v = esp_get_free_heap_size();
+		return true; }, nullptr},
+	{"homekit_lightness", Metrics::GAUGE, "LED brightness derived from the light sensor", [](double &v) {
+		v = Pipeline::brightness();
+		return true; }, nullptr},
+#if HARDWARE_VER == 4
+	{"homekit_temperature", Metrics::GAUGE, "Temperature in degrees Celsius", [](double &v) {
+		v = statsSnapshot().temperature + TEMP->offsetTemp.getVal<float>();
+		return true; }, nullptr},
+	{"homekit_humidity", Metrics::GAUGE, "Relative humidity in percent", [](double &v) {
+		v = statsSnapshot().humidity + HUM->offsetHum.getVal<float>();
+		return true; }, nullptr},
 #endif
+	{"homekit_reading", Metrics::SUMMARY, "Raw readings since the previous scrape", nullptr, ScrapeWindow::collectSummary},
+	{"homekit_reading_min", Metrics::GAUGE, "Lowest raw reading since the previous scrape", nullptr, ScrapeWindow::collectMin},
+	{"homekit_reading_max", Metrics::GAUGE, "Highest raw reading since the previous scrape", nullptr, ScrapeWindow::collectMax},
+	{"homekit_rolling_min", Metrics::GAUGE, "Lowest raw reading over the last 1h, 24h and 7d", nullptr, SlidingWindow::collectMin},
+	{"homekit_rolling_max", Metrics::GAUGE, "Highest raw reading over the last 1h, 24h and 7d", nullptr, SlidingWindow::collectMax},
+	{"homekit_rolling_mean", Metrics::GAUGE, "Mean raw reading over the last 1h, 24h and 7d", nullptr, SlidingWindow::collectMean},
+	{"homekit_readings_queued", Metrics::GAUGE, "Readings waiting for loop() to publish them", [](double &v) {
+		v = Pipeline::readings.depth();
+		return true; }, nullptr},
+	{"homekit_readings_queued_max", Metrics::GAUGE, "Most readings ever waiting for loop()", [](double &v) {
+		v = Pipeline::readings.highWater;
+		return true; }, nullptr},
+	{"homekit_readings_dropped", Metrics::COUNTER, "Readings lost because loop() fell too far behind", [](double &v) {
+		v = Pipeline::readings.dropped;
+		return true; }, nullptr},
+	{"homekit_readings_latency_seconds", Metrics::SUMMARY, "Time from taking a reading to publishing it", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		w.header(f);
+		w.sample(f, "_sum", "", Pipeline::readings.latencySumUs / 1e6);
+		w.sample(f, "_count", "", Pipeline::readings.latencyCount); }},
+	{"homekit_readings_latency_max_seconds", Metrics::GAUGE, "Longest time from taking a reading to publishing it", [](double &v) {
+		v = Pipeline::readings.latencyMaxUs / 1e6;
+		return true; }, nullptr},
+	{"homekit_mhz19b_temperature", Metrics::GAUGE, "MH-Z19B internal temperature in degrees Celsius", [](double &v) {
+		acquisitionStats_t s = statsSnapshot();
+		if (!s.mhzDetected) return false;
+		v = s.mhzTemperature;
+		return true; }, nullptr},
+	{"homekit_mhz19b_unclamped_ppm", Metrics::GAUGE, "CO2 level not clamped to the MH-Z19B range", [](double &v) {
+		acquisitionStats_t s = statsSnapshot();
+		if (!s.mhzUnclamped) return false;
+		v = s.mhzUnclamped;
+		return true; }, nullptr},
+	{"homekit_mhz19b_command_seconds", Metrics::SUMMARY, "MH-Z19B command round trips", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		acquisitionStats_t s = statsSnapshot();
+		w.header(f);
+		w.sample(f, "_sum", "", s.mhzLatencySumMs / 1e3);
+		w.sample(f, "_count", "", s.mhzReplies); }},
+	{"homekit_mhz19b_command_max_seconds", Metrics::GAUGE, "Slowest MH-Z19B command round trip", [](double &v) {
+		v = statsSnapshot().mhzLatencyMaxUs / 1e6;
+		return true; }, nullptr},
+	{"homekit_mhz19b_errors", Metrics::COUNTER, "MH-Z19B commands that failed by reason", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		acquisitionStats_t s = statsSnapshot();
+		w.header(f);
+		w.sample(f, "_total", "reason=\"checksum\"", s.mhzErrors);
+		w.sample(f, "_total", "reason=\"timeout\"", s.mhzTimeouts);
+		w.sample(f, "_total", "reason=\"queue_full\"", s.mhzOverflows); }},
+	{"homekit_uart_overruns", Metrics::COUNTER, "Sensor UART bytes lost to a full FIFO or buffer", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		collectUart(w, f, &HalEsp32::UartStats::overruns); }},
+	{"homekit_uart_framing_errors", Metrics::COUNTER, "Sensor UART characters garbled on the wire", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		collectUart(w, f, &HalEsp32::UartStats::framingErrors); }},
+	{"homekit_events_subscribers", Metrics::GAUGE, "Clients connected to /events", [](double &v) {
+		v = events.count();
+		return true; }, nullptr},
+	{"homekit_events_rejected", Metrics::COUNTER, "/events connections turned away with every slot taken", [](double &v) {
+		v = events.rejected;
+		return true; }, nullptr},
+	{"homekit_events_dropped", Metrics::COUNTER, "Events skipped for subscribers that fell behind", [](double &v) {
+		v = events.dropped;
+		return true; }, nullptr},
+	{"homekit_push_queued", Metrics::GAUGE, "Samples waiting for the push exporter", [](double &v) {
+		v = pusher.queued();
+		return true; }, nullptr},
+	{"homekit_push_sent", Metrics::COUNTER, "Samples the push server accepted", [](double &v) {
+		v = pusher.sent;
+		return true; }, nullptr},
+	{"homekit_push_dropped", Metrics::COUNTER, "Samples lost to a full push queue or refused by the server", [](double &v) {
+		v = pusher.dropped + pusher.rejected;
+		return true; }, nullptr},
+	{"homekit_push_failures", Metrics::COUNTER, "Push requests without a 2xx answer", [](double &v) {
+		v = pusher.failures;
+		return true; }, nullptr},
+	{"homekit_push_request_seconds", Metrics::GAUGE, "Duration of the last push request", [](double &v) {
+		v = pusher.lastMs / 1e3;
+		return true; }, nullptr},
+	{"homekit_update_checks", Metrics::COUNTER, "Firmware version checks by result", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		updateChecker.collect(w, f); }},
+	{"homekit_update_check_seconds", Metrics::GAUGE, "Duration of the last firmware version check", [](double &v) {
+		v = updateChecker.lastMs / 1e3;
+		return true; }, nullptr},
+	{"homekit_update_available", Metrics::GAUGE, "1 while the version server reports another firmware", [](double &v) {
+		v = updateChecker.available;
+		return true; }, nullptr},
+	{"homekit_ota_state", Metrics::GAUGE, "Firmware download state, 1 for the current one", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		updater.collectState(w, f); }},
+	{"homekit_ota_bytes", Metrics::GAUGE, "Bytes of the firmware image in flash", [](double &v) {
+		v = updater.written;
+		return true; }, nullptr},
+	{"homekit_ota_size_bytes", Metrics::GAUGE, "Size of the firmware image being downloaded", [](double &v) {
+		if (updater.state == Updater::IDLE) return false;
+		v = updater.manifest.size;
+		return true; }, nullptr},
+	{"homekit_ota_resumes", Metrics::COUNTER, "Firmware downloads resumed with a Range request", [](double &v) {
+		v = updater.resumes;
+		return true; }, nullptr},
+	{"homekit_ota_failures", Metrics::COUNTER, "Firmware updates given up by reason", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		updater.collectFailures(w, f); }},
+	{"homekit_ota_deltas", Metrics::COUNTER, "Firmware updates built from a delta", [](double &v) {
+		v = updater.deltas;
+		return true; }, nullptr},
+	{"homekit_ota_delta_fallbacks", Metrics::COUNTER, "Deltas given up for the full image", [](double &v) {
+		v = updater.deltaFallbacks;
+		return true; }, nullptr},
+	{"homekit_ota_duration_seconds", Metrics::GAUGE, "Duration of the last firmware download", [](double &v) {
+		v = updater.lastMs / 1e3;
+		return true; }, nullptr},
+	{"homekit_notifications", Metrics::COUNTER, "HomeKit value events sent or held back by the notification policy", nullptr, Notify::collect},
+	{"homekit_loop_latency_seconds", Metrics::HISTOGRAM, "Time spent per loop() subsystem", nullptr, LoopStats::collectLatency},
+	{"homekit_loop_max_seconds", Metrics::GAUGE, "Longest call per loop() subsystem since boot", nullptr, LoopStats::collectMax},
+	{"homekit_loop_stalls", Metrics::COUNTER, "loop() iterations over the stall budget", [](double &v) {
+		v = LoopStats::stallCount;
+		return true; }, nullptr},
+	{"homekit_http_lines_dropped", Metrics::COUNTER, "Response lines left out for not fitting the line buffer", [](double &v) {
+		v = httpWriter.dropped;
+		return true; }, nullptr},
+};
+// clang-format on
+
+// Pipeline::restoreHistory() replayed the flash log, once NTP had synced
+void onHistoryRestored(const Restore::Result &restored) {
+	CO2->updatePeak();
+	Boot::mark("history_restored");
+	LOG0("Restored %lu samples from flash (%lu torn pages skipped)\n", (unsigned long)restored.records, (unsigned long)sampleLog.tornPages);
+}
+
+void setupWeb() {
+	LOG0("Starting Air Quality Sensor Server Hub...\n\n");
+	Boot::mark("wifi_connected");
+
+	server.on("/metrics", HTTP_GET, []() {
+		server.setContentLength(CONTENT_LENGTH_UNKNOWN); // chunked, each buffer flush is one chunk
+		server.send(200, Metrics::CONTENT_TYPE, "");
+		ScrapeWindow::rotate(); // the homekit_reading families cover the readings since the previous scrape
+		Metrics::render(metricFamilies, httpWriter);
+		server.sendContent("");
+	});
+
+	// /history?channel=co2&from=<unix seconds>&res=<seconds>[&format=bin]
+	// Streams time,min,max,mean as CSV, or the SeriesCodec binary format (decode with tools/history2csv.py)
+	server.on("/history", HTTP_GET, []() {
+		History::Channel channel;
+		if (!History::Store::channel(server.arg("channel").c_str(), channel)) {
+			server.send(400, "text/plain", "unknown channel");
+			return;
+		}
+
+		uint32_t from = strtoul(server.arg("from").c_str(), nullptr, 10);
+		uint32_t res  = strtoul(server.arg("res").c_str(), nullptr, 10);
+
+		if (server.arg("format") == "bin") {
+			const History::Store &history = Pipeline::history;
+			uint32_t			  period  = history.period(res);
+			bool				  minMax  = period > history.series[channel].raw.period; // the raw tier holds single samples
+			server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+			server.send(200, "application/octet-stream", "");
+			SeriesCodec::encode(httpWriter, channel, period, minMax, [&](auto fn) { history.forEach(channel, from, res, fn); });
+			httpWriter.flush();
+			server.sendContent("");
+			return;
+		}
+
+		server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+		server.send(200, "text/csv", "");
+		httpWriter.write(clockSynced() ? "time,min,max,mean\n" : "uptime,min,max,mean\n");
+
+		float scale = History::CHANNELS[channel].scale;
+		Pipeline::history.forEach(channel, from, res, [&](uint32_t t, const History::Bucket &b) {
+			httpWriter.printf("%lu,%g,%g,%g\n", (unsigned long)t, b.min / scale, b.max / scale, b.mean / scale);
+		});
+		httpWriter.flush();
+		server.sendContent("");
+	});
+
+	// /debug/loop[?budget=<ms>], latency summary and the last stalls, optionally sets the stall budget
+	server.on("/debug/loop", HTTP_GET, []() {
+		if (server.hasArg("budget")) {
+			LoopStats::budgetUs = strtoul(server.arg("budget").c_str(), nullptr, 10) * 1000;
 		}
+		server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+		server.send(200, "text/plain", "");
+		LoopStats::report(httpWriter);
+		httpWriter.flush();
+		server.sendContent("");
+	});
+
+	// Raw sensor capture, replay it on the host with the native build: program --replay capture.bin
+	server.on("/capture/start", HTTP_GET, []() {
+		capture.start(systemClock.millis());
+		server.send(200, "text/plain", "capture started\n");
+	});
+
+	server.on("/capture/stop", HTTP_GET, []() {
+		capture.stop();
+		char line[96];
+		snprintf(line, sizeof(line), "capture stopped: %lu records, %lu bytes, %lu evicted\n", (unsigned long)capture.records, (unsigned long)capture.used, (unsigned long)capture.evicted);
+		server.send(200, "text/plain", line);
+	});
+
+	server.on("/capture", HTTP_GET, []() {
+		capture.stop(); // the acquisition task would append to the ring while it's sent
+		server.sendHeader("Content-Disposition", "attachment; filename=capture.bin");
+		server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+		server.send(200, "application/octet-stream", "");
+		capture.write(httpWriter);
+		httpWriter.flush();
+		server.sendContent("");
+	});
+
+	// Server-Sent Events, one event per filtered sample (see Events.hpp), the socket is kept and fed from loop()
+	server.on("/events", HTTP_GET, []() {
+		events.accept({server.client()}, server.header("Last-Event-ID").c_str(), millis());
+	});
+
+	server.on("/debug/boot", HTTP_GET, []() {
+		server.send(200, "text/plain", Boot::report());
+	});
+
+	// loop() jobs, then the acquisition task's, whose stats it may be updating meanwhile
+	server.on("/debug/scheduler", HTTP_GET, []() {
+		char   line[128];
+		String content;
+		auto   list = [&](auto &jobs) {
+			  for (uint8_t i = 0; i < jobs.count; i++) {
+				  auto &job = jobs.jobs[i];
+				  snprintf(line, sizeof(line), "%-8s period=%" PRIu32 " runs=%" PRIu32 " skipped=%" PRIu32 " last_due=%" PRIu32 " last_run=%" PRIu32 " late=%" PRIu32 " max_late=%" PRIu32 "\n",
+						   job.name, job.period, job.runs, job.skipped, job.lastDue, job.lastRun, job.lastLate, job.maxLate);
+				  content += line;
+			  }
+		};
+		list(scheduler);
+		list(Pipeline::acquisition);
+		server.send(200, "text/plain", content);
 	});
 
 	server.on("/reboot", HTTP_GET, []() {
@@ -206,10 +571,71 @@ void setupWeb() {
 		content += "<meta http-equiv = \"refresh\" content = \"10; url = /\" />";
 		server.send(200, "text/html", content);
 
+		sampleLog.flush(); // keep the samples batched in RAM
 		ESP.restart();
 	});
 
+	const char *headers[] = {"Last-Event-ID"};
+	server.collectHeaders(headers, 1);
+
+	// /config lists the runtime settings, POST /config?key=value&... changes and stores them
+	server.on("/config", HTTP_GET, []() {
+		server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+		server.send(200, "text/plain", "");
+		Settings::report(httpWriter);
+		httpWriter.flush();
+		server.sendContent("");
+	});
+
+	server.on("/config", HTTP_POST, []() {
+		for (int i = 0; i < server.args(); i++) {
+			const Settings::Field *f = Settings::find(server.argName(i).c_str());
+			if (!f) continue; // the POST body shows up as "plain"
+			if (!Settings::set(*f, server.arg(i).c_str()) || !Settings::save(*f)) {
+				server.send(400, "text/plain", "bad value for " + server.argName(i));
+				return;
+			}
+		}
+		server.send(200, "text/plain", "ok");
+	});
+
+	// MH-Z19B calibration, one of zero (in 400 ppm fresh air for 20 minutes), span=<ppm> or abc=on|off
+	server.on("/co2/calibrate", HTTP_POST, []() {
+		uint32_t calibration = 0;
+		if (server.hasArg("zero")) {
+			calibration = MHZ19B::CMD_ZERO << 16;
+		} else if (server.hasArg("span")) {
+			uint32_t ppm = strtoul(server.arg("span").c_str(), nullptr, 10);
+			if (ppm >= 1000 && ppm <= 5000) calibration = MHZ19B::CMD_SPAN << 16 | ppm;
+		} else if (server.arg("abc") == "on" || server.arg("abc") == "off") {
+			calibration = MHZ19B::CMD_ABC << 16 | (server.arg("abc") == "on");
+		}
+		if (!calibration || !Pipeline::mhzReady) {
+			server.send(400, "text/plain", Pipeline::mhzReady ? "expected zero, span=<1000..5000> or abc=on|off" : "sensor not ready");
+			return;
+		}
+		Pipeline::mhzCalibration = calibration;
+		server.send(200, "text/plain", "ok");
+	});
+
+	// Off the loop task, a slow or unreachable server must not hold up HomeKit
+	xTaskCreatePinnedToCore(pushTask, "push", 8192, nullptr, 1, nullptr, 0);
+	xTaskCreatePinnedToCore(updateTask, "update", 8192, nullptr, 1, nullptr, 0); // a TLS handshake takes seconds
+
 	ElegantOTA.begin(&server); // Start ElegantOTA
 	server.begin();
 	Serial.println("HTTP server started");
+	Boot::mark("web_server");
 } // setupWeb
+
+// Push exporter, idles while no URL is configured
+void pushTask(void *) {
+	for (;;) {
+		uint32_t waitMs = 1000;
+		if (Settings::pushUrl[0]) {
+			waitMs = pusher.step(Settings::pushFlushSecs * 1000, Settings::pushBatchLines);
+			if (waitMs > 1000) waitMs = 1000; // picks up /config changes and new samples within a second
+		}
+		vTaskDelay(pdMS_TO_TICKS(waitMs));
+	}
+}
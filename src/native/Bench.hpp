@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+/**
+ * Minimal micro-benchmark harness for the host build. Each case is run in
+ * growing batches until a batch takes at least MIN_TIME, then timed over
+ * that batch size. Heap allocations are counted by the operator new
+ * override in main.cpp, the firmware's hot paths are expected to stay at 0.
+ */
+namespace Bench {
+
+	constexpr static const double MIN_TIME = 0.2; // seconds per measured batch
+
+	inline uint64_t allocations = 0;
+
+	struct Result {
+		const char *name;
+		uint64_t	iterations;
+		double		nsPerOp;
+		double		allocsPerOp;
+	};
+
+	inline std::vector<Result> results;
+
+	// Keeps the compiler from optimising a result away
+	template <typename T>
+	inline void keep(T &&value) {
+		asm volatile("" : : "g"(&value) : "memory");
+	}
+
+	template <typename Fn>
+	void run(const char *name, Fn fn) {
+		using Clock = std::chrono::steady_clock;
+
+		for (uint64_t n = 1;; n *= 2) {
+			uint64_t allocs = allocations;
+			auto	 start	= Clock::now();
+			for (uint64_t i = 0; i < n; i++) fn(i);
+			double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+			if (elapsed >= MIN_TIME) {
+				results.push_back({name, n, elapsed * 1e9 / n, (double)(allocations - allocs) / n});
+				const Result &r = results.back();
+				printf("%-28s %12llu %12.1f ns/op %8.2f allocs/op\n", r.name, (unsigned long long)r.iterations, r.nsPerOp, r.allocsPerOp);
+				return;
+			}
+		}
+	}
+
+	// {"firmware": ..., "compiler": ..., "benchmarks": [{"name", "iterations", "ns_per_op", "allocs_per_op"}]}
+	inline bool writeJson(const char *path, const char *firmware) {
+		FILE *f = fopen(path, "w");
+		if (!f) return false;
+		fprintf(f, "{\n  \"firmware\": \"%s\",\n  \"compiler\": \"%s\",\n  \"benchmarks\": [\n", firmware, __VERSION__);
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result &r = results[i];
+			fprintf(f, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f}%s\n",
+					r.name, (unsigned long long)r.iterations, r.nsPerOp, r.allocsPerOp, i + 1 < results.size() ? "," : "");
+		}
+		fprintf(f, "  ]\n}\n");
+		return fclose(f) == 0;
+	}
+} // namespace Bench
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "Animation.hpp"
+#include "Bench.hpp"
+#include "Capture.hpp"
+#include "DeltaPatch.hpp"
+#include "Events.hpp"
+#include "Filters.hpp"
+#include "History.hpp"
+#include "LoopStats.hpp"
+#include "MHZ19B.hpp"
+#include "Notify.hpp"
+#include "Metrics.hpp"
+#include "PM1006.hpp"
+#include "Push.hpp"
+#include "Replay.hpp"
+#include "SampleLog.hpp"
+#include "ScrapeWindow.hpp"
+#include "SerialCom.hpp"
+#include "SeriesCodec.hpp"
+#include "Sha256.hpp"
+#include "Si7021.hpp"
+#include "Sim.hpp"
+#include "SlidingWindow.hpp"
+#include "SpscRing.hpp"
+#include "Types.hpp"
+#include "UpdateCheck.hpp"
+#include "Updater.hpp"
+
+// Hot paths of the firmware, run by --bench
+namespace Benchmarks {
+
+	// A synthetic /metrics, one family of each shape main.cpp's metricFamilies has: single values, a skipped one,
+	// the per-channel collectors, labelled counters and a histogram. What a render costs per family, not a copy
+	// of the device's table
+	// clang-format off
+	const Metrics::Family families[] = {
+		{"bench_gauge", Metrics::GAUGE, "A single value", [](double &v) { v = 812; return true; }, nullptr},
+		{"bench_skipped", Metrics::GAUGE, "A value that isn't there yet", [](double &) { return false; }, nullptr},
+		{"bench_counter", Metrics::COUNTER, "A single count", [](double &v) { v = 43200; return true; }, nullptr},
+		{"bench_reading", Metrics::SUMMARY, "Per channel summary", nullptr, ScrapeWindow::collectSummary},
+		{"bench_rolling_mean", Metrics::GAUGE, "Per channel and window", nullptr, SlidingWindow::collectMean},
+		{"bench_failures", Metrics::COUNTER, "A count per reason", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+			w.header(f);
+			for (const char *reason : Updater::FAILURE_NAMES) {
+				char labels[32];
+				snprintf(labels, sizeof(labels), "reason=\"%s\"", reason);
+				w.sample(f, "_total", labels, 0);
+			} }},
+		{"bench_notifications", Metrics::COUNTER, "A count per characteristic and outcome", nullptr, Notify::collect},
+		{"bench_latency_seconds", Metrics::HISTOGRAM, "Buckets per subsystem", nullptr, LoopStats::collectLatency},
+	};
+	// clang-format on
+
+	void pm1006Frame(uint8_t (&frame)[PM1006::FRAME_LEN], uint16_t pm25) {
+		memset(frame, 0, sizeof(frame));
+		memcpy(frame, PM1006::HEADER, sizeof(PM1006::HEADER));
+		frame[5]	= pm25 >> 8;
+		frame[6]	= pm25 & 0xFF;
+		uint8_t sum = 0;
+		for (uint8_t i = 0; i < PM1006::FRAME_LEN - 1; i++) sum += frame[i];
+		frame[PM1006::FRAME_LEN - 1] = -sum;
+	}
+
+	// Good frames with the faults of test_pm1006 at random between them: truncated frames, stray header bytes,
+	// bad checksums and line noise
+	std::vector<uint8_t> faultyPm1006Stream() {
+		Sim::Random			 rng(7);
+		std::vector<uint8_t> stream;
+		uint8_t				 frame[PM1006::FRAME_LEN];
+		for (uint16_t n = 0; n < 2000; n++) {
+			pm1006Frame(frame, rng.next() % 1000);
+			switch (rng.next() % 5) {
+			case 0:
+				stream.insert(stream.end(), frame, frame + 1 + rng.next() % (PM1006::FRAME_LEN - 1));
+				break;
+			case 1:
+				stream.push_back(0x16);
+				break;
+			case 2:
+				frame[PM1006::FRAME_LEN - 1] ^= 1 + rng.next() % 255;
+				stream.insert(stream.end(), frame, frame + PM1006::FRAME_LEN);
+				break;
+			case 3:
+				for (uint8_t i = rng.next() % 8; i; i--) stream.push_back(0x17 + rng.next() % 0xE0);
+				break;
+			}
+			pm1006Frame(frame, rng.next() % 1000);
+			stream.insert(stream.end(), frame, frame + PM1006::FRAME_LEN);
+		}
+		return stream;
+	}
+
+	// An hour of the simulated PM1006 read through a capture tap, the way /capture records the device
+	void recordPm1006(Replay::Capture &capture) {
+		struct Bytes {
+			std::vector<uint8_t> data;
+			void				 write(const char *p, size_t len) { data.insert(data.end(), p, p + len); }
+		};
+		static uint8_t	   buf[1 << 16];
+		Sim::Clock		   clock;
+		Sim::Uart		   uart(clock);
+		Sim::World		   world;
+		Sim::Random		   rng(1);
+		Sim::PM1006Device  device(uart, world, rng);
+		Capture::Recorder  recorder(buf, sizeof(buf));
+		Capture::StreamTap tap(uart, recorder, clock, Capture::PM1006_RX);
+		recorder.start(0);
+		for (clock.now = 0; clock.now < 3600000000ULL; clock.now += 100000) { // the acquisition task drains the UART often enough
+			device.tick(clock.now);
+			while (tap.read() >= 0) {}
+		}
+		Bytes out;
+		recorder.write(out);
+		capture.parse(out.data.data(), out.data.size());
+	}
+
+	// A frame's worth of the stream per op, over and over, so the decode cases compare
+	void decodePm1006(const char *name, const std::vector<uint8_t> &stream) {
+		PM1006::FrameDecoder decoder;
+		size_t				 pos	= 0;
+		uint32_t			 frames = 0;
+		Bench::run(name, [&](uint64_t) {
+			for (uint8_t n = 0; n < PM1006::FRAME_LEN; n++) {
+				frames += decoder.push(stream[pos]);
+				if (++pos == stream.size()) pos = 0;
+			}
+			Bench::keep(frames);
+		});
+	}
+
+	// capturePath is a capture from /capture to decode the PM1006 bytes of, the simulated sensor's without one.
+	// false if it can't be read
+	bool run(const char *capturePath = nullptr) {
+		Replay::Capture capture;
+		if (!capturePath) recordPm1006(capture);
+		else if (!capture.load(capturePath)) return false;
+		std::vector<uint8_t> captured;
+		for (const Replay::Event &e : capture.events[Capture::PM1006_RX]) captured.insert(captured.end(), e.data.begin(), e.data.end());
+
+		uint8_t frame[PM1006::FRAME_LEN];
+		pm1006Frame(frame, 35);
+
+		Bench::run("pm1006_decode_frame", [&](uint64_t) {
+			static PM1006::FrameDecoder decoder;
+			bool						done = false;
+			for (uint8_t b : frame) done = decoder.push(b);
+			Bench::keep(done);
+		});
+
+		decodePm1006("pm1006_decode_faulty", faultyPm1006Stream());
+		if (captured.empty()) printf("capture has no PM1006 bytes, pm1006_decode_capture skipped\n");
+		else decodePm1006("pm1006_decode_capture", captured);
+
+		Bench::run("pm1006_parse_state", [&](uint64_t) {
+			static PM1006::FrameDecoder	 decoder;
+			static particleSensorState_t state;
+			for (uint8_t b : frame) decoder.push(b);
+			SerialCom::parseState(state, decoder);
+			Bench::keep(state.avgPM25);
+		});
+
+		Bench::run("filter_pm25_frames", [](uint64_t i) {
+			static Filters::Pm25Frames filter;
+			int32_t					   pm25 = filter.pushFixed(i % 64 == 0 ? 900 : 30 + i % 5); // Hampel replaces the spikes
+			Bench::keep(pm25);
+		});
+
+		Bench::run("filter_co2", [](uint64_t i) {
+			static Filters::Co2 filter;
+			float				co2 = filter.push(400 + i % 600);
+			Bench::keep(co2);
+		});
+
+		Bench::run("filter_temperature", [](uint64_t i) {
+			static Filters::Temperature filter;
+			float						temperature = filter.push(20 + (i % 300) * 0.01f);
+			Bench::keep(temperature);
+		});
+
+		Bench::run("notify_offer", [](uint64_t i) {
+			static Notify::Gate gate(Notify::POLICIES[Notify::CO2]);
+			bool				send = gate.offer(400 + i % 64, i * 10000);
+			Bench::keep(send);
+		});
+
+		Bench::run("air_quality_level", [](uint64_t i) {
+			uint8_t level = PM1006::airQuality(i % 200);
+			Bench::keep(level);
+		});
+
+		Bench::run("si7021_convert", [](uint64_t i) {
+			float humidity	  = Si7021::toHumidity(i & 0xFFFC);
+			float temperature = Si7021::toTemperature(i & 0xFFFC);
+			Bench::keep(humidity);
+			Bench::keep(temperature);
+		});
+
+		Bench::run("mhz19b_checksum", [](uint64_t i) {
+			uint8_t reply[MHZ19B::FRAME_LEN] = {0xFF, 0x86, (uint8_t)(i >> 8), (uint8_t)i, 0x3F, 0, 0, 0, 0};
+			uint8_t sum						 = MHZ19B::checksum(reply);
+			Bench::keep(sum);
+		});
+
+		// A reading every 10 s on each channel, into its hour, day and week windows
+		static uint32_t windowTime = 0;
+		SlidingWindow::clock	   = []() { return windowTime; };
+		Bench::run("sliding_window_add", [](uint64_t i) {
+			windowTime = i * 2;
+			SlidingWindow::add((History::Channel)(i % History::CHANNEL_COUNT), windowTime, 400 + (i * 7919) % 800);
+		});
+
+		Bench::run("scrape_window_add", [](uint64_t i) {
+			ScrapeWindow::add((History::Channel)(i % History::CHANNEL_COUNT), 400 + i % 800);
+		});
+
+		// One reading handed from the acquisition task to loop() per op
+		Bench::run("readings_ring", [](uint64_t i) {
+			static SpscRing<sensorReading_t, 64> ring;
+			sensorReading_t						 reading;
+			ring.push({(History::Channel)(i % History::CHANNEL_COUNT), 400.0f + i % 800, 400.0f}, i);
+			ring.pop(reading, i);
+			Bench::keep(reading.raw);
+		});
+
+		// One sample published and streamed to three subscribers per op
+		Bench::run("events_publish_pump", [](uint64_t i) {
+			struct Sink {
+				int	 send(const char *, size_t len) { return len; }
+				void close() {}
+			};
+			static Events::Hub<Sink> hub;
+			if (i == 0)
+				for (uint8_t s = 0; s < 3; s++) hub.subscribe({}, 0, 0);
+			hub.publish(History::CO2, 400 + i % 800);
+			hub.pump(i);
+		});
+
+		// A full batch queued and encoded, the request itself costs nothing here
+		Bench::run("push_batch", [](uint64_t i) {
+			struct Server {
+				int post(const char *, size_t len) { return len ? 204 : 400; }
+			};
+			static Server								server;
+			static Sim::Clock							clock;
+			static Push::Exporter<Server, Push::MAX_LINES> exporter(server, clock);
+			for (uint8_t n = 0; n < Push::MAX_LINES; n++) exporter.add(1700000000 + i, (History::Channel)(n % History::CHANNEL_COUNT), 21.37f);
+			uint32_t wait = exporter.step(60000, Push::MAX_LINES);
+			Bench::keep(wait);
+		});
+
+		// Verifying an image costs one of these per flash sector
+		Bench::run("sha256_sector", [](uint64_t i) {
+			static uint8_t sector[Updater::SECTOR];
+			static Sha256  sha;
+			sector[0] = i;
+			sha.update(sector, sizeof(sector));
+			Bench::keep(sha.h[0]);
+		});
+
+		// A sector of the new image copied from the old one, what most of a delta is
+		Bench::run("delta_copy_sector", [](uint64_t i) {
+			struct Source {
+				bool read(uint32_t, void *buf, size_t len) {
+					memset(buf, 0x5A, len);
+					return true;
+				}
+			};
+			struct Out {
+				uint32_t n = 0;
+				bool	 emit(const uint8_t *, size_t len) {
+					n += len;
+					return true;
+				}
+				bool	 readBack(uint32_t, uint8_t *, size_t) { return false; }
+				uint32_t produced() const { return n; }
+			};
+			static Source					  source;
+			static DeltaPatch::Decoder<Source> decoder;
+			static const uint8_t			  op[] = {DeltaPatch::COPY_OLD, 0x80, 0x20, 0x00}; // 4096 bytes from 0
+			static uint8_t					  head[DeltaPatch::HEADER_SIZE];
+			DeltaPatch::Header				  expected = {Updater::SECTOR, {}, Updater::SECTOR, {}};
+			Out								  out;
+			memcpy(head, DeltaPatch::MAGIC, 4);
+			head[5] = head[41] = Updater::SECTOR >> 8;
+			decoder.begin(source, expected);
+			decoder.feed(head, sizeof(head), out);
+			decoder.feed(op, sizeof(op), out);
+			Bench::keep(out.n + i);
+		});
+
+		Bench::run("metrics_render_synthetic", [](uint64_t) {
+			static size_t	sent = 0;
+			static char		buf[512];
+			Metrics::Writer writer(buf, sizeof(buf), [](const char *, size_t len) { sent += len; });
+			Metrics::render(families, writer);
+			Bench::keep(sent);
+		});
+
+		// A recorded week of CO2 from /history, at the 15 min tier (672 rows with min/max) in both formats
+		static History::Store week;
+		Sim::recordWeek(week, 1700000000);
+		struct Counter {
+			size_t bytes = 0;
+			void   write(const char *, size_t len) { bytes += len; }
+		};
+		auto weekRows = [](auto fn) { week.forEach(History::CO2, 0, 900, fn); };
+		auto toCsv	  = [&](Counter &out) {
+			weekRows([&](uint32_t t, const History::Bucket &b) {
+				char line[48];
+				out.write(line, snprintf(line, sizeof(line), "%lu,%g,%g,%g\n", (unsigned long)t, (float)b.min, (float)b.max, (float)b.mean));
+			});
+		};
+		Counter codecSize, csvSize;
+		SeriesCodec::encode(codecSize, History::CO2, 900, true, weekRows);
+		toCsv(csvSize);
+		printf("series week co2: codec %zu bytes, csv %zu bytes\n", codecSize.bytes, csvSize.bytes);
+
+		Bench::run("series_codec_week", [&](uint64_t) {
+			Counter out;
+			SeriesCodec::encode(out, History::CO2, 900, true, weekRows);
+			Bench::keep(out.bytes);
+		});
+
+		Bench::run("series_csv_week", [&](uint64_t) {
+			Counter out;
+			toCsv(out);
+			Bench::keep(out.bytes);
+		});
+
+		Bench::run("history_ingest", [](uint64_t i) {
+			static History::Store history;
+			history.ingest((History::Channel)(i % History::CHANNEL_COUNT), 1700000000 + i * 2, 400 + i % 800);
+		});
+
+		Bench::run("sample_log_append", [](uint64_t i) {
+			static Sim::Flash				  flash(0x160000);
+			static SampleLog::Log<Sim::Flash> log(flash);
+			if (i == 0) log.recover();
+			log.append(i % History::CHANNEL_COUNT, 1700000000 + i * 2, i);
+		});
+
+		Bench::run("capture_uart_byte", [](uint64_t i) {
+			static uint8_t			 buf[32768];
+			static Capture::Recorder recorder(buf, sizeof(buf));
+			if (i == 0) recorder.start(0);
+			uint8_t b = i;
+			recorder.add(Capture::PM1006_RX, i / 8, &b, 1);
+		});
+
+		Bench::run("animator_tick", [](uint64_t i) {
+			static Animation::Animator animator([](Animation::Color c) { Bench::keep(c); });
+			if (i % 1000 == 0) animator.fadeTo(i % 2000 ? Animation::RED : Animation::GREEN, Animation::CROSSFADE_MS, i);
+			animator.tick(i);
+		});
+		return true;
+	}
+} // namespace Benchmarks
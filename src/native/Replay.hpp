@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Capture.hpp"
+#include "Hal.hpp"
+#include "Sim.hpp"
+
+/**
+ * Hal backends that play a capture (Capture.hpp) back to the real drivers.
+ * Everything is keyed on the capture's timestamps (device uptime) against
+ * Sim::Clock, so the firmware sees the bytes, I2C words and ADC samples at
+ * the moment it read them on the device and the simulation loop can run
+ * as fast as it likes.
+ */
+namespace Replay {
+
+	struct Event {
+		uint32_t			 ms; // device uptime
+		std::vector<uint8_t> data;
+	};
+
+	struct Capture {
+		std::vector<Event> events[::Capture::SOURCE_COUNT];
+		uint32_t		   startMs	  = 0;
+		uint32_t		   durationMs = 0;
+		uint32_t		   records	  = 0;
+
+		bool load(const char *path) {
+			FILE *f = fopen(path, "rb");
+			if (!f) return false;
+			std::vector<uint8_t> file;
+			uint8_t				 chunk[4096];
+			size_t				 n;
+			while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) file.insert(file.end(), chunk, chunk + n);
+			fclose(f);
+			return parse(file.data(), file.size());
+		}
+
+		// A capture in the download format, false if it is malformed
+		bool parse(const uint8_t *data, size_t len) {
+			::Capture::Reader reader(data, len);
+			::Capture::Record r;
+			while (reader.next(r)) {
+				if (records++ == 0) startMs = r.ms;
+				events[r.source].push_back({r.ms, std::vector<uint8_t>(r.data, r.data + r.len)});
+				durationMs = r.ms - startMs;
+			}
+			return reader.ok;
+		}
+	};
+
+	// Bytes become readable at the time they were read on the device, writes go nowhere
+	struct Uart : Hal::ByteStream {
+		Sim::Clock				 &clock;
+		const std::vector<Event> &events;
+		size_t					  next = 0, offset = 0;
+
+		Uart(Sim::Clock &clock, const std::vector<Event> &events) : clock(clock), events(events) {}
+
+		int available() override {
+			int n = 0;
+			for (size_t i = next; i < events.size() && events[i].ms <= clock.millis(); i++) n += events[i].data.size();
+			return n - offset;
+		}
+
+		int read() override {
+			while (next < events.size() && events[next].ms <= clock.millis()) {
+				if (offset < events[next].data.size()) return events[next].data[offset++];
+				next++, offset = 0;
+			}
+			return -1;
+		}
+
+		size_t write(const uint8_t *, size_t len) override {
+			return len;
+		}
+	};
+
+	/**
+	 * Reads return the next recorded result once its time has come (within
+	 * LEAD_MS, the simulation loop polls less often than the device did) and
+	 * NACK until then. Recorded NACKs only say when the device happened to
+	 * poll, they are skipped. Writes are always ACKed, the capture only holds
+	 * what the device read.
+	 */
+	struct I2C : Hal::I2CBus {
+		constexpr static const uint32_t LEAD_MS = 50;
+
+		Sim::Clock				 &clock;
+		const std::vector<Event> &events;
+		size_t					  next = 0;
+
+		I2C(Sim::Clock &clock, const std::vector<Event> &events) : clock(clock), events(events) {}
+
+		bool write(uint8_t, const uint8_t *, uint8_t) override {
+			return true;
+		}
+
+		uint8_t read(uint8_t addr, uint8_t *data, uint8_t len) override {
+			uint32_t now = clock.millis();
+			while (next < events.size() && events[next].ms <= now && events[next].data.size() <= 1) next++;
+			if (next >= events.size() || events[next].ms > now + LEAD_MS) return 0;
+			const Event &e = events[next++];
+			if (e.data[0] != addr) return 0;
+			uint8_t n = e.data.size() - 1 < len ? e.data.size() - 1 : len;
+			memcpy(data, e.data.data() + 1, n);
+			return n;
+		}
+	};
+
+	// Latest sample recorded at or before now
+	struct Adc : Hal::Adc {
+		Sim::Clock				 &clock;
+		const std::vector<Event> &events;
+		size_t					  next = 0;
+		uint16_t				  last = 0;
+
+		Adc(Sim::Clock &clock, const std::vector<Event> &events) : clock(clock), events(events) {}
+
+		uint16_t read() override {
+			while (next < events.size() && events[next].ms <= clock.millis()) {
+				const Event &e = events[next++];
+				if (e.data.size() == 2) last = e.data[0] | (e.data[1] << 8);
+			}
+			return last;
+		}
+	};
+} // namespace Replay
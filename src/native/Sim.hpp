@@ -0,0 +1,430 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Hal.hpp"
+#include "History.hpp"
+#include "PM1006.hpp"
+#include "SampleLog.hpp"
+
+/**
+ * Simulated devices for the host build. Everything runs off SimClock, which
+ * the simulation loop advances in fixed steps, so a day of device time
+ * takes as long as the CPU needs to run the pipeline over it. Sensor values
+ * follow a deterministic daily pattern (World) plus seeded noise, faults are
+ * injected at a fixed rate and counted so the run can check the drivers
+ * caught every one of them.
+ */
+namespace Sim {
+
+	struct Clock : Hal::Clock {
+		uint64_t now = 0;
+
+		uint64_t micros() override {
+			return now;
+		}
+	};
+
+	// xorshift32, same generator on every platform so runs are reproducible
+	struct Random {
+		uint32_t state;
+
+		Random(uint32_t seed) : state(seed ? seed : 1) {}
+
+		uint32_t next() {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		// Uniform in [-1, 1)
+		float noise() {
+			return (next() >> 8) / 8388608.0f - 1.0f;
+		}
+
+		bool chance(uint32_t oneIn) {
+			return next() % oneIn == 0;
+		}
+	};
+
+	// Indoor conditions over a day: CO2 builds up while the room is used, cooking raises PM
+	struct World {
+		uint32_t startOfDay = 6 * 3600; // device boots at 06:00
+
+		float hour(uint64_t us) const {
+			return fmodf((startOfDay + us / 1000000) / 3600.0f, 24.0f);
+		}
+
+		static float bump(float h, float center, float width) {
+			float d = (h - center) / width;
+			return expf(-d * d);
+		}
+
+		float co2(uint64_t us) const {
+			float h = hour(us);
+			return 430 + 500 * bump(h, 10, 2) + 900 * bump(h, 20, 2.5f) + 300 * bump(h, 2, 3); // office hours, evening, night
+		}
+
+		float pm25(uint64_t us) const {
+			float h = hour(us);
+			return 6 + 40 * bump(h, 8, 0.4f) + 120 * bump(h, 19, 0.5f); // breakfast, dinner
+		}
+
+		float temperature(uint64_t us) const {
+			return 21 + 2 * sinf((hour(us) - 9) * (float)M_PI / 12);
+		}
+
+		float humidity(uint64_t us) const {
+			return 45 + 8 * sinf((hour(us) - 3) * (float)M_PI / 12);
+		}
+
+		float light(uint64_t us) const {
+			float h = hour(us);
+			return h > 7 && h < 19 ? 3500 * sinf((h - 7) * (float)M_PI / 12) : 40;
+		}
+	};
+
+	// A week of World plus sensor noise in history, every channel sampled every 10 s like the firmware does
+	inline void recordWeek(History::Store &history, uint32_t start, uint32_t seed = 1) {
+		World  world;
+		Random rng(seed);
+		for (uint32_t s = 0; s < 7 * 86400; s += 10) {
+			uint64_t us = (uint64_t)s * 1000000;
+			history.ingest(History::CO2, start + s, world.co2(us) + 10 * rng.noise());
+			history.ingest(History::PM25, start + s, world.pm25(us) + 2 * rng.noise());
+			history.ingest(History::TEMPERATURE, start + s, world.temperature(us) + 0.05f * rng.noise());
+			history.ingest(History::HUMIDITY, start + s, world.humidity(us) + 0.2f * rng.noise());
+			history.ingest(History::LIGHT, start + s, world.light(us) + 20 * rng.noise());
+		}
+	}
+
+	// Peer on the other end of a Uart, sees everything the firmware writes
+	struct UartPeer {
+		virtual void received(const uint8_t *data, size_t len) = 0;
+	};
+
+	/**
+	 * 9600 8N1 line with the receive buffer of the UART driver. Bytes sent by
+	 * the peer arrive one character time apart, bytes that arrive while the
+	 * buffer is full are lost, like an unserviced SoftwareSerial.
+	 */
+	struct Uart : Hal::ByteStream {
+		constexpr static const uint32_t CHAR_US = 1042; // 10 bits at 9600 baud
+		constexpr static const uint16_t BUFFER	= 64;	// SoftwareSerial default
+
+		struct InFlight {
+			uint64_t at;
+			uint8_t	 b;
+		};
+
+		Clock				 &clock;
+		UartPeer			 *peer = nullptr;
+		std::vector<InFlight> wire; // sent by the peer, ordered by arrival
+		size_t				  wireHead = 0;
+		uint8_t				  rx[BUFFER];
+		uint16_t			  rxHead = 0, rxCount = 0;
+		uint64_t			  lineFreeAt = 0;
+		uint32_t			  overruns	 = 0;
+
+		Uart(Clock &clock) : clock(clock) {}
+
+		// Peer side: queue bytes on the line, starting at at (or when the previous ones are out)
+		void send(uint64_t at, const uint8_t *data, size_t len) {
+			if (at < lineFreeAt) at = lineFreeAt;
+			for (size_t i = 0; i < len; i++) wire.push_back({at + (i + 1) * CHAR_US, data[i]});
+			lineFreeAt = at + len * CHAR_US;
+		}
+
+		int available() override {
+			deliver();
+			return rxCount;
+		}
+
+		int read() override {
+			deliver();
+			if (!rxCount) return -1;
+			uint8_t b = rx[rxHead];
+			rxHead	  = (rxHead + 1) % BUFFER;
+			rxCount--;
+			return b;
+		}
+
+		size_t write(const uint8_t *data, size_t len) override {
+			if (peer) peer->received(data, len);
+			return len;
+		}
+
+	private:
+		void deliver() {
+			while (wireHead < wire.size() && wire[wireHead].at <= clock.now) {
+				if (rxCount == BUFFER) overruns++;
+				else {
+					rx[(rxHead + rxCount) % BUFFER] = wire[wireHead].b;
+					rxCount++;
+				}
+				wireHead++;
+			}
+			if (wireHead == wire.size()) {
+				wire.clear();
+				wireHead = 0;
+			}
+		}
+	};
+
+	// Cubic PM1006 as driven by the VINDRIKTNING board, one frame every 2 s
+	struct PM1006Device {
+		constexpr static const uint32_t PERIOD_US = 2000000;
+
+		Uart		&uart;
+		const World &world;
+		Random		&random;
+		uint64_t	 nextAt	   = PERIOD_US;
+		uint32_t	 sent	   = 0;
+		uint32_t	 corrupted = 0; // one byte flipped, the decoder must reject these
+
+		PM1006Device(Uart &uart, const World &world, Random &random) : uart(uart), world(world), random(random) {}
+
+		void tick(uint64_t now) {
+			if (now < nextAt) return;
+
+			float	 v	  = world.pm25(now) * (1 + 0.1f * random.noise());
+			uint16_t pm25 = v < 0 ? 0 : (uint16_t)v;
+
+			uint8_t frame[PM1006::FRAME_LEN] = {0x16, 0x11, 0x0B};
+			frame[5]						 = pm25 >> 8;
+			frame[6]						 = pm25 & 0xFF;
+			uint8_t sum						 = 0;
+			for (uint8_t i = 0; i < PM1006::FRAME_LEN - 1; i++) sum += frame[i];
+			frame[PM1006::FRAME_LEN - 1] = -sum;
+
+			if (random.chance(250)) {
+				frame[random.next() % PM1006::FRAME_LEN] ^= 1 << (random.next() % 8);
+				corrupted++;
+			}
+
+			uart.send(now, frame, sizeof(frame));
+			sent++;
+			nextAt += PERIOD_US;
+		}
+	};
+
+	// MH-Z19B answering the 9 byte command protocol, replies to 0x86 after LATENCY_US
+	struct MHZ19BDevice : UartPeer {
+		constexpr static const uint32_t LATENCY_US = 20000;
+
+		Uart		&uart;
+		const World &world;
+		Random		&random;
+		uint8_t		 cmd[9];
+		uint8_t		 idx		 = 0;
+		bool		 abc		 = false;
+		uint16_t	 lastCo2	 = 0; // of the last 0x86 reply, 0x85 reports the same reading
+		uint32_t	 zeroed		 = 0; // zero point calibrations
+		uint16_t	 span		 = 0; // ppm of the last span calibration
+		uint32_t	 commands	 = 0;
+		uint32_t	 badCommands = 0;
+		uint32_t	 corrupted	 = 0; // replies sent with a wrong checksum
+
+		MHZ19BDevice(Uart &uart, const World &world, Random &random) : uart(uart), world(world), random(random) {
+			uart.peer = this;
+		}
+
+		static uint8_t checksum(const uint8_t *frame) {
+			uint8_t sum = 0;
+			for (uint8_t i = 1; i < 8; i++) sum += frame[i];
+			return 0xFF - sum + 1;
+		}
+
+		void received(const uint8_t *data, size_t len) override {
+			for (size_t i = 0; i < len; i++) {
+				if (idx == 0 && data[i] != 0xFF) continue;
+				cmd[idx++] = data[i];
+				if (idx == sizeof(cmd)) {
+					idx = 0;
+					execute();
+				}
+			}
+		}
+
+	private:
+		void execute() {
+			if (cmd[8] != checksum(cmd)) {
+				badCommands++;
+				return;
+			}
+			commands++;
+
+			uint64_t now = uart.clock.now;
+			if (cmd[2] == 0x79) {
+				abc = cmd[3] == 0xA0;
+				return;
+			}
+			if (cmd[2] == 0x87) {
+				zeroed++;
+				return;
+			}
+			if (cmd[2] == 0x88) {
+				span = cmd[3] << 8 | cmd[4];
+				return;
+			}
+			if (cmd[2] == 0x85) {
+				uint8_t reply[9] = {0xFF, 0x85, 0, 0, (uint8_t)(lastCo2 >> 8), (uint8_t)(lastCo2 & 0xFF), 0, 0, 0};
+				reply[8]		 = checksum(reply);
+				uart.send(now + LATENCY_US, reply, sizeof(reply));
+				return;
+			}
+			if (cmd[2] != 0x86) return;
+
+			float	 v	 = world.co2(now) + 15 * random.noise();
+			uint16_t co2 = (uint16_t)v;
+			lastCo2		 = co2;
+			uint8_t	 reply[9] = {0xFF, 0x86, (uint8_t)(co2 >> 8), (uint8_t)(co2 & 0xFF), (uint8_t)(world.temperature(now) + 40), 0, 0, 0, 0};
+			reply[8]		  = checksum(reply);
+			if (random.chance(500)) {
+				reply[8]++;
+				corrupted++;
+			}
+			uart.send(now + LATENCY_US, reply, sizeof(reply));
+		}
+	};
+
+	// Si7021 on the I2C bus, NACKs reads until a no-hold conversion is done
+	struct Si7021Device : Hal::I2CBus {
+		constexpr static const uint32_t CONVERSION_US = 23000;
+
+		enum Pending : uint8_t {
+			NONE,
+			HUMIDITY,
+			TEMPERATURE,
+		};
+
+		Clock		&clock;
+		const World &world;
+		Random		&random;
+		uint8_t		 addr;
+		Pending		 pending  = NONE;
+		uint64_t	 readyAt  = 0;
+		float		 lastTemp = 0; // measured along with the humidity, returned by 0xE0
+		uint32_t	 nacks	  = 0;
+
+		Si7021Device(Clock &clock, const World &world, Random &random, uint8_t addr) : clock(clock), world(world), random(random), addr(addr) {}
+
+		bool write(uint8_t a, const uint8_t *data, uint8_t len) override {
+			if (a != addr) return false;
+			if (len == 0) return true; // address probe
+			if (data[0] == 0xF5) {
+				pending	 = HUMIDITY;
+				readyAt	 = clock.now + CONVERSION_US;
+				lastTemp = world.temperature(clock.now) + 0.05f * random.noise();
+			} else if (data[0] == 0xE0) {
+				pending = TEMPERATURE;
+				readyAt = clock.now;
+			}
+			return true;
+		}
+
+		uint8_t read(uint8_t a, uint8_t *data, uint8_t len) override {
+			if (a != addr || pending == NONE || clock.now < readyAt || len < 2) {
+				nacks++;
+				return 0;
+			}
+
+			uint16_t word;
+			if (pending == HUMIDITY) {
+				float rh = world.humidity(clock.now) + 0.3f * random.noise();
+				word	 = (uint16_t)((rh + 6) * 65536 / 125);
+			} else {
+				word = (uint16_t)((lastTemp + 46.85f) * 65536 / 175.72f);
+			}
+			pending = NONE;
+			data[0] = word >> 8;
+			data[1] = word & 0xFC;
+			return 2;
+		}
+	};
+
+	// 12 bit light sensor on an ADC pin
+	struct LightSensor : Hal::Adc {
+		Clock		&clock;
+		const World &world;
+		Random		&random;
+
+		LightSensor(Clock &clock, const World &world, Random &random) : clock(clock), world(world), random(random) {}
+
+		uint16_t read() override {
+			float v = world.light(clock.now) + 20 * random.noise();
+			return v < 0 ? 0 : v > 4095 ? 4095 : (uint16_t)v;
+		}
+	};
+
+	struct Led : Hal::Led {
+		uint8_t	 r = 0, g = 0, b = 0;
+		uint32_t updates = 0;
+
+		void show(uint8_t red, uint8_t green, uint8_t blue) override {
+			r = red, g = green, b = blue;
+			updates++;
+		}
+	};
+
+	/**
+	 * NOR flash in RAM for SampleLog: erase sets a whole sector to 0xFF,
+	 * program can only clear bits. Programming a byte again before it is
+	 * erased is counted as a violation: a real chip may keep a bit at 0 or
+	 * leave a half programmed cell that reads back differently later.
+	 *
+	 * Power can be cut after a given number of programmed bytes: the write
+	 * in progress stops there and everything fails until it comes back.
+	 */
+	struct Flash {
+		std::vector<uint8_t>  data;
+		std::vector<uint32_t> erases; // per sector
+		uint32_t			  violations = 0;
+		uint32_t			  powerLeft	 = UINT32_MAX; // bytes programmed before the power goes
+
+		// The power goes once bytes more bytes have been programmed
+		void cutPowerAfter(uint32_t bytes) {
+			powerLeft = bytes;
+		}
+
+		void restorePower() {
+			powerLeft = UINT32_MAX;
+		}
+
+		Flash(uint32_t size) : data(size, 0xFF), erases(size / SampleLog::SECTOR, 0) {}
+
+		uint32_t size() const {
+			return data.size();
+		}
+
+		bool read(uint32_t addr, void *dst, size_t len) {
+			if (addr + len > data.size() || !powerLeft) return false;
+			memcpy(dst, &data[addr], len);
+			return true;
+		}
+
+		bool write(uint32_t addr, const void *src, size_t len) {
+			if (addr + len > data.size()) return false;
+			const uint8_t *p = (const uint8_t *)src;
+			for (size_t i = 0; i < len; i++) {
+				if (!powerLeft) return false;
+				if (powerLeft != UINT32_MAX) powerLeft--;
+				if (data[addr + i] != 0xFF) violations++;
+				data[addr + i] &= p[i];
+			}
+			return true;
+		}
+
+		bool erase(uint32_t addr, size_t len) {
+			if (addr % SampleLog::SECTOR || len % SampleLog::SECTOR || addr + len > data.size() || !powerLeft) return false;
+			memset(&data[addr], 0xFF, len);
+			for (uint32_t s = addr / SampleLog::SECTOR; s < (addr + len) / SampleLog::SECTOR; s++) erases[s]++;
+			return true;
+		}
+	};
+} // namespace Sim
@@ -0,0 +1,568 @@
+#pragma once
+
+/*
+ * The host build of the sensor pipeline, shared by the native program
+ * (main.cpp) and the test suites under test/. It runs the firmware's
+ * Pipeline.hpp and UpdateFlow.hpp with the real drivers, decoders,
+ * scheduler, history, flash log and LED animator, wired to the simulated
+ * devices in Sim.hpp instead of the ESP32 peripherals, over accelerated
+ * time; only the board is set up here. With Options::replayPath the
+ * drivers read a capture downloaded from /capture instead (Replay.hpp).
+ *
+ * Everything here is global, like the firmware's, so it is included from
+ * exactly one translation unit.
+ */
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Animation.hpp"
+#include "Capture.hpp"
+#include "DeltaPatch.hpp"
+#include "Events.hpp"
+#include "Hal.hpp"
+#include "History.hpp"
+#include "MHZ19B.hpp"
+#include "Notify.hpp"
+#include "Pipeline.hpp"
+#include "Push.hpp"
+#include "SampleLog.hpp"
+#include "ScrapeWindow.hpp"
+#include "SerialCom.hpp"
+#include "Settings.hpp"
+#include "Replay.hpp"
+#include "Restore.hpp"
+#include "Si7021.hpp"
+#include "Sim.hpp"
+#include "UpdateCheck.hpp"
+#include "UpdateFlow.hpp"
+#include "Updater.hpp"
+#include "Version.hpp"
+
+#define INTERVAL			 10	 // in seconds, same as the firmware
+#define SI7021_ADDR			 0x40
+#define HISTORY_SIZE		 0x160000 // "history" partition in partitions.csv
+
+constexpr static const uint32_t START_TIME		 = 1700000000; // unix time at boot, the simulated clock is always synced
+constexpr static const uint32_t MHZ19B_REPLY_MS = 30;		  // from the read command to the first reply byte, 9 bytes at 9600 baud plus latency
+constexpr static const uint32_t SCRAPE_MS		 = 60000;	  // Prometheus scrape interval
+
+// Simulated board
+Sim::Clock		  simClock;
+Sim::World		  world;
+Sim::Random		  rng(1);
+Sim::Uart		  pmUart(simClock);
+Sim::Uart		  mhzUart(simClock);
+Sim::PM1006Device pmDevice(pmUart, world, rng);
+Sim::MHZ19BDevice mhzDevice(mhzUart, world, rng);
+Sim::Si7021Device siDevice(simClock, world, rng, SI7021_ADDR);
+Sim::LightSensor  lightSensor(simClock, world, rng);
+Sim::Led		  led;
+Sim::Flash		  flash(HISTORY_SIZE);
+
+// Recorded board, --replay
+Replay::Capture replay;
+Replay::Uart	replayPm(simClock, replay.events[Capture::PM1006_RX]);
+Replay::Uart	replayMhz(simClock, replay.events[Capture::MHZ19B_RX]);
+Replay::I2C		replayI2C(simClock, replay.events[Capture::I2C_READ]);
+Replay::Adc		replayLight(simClock, replay.events[Capture::ADC]);
+
+static uint8_t	  captureBuf[1 << 22]; // a day of simulated traffic, the device ring is much smaller
+Capture::Recorder capture(captureBuf, sizeof(captureBuf));
+
+// Firmware side, same objects as DEV_Sensors.hpp, on whichever board was picked
+struct Firmware {
+	Capture::StreamTap pmTap;
+	Capture::StreamTap mhzTap;
+	Capture::I2CTap	   i2cTap;
+	Capture::AdcTap	   lightTap;
+	MHZ19B			   mhz19b;
+	Si7021			   si7021;
+
+	Firmware(Hal::ByteStream &pm, Hal::ByteStream &mhz, Hal::I2CBus &i2c, Hal::Adc &light)
+		: pmTap(pm, capture, simClock, Capture::PM1006_RX),
+		  mhzTap(mhz, capture, simClock, Capture::MHZ19B_RX),
+		  i2cTap(i2c, capture, simClock),
+		  lightTap(light, capture, simClock),
+		  mhz19b(mhzTap, simClock),
+		  si7021(i2cTap, simClock, SI7021_ADDR) {}
+};
+
+Firmware				  *fw;
+SampleLog::Log<Sim::Flash> sampleLog(flash);
+float					   offsets[History::CHANNEL_COUNT] = {}; // the Eve offset characteristics, see Pipeline::offset
+uint32_t				   recorded[History::CHANNEL_COUNT];
+uint32_t				   logged = 0;
+uint32_t				   digest = 2166136261u; // FNV-1a over every recorded value, compares runs
+int16_t					   highest[History::CHANNEL_COUNT];
+ScrapeWindow::Aggregate	   scraped[History::CHANNEL_COUNT]; // every scrape window merged
+uint32_t				   scrapes = 0;
+
+void showPixel(Animation::Color color) {
+	led.show(color.r, color.g, color.b);
+}
+
+Animation::Animator animator(showPixel);
+
+// An /events subscriber, takes whatever the hub sends unless stalled and checks the stream it gets
+struct SseReader {
+	uint64_t	stallFrom = 0, stallTo = 0; // takes nothing in between, in simulated us
+	uint64_t	dropAt	  = UINT64_MAX;		// connection lost, the next send fails
+	std::string line;
+	uint32_t	events = 0, heartbeats = 0, gaps = 0, lastId = 0;
+	bool		gone   = false;
+
+	int take(const char *data, size_t len) {
+		if (gone || simClock.now >= dropAt) return gone = true, -1;
+		if (simClock.now >= stallFrom && simClock.now < stallTo) return 0;
+		for (size_t i = 0; i < len; i++) {
+			line += data[i];
+			if (line.size() < 2 || line.compare(line.size() - 2, 2, "\n\n")) continue;
+			if (line[0] == ':') heartbeats++;
+			else if (!line.compare(0, 4, "id: ")) {
+				uint32_t id = strtoul(line.c_str() + 4, nullptr, 10);
+				if (lastId && id != lastId + 1) gaps++;
+				lastId = id;
+				events++;
+			}
+			line.clear();
+		}
+		return len;
+	}
+};
+
+struct SseClient {
+	SseReader *reader;
+
+	int send(const char *data, size_t len) {
+		return reader->take(data, len);
+	}
+
+	void close() {}
+};
+
+Events::Hub<SseClient> events;
+SseReader			   fastReader, slowReader, resumedReader;
+
+// Stand-in for the InfluxDB write endpoint, unreachable during the outages, checks the lines it gets
+struct PushServer {
+	uint64_t outages[2][2]; // [from, to) in simulated us
+	uint32_t lines = 0, requests = 0, disorder = 0, malformed = 0, lastT = 0;
+
+	int post(const char *body, size_t len) {
+		for (auto &o : outages)
+			if (simClock.now >= o[0] && simClock.now < o[1]) return -1;
+		requests++;
+		for (const char *p = body, *end = body + len; p < end;) {
+			const char	 *nl = (const char *)memchr(p, '\n', end - p);
+			char		  name[16];
+			float		  value;
+			unsigned long t;
+			if (!nl || sscanf(p, "%15[a-z0-9],device=air_sensor,location=home value=%f %lu", name, &value, &t) != 3) {
+				malformed++;
+				break;
+			}
+			if (t < lastT) disorder++;
+			lastT = t;
+			lines++;
+			p = nl + 1;
+		}
+		return 204;
+	}
+};
+
+PushServer					 pushServer;
+Push::Exporter<PushServer> pusher(pushServer, simClock);
+uint32_t					 pushed = 0, pushWakeMs = 0;
+
+// Stand-in for the version file, honors If-None-Match and publishes a new version at releaseAt
+struct VersionServer {
+	uint64_t releaseAt;
+	uint32_t requests = 0, bodies = 0;
+
+	int get(const char *, const UpdateCheck::Request &request, UpdateCheck::Response &response) {
+		requests++;
+		const bool	released = simClock.now >= releaseAt;
+		const char *etag	 = released ? "\"v2\"" : "\"v1\"";
+		if (!strcmp(request.etag, etag)) return 304;
+		bodies++;
+		strcpy(response.etag, etag);
+		strcpy(response.lastModified, released ? "Tue, 02 Jan 2024 00:00:00 GMT" : "Mon, 01 Jan 2024 00:00:00 GMT");
+		strcpy(response.body, released ? "4.1.0\n" : FW_VERSION "\n");
+		return 200;
+	}
+};
+
+// Stand-in for the server with the image, its delta and manifest, drops the connection every dropEvery
+// bytes and ignores Range on request number ignoreRangeAt. Until trailsUntil the manifest is still the
+// one for the running firmware, like a mirror that has the version file but not the rest of the release yet
+struct FileServer {
+	std::vector<uint8_t> image, delta;
+	std::string			 manifest;
+	uint32_t			 dropEvery = 0, ignoreRangeAt = 0;
+	uint64_t			 trailsUntil = 0; // simulated us
+	uint32_t			 requests = 0, served = 0;
+
+	static std::string hex(const std::vector<uint8_t> &data, uint8_t digest[32]) {
+		Sha256 sha;
+		char   text[65];
+		sha.update(data.data(), data.size());
+		sha.finish(digest);
+		Sha256::hex(digest, text);
+		return text;
+	}
+
+	// A random image, or with a base one like a release: most of the base kept, some of it shifted, new
+	// code and a repeated table in between. The delta is written as the image is built, the way
+	// tools/ota_delta.py would find it. Tests corrupt either afterwards, the manifest has the real hashes
+	void publish(uint32_t size, uint32_t seed, const std::vector<uint8_t> *base = nullptr) {
+		Sim::Random random(seed);
+		image.clear();
+		delta.assign(DeltaPatch::HEADER_SIZE, 0);
+		auto varint = [&](uint32_t v) {
+			for (; v >= 0x80; v >>= 7) delta.push_back(v | 0x80);
+			delta.push_back(v);
+		};
+		auto literal = [&](uint32_t n) {
+			delta.push_back(DeltaPatch::LITERAL), varint(n);
+			for (uint32_t i = 0; i < n; i++) image.push_back(random.next() >> 24), delta.push_back(image.back());
+		};
+		auto copyOld = [&](uint32_t from, uint32_t n) {
+			delta.push_back(DeltaPatch::COPY_OLD), varint(n), varint(from);
+			image.insert(image.end(), base->begin() + from, base->begin() + from + n);
+		};
+		auto copyNew = [&](uint32_t distance, uint32_t n) {
+			delta.push_back(DeltaPatch::COPY_NEW), varint(n), varint(distance);
+			for (uint32_t i = 0; i < n; i++) image.push_back(image[image.size() - distance]);
+		};
+
+		if (!base) {
+			image.resize(size);
+			for (uint8_t &b : image) b = random.next() >> 24;
+		} else {
+			const uint32_t third = base->size() / 3;
+			copyOld(0, third);
+			literal(1500);
+			copyOld(third + 700, third);
+			copyNew(third / 2, 8000);
+			literal(300);
+			copyOld(2 * third + 700, base->size() - 2 * third - 700);
+		}
+
+		uint8_t		imageSha[32], baseSha[32];
+		std::string imageHex = hex(image, imageSha);
+		manifest			 = "version=4.1.0\nsize=" + std::to_string(image.size()) + "\nsha256=" + imageHex + "\nurl=air.bin\n";
+		if (!base) return;
+
+		std::string baseHex = hex(*base, baseSha);
+		manifest += "delta_url=air.delta\ndelta_base_size=" + std::to_string(base->size()) + "\ndelta_base_sha256=" + baseHex + "\n";
+		uint32_t sizes[2] = {(uint32_t)base->size(), (uint32_t)image.size()};
+		memcpy(&delta[0], DeltaPatch::MAGIC, 4);
+		for (uint8_t i = 0; i < 4; i++) delta[4 + i] = sizes[0] >> (8 * i), delta[40 + i] = sizes[1] >> (8 * i);
+		memcpy(&delta[8], baseSha, 32);
+		memcpy(&delta[44], imageSha, 32);
+	}
+
+	template <typename Sink>
+	int fetch(const char *url, uint32_t from, Sink &sink) {
+		requests++;
+		const char *name = strrchr(url, '/') + 1;
+		if (!strcmp(name, "air.manifest")) {
+			std::string text = simClock.now < trailsUntil ? "version=" FW_VERSION + manifest.substr(manifest.find('\n')) : manifest;
+			if (sink.begin(0)) sink.write((const uint8_t *)text.data(), text.size());
+			return 200;
+		}
+		const std::vector<uint8_t> *body = !strcmp(name, "air.bin") ? &image : !strcmp(name, "air.delta") && !delta.empty() ? &delta : nullptr;
+		if (!body) return 404;
+		if (from >= body->size()) return 416;
+		if (requests == ignoreRangeAt) from = 0;
+		if (!sink.begin(from)) return from ? 206 : 200;
+
+		uint32_t end = dropEvery && from + dropEvery < body->size() ? from + dropEvery : body->size();
+		for (uint32_t at = from; at < end; at += 1460) { // one TCP segment at a time
+			uint32_t n = end - at < 1460 ? end - at : 1460;
+			served += n;
+			if (!sink.write(&(*body)[at], n)) break;
+		}
+		return from ? 206 : 200;
+	}
+};
+
+VersionServer						   versionServer;
+UpdateCheck::Checker<VersionServer> updateChecker(versionServer, simClock);
+uint32_t							   updateWakeMs = 0;
+FileServer							   fileServer;
+Sim::Flash							   runningSlot(0x140000); // app0 in partitions.csv, with the firmware deltas apply to
+Sim::Flash							   otaSlot(0x140000);	  // app1
+std::vector<uint8_t>				   runningImage;
+Updater::Job<FileServer, Sim::Flash>   updater(fileServer, otaSlot, simClock);
+
+UpdateFlow::Task<UpdateCheck::Checker<VersionServer>, Updater::Job<FileServer, Sim::Flash>> updateFlow(updateChecker, updater, simClock, FW_VERSION);
+
+// What a reboot does to the history and the filters: the RAM copies are gone, the log is found again and
+// replayed before the next sample goes in. The pending batch is written first, as on an OTA restart
+void rebootHistory() {
+	sampleLog.flush();
+	Pipeline::history		  = History::Store();
+	Pipeline::historyRestored = false;
+	Pipeline::co2Filter.reset();
+	Pipeline::pm25Filter.reset();
+	Pipeline::temperatureFilter.reset();
+	Pipeline::humidityFilter.reset();
+	sampleLog.recover();
+}
+
+// Pipeline::logSample, every sample once the history is restored, which the first one does here
+void logSample(History::Channel channel, uint32_t t, int16_t value) {
+	sampleLog.append(channel, t, value);
+	recorded[channel]++;
+	logged++;
+
+	if (recorded[channel] == 1 || value > highest[channel]) highest[channel] = value;
+	for (uint8_t b : {(uint8_t)channel, (uint8_t)value, (uint8_t)(value >> 8)}) digest = (digest ^ b) * 16777619u;
+}
+
+// What a /metrics scrape does to the windows
+void scrape() {
+	ScrapeWindow::rotate();
+	for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) scraped[ch].merge(ScrapeWindow::scraped(ch));
+	scrapes++;
+}
+
+// The board side of setup(), the deferred init stages all succeed at once on the host
+void setupBoard(uint32_t origin) {
+	Pipeline::clock		   = &simClock;
+	Pipeline::mhz19b	   = &fw->mhz19b;
+	Pipeline::si7021	   = &fw->si7021;
+	Pipeline::light		   = &fw->lightTap;
+	Pipeline::animator	   = &animator;
+	Pipeline::clockSynced  = []() { return true; }; // from the start on the host
+	Pipeline::historyTime  = []() { return START_TIME + (uint32_t)(simClock.millis() / 1000); };
+	Pipeline::logSample	   = logSample;
+	Pipeline::replayLog	   = [](History::Store &history, uint32_t now) { return Restore::replay(sampleLog, history, now); };
+	Pipeline::pushSample   = [](uint32_t t, History::Channel channel, float value) { pusher.add(t, channel, value), pushed++; };
+	Pipeline::streamSample = [](History::Channel channel, float value) { events.publish(channel, value); };
+	Pipeline::offset	   = [](History::Channel channel) { return offsets[channel]; };
+	Pipeline::show		   = [](Notify::Characteristic, float) {}; // no HomeKit here, Notify counts what it would get
+
+	SerialCom::setup(fw->pmTap);
+	fw->mhz19b.setAutoCalibration(true);
+	Pipeline::pm1006Ready = true;
+	Pipeline::mhzReady	  = true;
+	Pipeline::si7021Ready = true;
+	sampleLog.recover();
+	animator.setLevel(BRIGHTNESS_DEFAULT);
+	animator.play(Animation::WARMUP, simClock.millis());
+	Pipeline::setupJobs(INTERVAL * 1000, origin);
+}
+
+// One pass of the firmware's loop(), minus HomeSpan and the web server, with the acquisition task
+// stepped first, the device runs the two side by side
+void loopOnce() {
+	uint32_t ms = simClock.millis();
+
+	Pipeline::acquire();
+	Pipeline::drainReadings();
+	if (Pipeline::needToWarmUp && !fw->mhz19b.warmingUp()) Pipeline::needToWarmUp = false; // DEV_CO2Sensor::loop()
+
+	animator.tick(ms);
+	events.pump(ms);
+
+	// The push and update tasks, each woken when its last step asked to be
+	if ((int32_t)(ms - pushWakeMs) >= 0) pushWakeMs = ms + pusher.step(60000, 50);
+	if ((int32_t)(ms - updateWakeMs) >= 0) updateWakeMs = ms + updateFlow.step();
+}
+
+// What a run is asked to do, see main.cpp for the command line
+struct Options {
+	float		hours		= 24;
+	uint32_t	stepMs		= 10;
+	uint32_t	seed		= 1;
+	const char *replayPath	= nullptr;
+	const char *capturePath = nullptr;
+};
+
+// Set by simulate(), the tests check the run against them
+Options			options;
+uint64_t		beginUs = 0, endUs = 0, spanUs = 0; // simulated us
+double			wall					= 0;		  // seconds the run took
+uint32_t		replayed				= 0;		  // records read back from the flash log
+uint32_t		droppedEarly			= UINT32_MAX; // push samples dropped before the long outage
+bool			resumed					= false;
+bool			availableBeforeRelease	= false;
+uint8_t			calibrations			= 0;
+History::Store restored; // the flash log replayed the way restoreHistory() does after a reboot
+
+// Set up the board, run it for the requested time and replay the flash log. 0, or 2 when a file can't be read or written
+int simulate(const Options &o) {
+	options = o;
+	rng		= Sim::Random(options.seed);
+
+	uint32_t origin = 0;
+	endUs			= (uint64_t)(options.hours * 3600) * 1000000;
+	if (options.replayPath) {
+		if (!replay.load(options.replayPath)) {
+			fprintf(stderr, "%s: not a readable capture\n", options.replayPath);
+			return 2;
+		}
+		fw = new Firmware(replayPm, replayMhz, replayI2C, replayLight);
+
+		// Run over the captured span of device uptime, with the job grid lined up with the device's:
+		// the CO2 job sends its request right before the first MH-Z19B reply was read.
+		// The grid starts one period early so no job due in the first period is missed
+		const uint32_t period = INTERVAL * 1000;
+		const auto	  &mhz	  = replay.events[Capture::MHZ19B_RX];
+		beginUs				  = (uint64_t)replay.startMs * 1000;
+		endUs				  = (uint64_t)(replay.startMs + replay.durationMs + 1) * 1000;
+		origin				  = replay.startMs - period;
+		if (!mhz.empty()) origin += (mhz[0].ms - MHZ19B_REPLY_MS - replay.startMs) % period;
+		options.hours = replay.durationMs / 3600000.0f;
+	} else {
+		fw = new Firmware(pmUart, mhzUart, siDevice, lightSensor);
+		if (options.capturePath) capture.start(0);
+	}
+	simClock.now = beginUs;
+
+	setupBoard(origin);
+
+	// Three /events subscribers fill every slot and a fourth is turned away. The slow one stalls for up to
+	// an hour a quarter in, the last one loses its connection halfway and comes back with Last-Event-ID
+	spanUs				 = endUs - beginUs;
+	slowReader.stallFrom = beginUs + spanUs / 4;
+	slowReader.stallTo	 = slowReader.stallFrom + (spanUs / 4 < 3600000000ULL ? spanUs / 4 : 3600000000ULL);
+	resumedReader.dropAt = beginUs + spanUs / 2;
+	for (SseReader *r : {&fastReader, &slowReader, &resumedReader, &fastReader}) events.subscribe({r}, 0, simClock.millis());
+
+	// The push server goes away twice: for up to half an hour, which the queue rides out, then for up to
+	// two hours, which it doesn't
+	const uint64_t shortOutage = spanUs / 10 < 1800000000ULL ? spanUs / 10 : 1800000000ULL;
+	const uint64_t longOutage  = spanUs / 5 < 7200000000ULL ? spanUs / 5 : 7200000000ULL;
+	pushServer.outages[0][0]   = beginUs + spanUs / 5;
+	pushServer.outages[0][1]   = pushServer.outages[0][0] + shortOutage;
+	pushServer.outages[1][0]   = beginUs + spanUs / 2;
+	pushServer.outages[1][1]   = pushServer.outages[1][0] + longOutage;
+
+	// Hourly version checks, at least eight of them on short runs, a new version shows up three quarters in
+	snprintf(Settings::updateUrl, sizeof(Settings::updateUrl), "http://versions/bin_version.txt");
+	snprintf(Settings::otaManifestUrl, sizeof(Settings::otaManifestUrl), "http://files/air.manifest");
+	Settings::updateCheckSecs = spanUs / 8000000 < 3600 ? spanUs / 8000000 + 1 : 3600;
+	versionServer.releaseAt	  = beginUs + spanUs * 3 / 4;
+	calibrations			  = options.replayPath ? 2 : 0; // zero and span once a third in, as /co2/calibrate would
+
+	// The first manifest after the release is still the old one and is refused. The delta for the new
+	// image then arrives broken, so it comes whole in chunks of a fifth, the fifth request (the second for
+	// the image) gets all of it again
+	Sim::Random firmware(options.seed);
+	runningImage.resize(300000);
+	for (uint8_t &b : runningImage) b = firmware.next() >> 24;
+	runningSlot.write(0, runningImage.data(), runningImage.size());
+	updater.running = &runningSlot;
+	fileServer.publish(0, options.seed, &runningImage);
+	fileServer.delta[200] ^= 1; // in the first literal, the delta applies but the image doesn't verify
+	fileServer.dropEvery	 = 60000;
+	fileServer.ignoreRangeAt = 5;
+	fileServer.trailsUntil	 = versionServer.releaseAt + spanUs / 48; // the first check after the release gets the old manifest
+
+	const uint64_t step	 = options.stepMs * 1000;
+	auto		   start = std::chrono::steady_clock::now();
+
+	uint64_t nextScrape = beginUs + SCRAPE_MS * 1000ULL;
+	while (simClock.now < endUs) {
+		loopOnce();
+		if (simClock.now >= nextScrape) {
+			scrape();
+			nextScrape += SCRAPE_MS * 1000ULL;
+		}
+		if (resumedReader.gone && !resumed && simClock.now >= resumedReader.dropAt + 30000000ULL) {
+			resumedReader.gone = false, resumedReader.dropAt = UINT64_MAX;
+			resumed			   = events.subscribe({&resumedReader}, resumedReader.lastId, simClock.millis());
+		}
+		if (droppedEarly == UINT32_MAX && simClock.now >= pushServer.outages[1][0]) droppedEarly = pusher.dropped;
+		if (simClock.now < versionServer.releaseAt) availableBeforeRelease |= updateChecker.available;
+		if (calibrations < 2 && simClock.now >= beginUs + spanUs / 3 && !Pipeline::mhzCalibration) { // one at a time, as over HTTP
+			Pipeline::mhzCalibration = calibrations++ ? MHZ19B::CMD_SPAN << 16 | 2000 : MHZ19B::CMD_ZERO << 16;
+		}
+		if (!options.replayPath) pmDevice.tick(simClock.now);
+		simClock.now += step;
+	}
+	for (uint8_t i = 0; i < 32; i++) events.pump(simClock.millis()); // whatever the last passes published
+	sampleLog.flush();
+	scrape();
+
+	if (options.capturePath) {
+		struct File {
+			FILE *f;
+			void  write(const char *data, size_t len) { fwrite(data, 1, len, f); }
+		} out = {fopen(options.capturePath, "wb")};
+		if (!out.f) {
+			fprintf(stderr, "%s: cannot write\n", options.capturePath);
+			return 2;
+		}
+		capture.write(out);
+		fclose(out.f);
+	}
+
+	wall	 = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	replayed = sampleLog.replay([](uint8_t ch, uint32_t t, int16_t v) { restored.ingestRaw((History::Channel)ch, t, v); });
+	return 0;
+}
+
+// What the run did, one line per part
+void report() {
+	MHZ19B &mhz19b = fw->mhz19b;
+	Si7021 &si7021 = fw->si7021;
+
+	printf("%s %.1f h in %.2f s (%.0fx real time, %u ms steps)\n", options.replayPath ? "replayed" : "simulated", options.hours, wall, options.hours * 3600 / wall, (unsigned)options.stepMs);
+	if (options.replayPath) printf("replay   records=%u start=%u ms\n", (unsigned)replay.records, (unsigned)replay.startMs);
+	if (options.capturePath) printf("capture  records=%u bytes=%u evicted=%u\n", (unsigned)capture.records, (unsigned)capture.used, (unsigned)capture.evicted);
+	printf("pm1006   sent=%u decoded=%u checksum_errors=%u discarded=%u injected=%u overruns=%u aqi=%u\n",
+		   (unsigned)pmDevice.sent, (unsigned)SerialCom::decoder.framesOk, (unsigned)SerialCom::decoder.checksumErrors,
+		   (unsigned)SerialCom::decoder.bytesDiscarded, (unsigned)pmDevice.corrupted, (unsigned)pmUart.overruns, (unsigned)Pipeline::airQuality);
+	printf("mhz19b   readings=%u errors=%u injected=%u timeouts=%u abc=%d last=%u ppm unclamped=%u ppm %d C replies=%u latency_mean=%u ms max=%u us\n",
+		   (unsigned)mhz19b.seq, (unsigned)mhz19b.errors, (unsigned)mhzDevice.corrupted, (unsigned)mhz19b.timeouts, mhzDevice.abc, (unsigned)mhz19b.co2,
+		   (unsigned)mhz19b.co2Unlimited, mhz19b.temperature, (unsigned)mhz19b.replies, (unsigned)(mhz19b.replies ? mhz19b.latencySumMs / mhz19b.replies : 0),
+		   (unsigned)mhz19b.latencyMaxUs);
+	printf("si7021   readings=%u errors=%u nacks=%u last=%.2f C %.2f %%\n",
+		   (unsigned)si7021.seq, (unsigned)si7021.errors, (unsigned)siDevice.nacks, si7021.temperature, si7021.humidity);
+	for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) {
+		uint32_t raw = 0, minute = 0, quarter = 0;
+		Pipeline::history.forEach((History::Channel)ch, 0, 10, [&](uint32_t, const History::Bucket &) { raw++; });
+		Pipeline::history.forEach((History::Channel)ch, 0, 60, [&](uint32_t, const History::Bucket &) { minute++; });
+		Pipeline::history.forEach((History::Channel)ch, 0, 900, [&](uint32_t, const History::Bucket &) { quarter++; });
+		printf("history  %-11s samples=%u raw=%u minute=%u quarter=%u\n", History::CHANNELS[ch].name, (unsigned)recorded[ch], (unsigned)raw, (unsigned)minute, (unsigned)quarter);
+	}
+	uint32_t maxErases = 0;
+	for (uint32_t e : flash.erases) maxErases = e > maxErases ? e : maxErases;
+	printf("flash    logged=%u replayed=%u pages=%u sectors_erased=%u max_sector_erases=%u violations=%u\n",
+		   (unsigned)logged, (unsigned)replayed, (unsigned)sampleLog.pagesWritten, (unsigned)sampleLog.sectorsErased, (unsigned)maxErases, (unsigned)flash.violations);
+	printf("filtered co2=%.0f ppm pm25=%.0f ug/m3 temperature=%.2f C humidity=%.2f %% outliers=%u\n",
+		   Pipeline::co2Filter.get(), Pipeline::pm25Filter.get(), Pipeline::temperatureFilter.get(), Pipeline::humidityFilter.get(),
+		   (unsigned)Pipeline::state.frames.stages.stage.replaced);
+	const ScrapeWindow::Aggregate &co2Window = scraped[History::CO2];
+	printf("scrape   windows=%u co2 p50=%.0f p90=%.0f p99=%.0f max=%d ppm\n", (unsigned)scrapes,
+		   co2Window.quantile(ScrapeWindow::LAYOUTS[History::CO2], 0.5f), co2Window.quantile(ScrapeWindow::LAYOUTS[History::CO2], 0.9f),
+		   co2Window.quantile(ScrapeWindow::LAYOUTS[History::CO2], 0.99f), co2Window.max);
+	const uint32_t published = events.nextId - 1;
+	printf("events   published=%u rejected=%u dropped=%u fast=%u slow=%u resumed=%u\n", (unsigned)published, (unsigned)events.rejected,
+		   (unsigned)events.dropped, (unsigned)fastReader.events, (unsigned)slowReader.events, (unsigned)resumedReader.events);
+	printf("push     samples=%u sent=%u queued=%u dropped=%u requests=%u failures=%u received=%u\n", (unsigned)pushed, (unsigned)pusher.sent,
+		   (unsigned)pusher.queued(), (unsigned)pusher.dropped, (unsigned)pushServer.requests, (unsigned)pusher.failures, (unsigned)pushServer.lines);
+	printf("update   checks=%u bodies=%u not_modified=%u available=%u latest=%s\n", (unsigned)versionServer.requests, (unsigned)versionServer.bodies,
+		   (unsigned)updateChecker.results[UpdateCheck::NOT_MODIFIED], updateChecker.available, updateChecker.latest);
+	printf("ota      state=%s written=%u served=%u resumes=%u restarts=%u delta=%u fallbacks=%u wrong_version=%u\n", Updater::STATE_NAMES[updater.state],
+		   (unsigned)updater.written, (unsigned)fileServer.served, (unsigned)updater.resumes, (unsigned)updater.restarts, (unsigned)fileServer.delta.size(),
+		   (unsigned)updater.deltaFallbacks, (unsigned)updater.failures[Updater::VERSION]);
+	const auto &readings = Pipeline::readings;
+	printf("readings pushed=%u dropped=%u max_queued=%u latency_max=%u us\n", (unsigned)readings.pushed, (unsigned)readings.dropped,
+		   (unsigned)readings.highWater, (unsigned)readings.latencyMaxUs);
+	printf("notify  ");
+	for (const Notify::Gate &g : Notify::gates) printf(" %s=%u/%u", g.policy.name, (unsigned)g.sent, (unsigned)(g.sent + g.suppressed));
+	printf(" sent\n");
+	printf("led      updates=%u last=%u,%u,%u\n", (unsigned)led.updates, led.r, led.g, led.b);
+	printf("digest   %08x\n", (unsigned)digest);
+}
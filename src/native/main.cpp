@@ -0,0 +1,157 @@
+/*
+ * Host build of the sensor pipeline against the simulated devices in
+ * Simulation.hpp. Runs the device's jobs over accelerated time and prints
+ * what every part of the pipeline did, the checks on it are the test
+ * suites under test/.
+ *
+ * With --replay the drivers read a capture downloaded from /capture
+ * instead (Replay.hpp), with --capture the simulated traffic is written
+ * out in the same format.
+ *
+ *   pio run -e native && .pio/build/native/program --hours 24 [--seed N] [--step-ms N] [--verbose]
+ *   .pio/build/native/program --replay capture.bin
+ *   .pio/build/native/program --hours 2 --capture capture.bin
+ *   pio test -e native
+ *
+ * --bench FILE runs the micro-benchmarks in Benchmarks.hpp instead and
+ * writes the results as JSON, compare two runs with tools/benchcmp.py.
+ * With --replay as well, the PM1006 bytes of that capture are decoded
+ * instead of a simulated one.
+ * --apply-delta OLD PATCH OUT rebuilds an image from a tools/ota_delta.py
+ * patch with the firmware's decoder.
+ */
+
+#include <new>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Bench.hpp"
+#include "Benchmarks.hpp"
+#include "DeltaPatch.hpp"
+#include "Sha256.hpp"
+#include "Simulation.hpp"
+#include "Version.hpp"
+
+// Count heap allocations for the benchmarks
+void *operator new(size_t size) {
+	Bench::allocations++;
+	if (void *p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+// The firmware's side of tools/ota_delta.py, with the image hashes the patch claims
+static bool readFile(const char *path, std::vector<uint8_t> &data) {
+	FILE *f = fopen(path, "rb");
+	if (!f) return false;
+	uint8_t buf[4096];
+	size_t	n;
+	while ((n = fread(buf, 1, sizeof(buf), f))) data.insert(data.end(), buf, buf + n);
+	fclose(f);
+	return true;
+}
+
+static int applyDelta(const char *oldPath, const char *patchPath, const char *outPath) {
+	struct Out {
+		std::vector<uint8_t> data;
+
+		bool emit(const uint8_t *bytes, size_t len) {
+			data.insert(data.end(), bytes, bytes + len);
+			return true;
+		}
+
+		bool readBack(uint32_t at, uint8_t *buf, size_t len) {
+			memcpy(buf, &data[at], len);
+			return true;
+		}
+
+		uint32_t produced() const {
+			return data.size();
+		}
+	};
+
+	std::vector<uint8_t> old, patch;
+	if (!readFile(oldPath, old) || !readFile(patchPath, patch) || patch.size() < DeltaPatch::HEADER_SIZE) {
+		fprintf(stderr, "cannot read %s or %s\n", oldPath, patchPath);
+		return 2;
+	}
+	Sim::Flash source(old.size());
+	source.write(0, old.data(), old.size());
+
+	DeltaPatch::Header expected;
+	Sha256			   sha;
+	sha.update(old.data(), old.size());
+	sha.finish(expected.oldSha256);
+	expected.oldSize = old.size();
+	expected.newSize = patch[40] | patch[41] << 8 | patch[42] << 16 | (uint32_t)patch[43] << 24;
+	memcpy(expected.newSha256, &patch[44], 32);
+
+	DeltaPatch::Decoder<Sim::Flash> decoder;
+	Out								out;
+	decoder.begin(source, expected);
+	for (size_t at = 0; at < patch.size(); at += 1460) decoder.feed(&patch[at], patch.size() - at < 1460 ? patch.size() - at : 1460, out);
+	uint8_t digest[32];
+	sha.reset();
+	sha.update(out.data.data(), out.data.size());
+	sha.finish(digest);
+	if (!decoder.done(out) || memcmp(digest, expected.newSha256, 32)) {
+		fprintf(stderr, "%s doesn't turn %s into the image it names\n", patchPath, oldPath);
+		return 1;
+	}
+
+	FILE *f = fopen(outPath, "wb");
+	if (!f || fwrite(out.data.data(), 1, out.data.size(), f) != out.data.size()) {
+		fprintf(stderr, "%s: cannot write\n", outPath);
+		return 2;
+	}
+	fclose(f);
+	printf("%u byte image from a %u byte delta\n", (unsigned)out.data.size(), (unsigned)patch.size());
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	Options		o;
+	const char *benchPath = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--hours") && i + 1 < argc) o.hours = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--step-ms") && i + 1 < argc) o.stepMs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc) o.seed = strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--replay") && i + 1 < argc) o.replayPath = argv[++i];
+		else if (!strcmp(argv[i], "--capture") && i + 1 < argc) o.capturePath = argv[++i];
+		else if (!strcmp(argv[i], "--bench") && i + 1 < argc) benchPath = argv[++i];
+		else if (!strcmp(argv[i], "--apply-delta") && i + 3 < argc) return applyDelta(argv[i + 1], argv[i + 2], argv[i + 3]);
+		else if (!strcmp(argv[i], "--verbose")) Hal::verbose = true;
+		else {
+			fprintf(stderr, "usage: %s [--hours N] [--step-ms N] [--seed N] [--replay FILE | --capture FILE] [--bench FILE] [--apply-delta OLD PATCH OUT] [--verbose]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (o.stepMs == 0) o.stepMs = 1;
+
+	if (benchPath) {
+		printf("firmware %s\n", FW_VERSION);
+		if (!Benchmarks::run(o.replayPath)) {
+			fprintf(stderr, "%s: not a readable capture\n", o.replayPath);
+			return 2;
+		}
+		if (!Bench::writeJson(benchPath, FW_VERSION)) {
+			fprintf(stderr, "%s: cannot write\n", benchPath);
+			return 2;
+		}
+		return 0;
+	}
+
+	if (int status = simulate(o)) return status;
+	report();
+	return 0;
+}
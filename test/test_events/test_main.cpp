@@ -0,0 +1,173 @@
+// /events as a client sees it: the response, the event framing and resuming with Last-Event-ID
+#include <unity.h>
+
+#include <stdint.h>
+#include <string>
+
+#include "Events.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+// The client's end of one socket
+struct Wire {
+	std::string received;
+	size_t		window = SIZE_MAX; // bytes a send() takes at most
+	bool		gone   = false;
+	bool		closed = false;
+};
+
+struct Client {
+	Wire *wire = nullptr;
+
+	int send(const char *data, size_t len) {
+		if (wire->gone) return -1;
+		size_t n = len < wire->window ? len : wire->window;
+		wire->received.append(data, n);
+		return n;
+	}
+
+	void close() {
+		wire->closed = true;
+	}
+};
+
+typedef Events::Hub<Client, 3, 8> Hub;
+
+static bool startsWith(const std::string &s, const char *prefix) {
+	return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static bool endsWith(const std::string &s, const char *suffix) {
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool contains(const std::string &s, const char *part) {
+	return s.find(part) != std::string::npos;
+}
+
+void test_response_headers() {
+	Hub	 hub;
+	Wire wire;
+	TEST_ASSERT_TRUE(hub.accept({&wire}, "", 0));
+	TEST_ASSERT_EQUAL(1, hub.count());
+	TEST_ASSERT_FALSE(wire.closed);
+
+	TEST_ASSERT_TRUE(startsWith(wire.received, "HTTP/1.1 200 OK\r\n"));
+	TEST_ASSERT_TRUE(contains(wire.received, "\r\nContent-Type: text/event-stream\r\n"));
+	TEST_ASSERT_TRUE(contains(wire.received, "\r\nCache-Control: no-cache\r\n"));
+	TEST_ASSERT_TRUE(endsWith(wire.received, "\r\n\r\nretry: 5000\n\n")); // the stream starts right after the headers
+}
+
+// A fourth client gets a complete 503 and its socket closed, the three streams carry on
+void test_rejected_when_full() {
+	Hub	 hub;
+	Wire wires[4];
+	for (uint8_t i = 0; i < 3; i++) TEST_ASSERT_TRUE(hub.accept({&wires[i]}, "", 0));
+	TEST_ASSERT_FALSE(hub.accept({&wires[3]}, "", 0));
+
+	const std::string &response = wires[3].received;
+	size_t			   body		= response.find("\r\n\r\n") + 4;
+	TEST_ASSERT_TRUE(startsWith(response, "HTTP/1.1 503 "));
+	TEST_ASSERT_TRUE(contains(response, "\r\nConnection: close\r\n"));
+	TEST_ASSERT_TRUE(contains(response, ("\r\nContent-Length: " + std::to_string(response.size() - body) + "\r\n").c_str()));
+	TEST_ASSERT_EQUAL_STRING("too many subscribers\n", response.c_str() + body);
+	TEST_ASSERT_TRUE(wires[3].closed);
+	TEST_ASSERT_EQUAL_UINT32(1, hub.rejected);
+	TEST_ASSERT_EQUAL(3, hub.count());
+
+	// A slot freed by a client that went away takes the next one
+	wires[0].gone = true;
+	hub.publish(History::CO2, 812);
+	hub.pump(0);
+	Wire next;
+	TEST_ASSERT_TRUE(hub.accept({&next}, "", 0));
+	TEST_ASSERT_EQUAL_UINT32(1, hub.disconnects);
+}
+
+// One event per sample in the channel's resolution, a comment line on an idle stream
+void test_framing() {
+	Hub	 hub;
+	Wire wire;
+	hub.accept({&wire}, "", 0);
+	wire.received.clear();
+
+	hub.publish(History::CO2, 812);
+	hub.publish(History::TEMPERATURE, 21.374f);
+	hub.publish(History::HUMIDITY, 45.2f);
+	for (uint8_t i = 0; i < 3; i++) hub.pump(1000);
+	TEST_ASSERT_EQUAL_STRING("id: 1\nevent: co2\ndata: 812\n\n"
+							 "id: 2\nevent: temperature\ndata: 21.37\n\n"
+							 "id: 3\nevent: humidity\ndata: 45.20\n\n",
+							 wire.received.c_str());
+
+	wire.received.clear();
+	hub.pump(1000 + Events::HEARTBEAT_MS - 1);
+	TEST_ASSERT_EQUAL_STRING("", wire.received.c_str());
+	hub.pump(1000 + Events::HEARTBEAT_MS);
+	TEST_ASSERT_EQUAL_STRING(":\n\n", wire.received.c_str());
+}
+
+// A socket that takes a few bytes at a time still gets every event whole and in order
+void test_partial_sends() {
+	Hub	 hub;
+	Wire wire;
+	hub.accept({&wire}, "", 0);
+	wire.received.clear();
+	wire.window = 5;
+
+	hub.publish(History::CO2, 812);
+	hub.publish(History::PM25, 12);
+	for (uint8_t i = 0; i < 20; i++) hub.pump(0);
+	TEST_ASSERT_EQUAL_STRING("id: 1\nevent: co2\ndata: 812\n\nid: 2\nevent: pm25\ndata: 12\n\n", wire.received.c_str());
+}
+
+void test_last_event_id_parsing() {
+	TEST_ASSERT_EQUAL_UINT32(0, Events::lastEventId(""));
+	TEST_ASSERT_EQUAL_UINT32(42, Events::lastEventId("42"));
+	TEST_ASSERT_EQUAL_UINT32(4294967295u, Events::lastEventId("4294967295"));
+	TEST_ASSERT_EQUAL_UINT32(0, Events::lastEventId("4294967296"));
+	TEST_ASSERT_EQUAL_UINT32(0, Events::lastEventId("99999999999999999999999"));
+	TEST_ASSERT_EQUAL_UINT32(0, Events::lastEventId("-1"));
+	TEST_ASSERT_EQUAL_UINT32(0, Events::lastEventId("42abc"));
+	TEST_ASSERT_EQUAL_UINT32(0, Events::lastEventId(" 42"));
+}
+
+// A client that reconnects picks up after the last id it saw, as far back as the ring goes
+void test_resume_from_last_event_id() {
+	Hub hub;
+	for (uint16_t v = 401; v <= 405; v++) hub.publish(History::CO2, v);
+
+	Wire resumed, ahead, fresh;
+	hub.accept({&resumed}, "3", 0);
+	hub.accept({&ahead}, "99", 0);	// an id this hub never handed out, from before a reboot
+	hub.accept({&fresh}, "junk", 0);
+	for (uint8_t i = 0; i < 4; i++) hub.pump(0);
+	TEST_ASSERT_TRUE(endsWith(resumed.received, "retry: 5000\n\nid: 4\nevent: co2\ndata: 404\n\nid: 5\nevent: co2\ndata: 405\n\n"));
+	TEST_ASSERT_TRUE(endsWith(ahead.received, "retry: 5000\n\n"));
+	TEST_ASSERT_TRUE(endsWith(fresh.received, "retry: 5000\n\n"));
+	TEST_ASSERT_EQUAL_UINT32(0, hub.dropped);
+
+	// Further back than the ring of 8 holds, the skipped ones are counted
+	Hub	 older;
+	Wire late;
+	for (uint16_t v = 401; v <= 420; v++) older.publish(History::CO2, v);
+	older.accept({&late}, "5", 0);
+	for (uint8_t i = 0; i < 16; i++) older.pump(0);
+	TEST_ASSERT_TRUE(contains(late.received, "retry: 5000\n\nid: 13\nevent: co2\ndata: 413\n\n"));
+	TEST_ASSERT_TRUE(endsWith(late.received, "id: 20\nevent: co2\ndata: 420\n\n"));
+	TEST_ASSERT_EQUAL_UINT32(7, older.dropped);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_response_headers);
+	RUN_TEST(test_rejected_when_full);
+	RUN_TEST(test_framing);
+	RUN_TEST(test_partial_sends);
+	RUN_TEST(test_last_event_id_parsing);
+	RUN_TEST(test_resume_from_last_event_id);
+	return UNITY_END();
+}
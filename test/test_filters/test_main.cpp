@@ -0,0 +1,120 @@
+// Step and spike responses of the filter stages, sample by sample
+#include <unity.h>
+
+#include "Filters.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+template <typename Stage>
+static void settle(Stage &stage, int32_t x, uint8_t n) {
+	for (uint8_t i = 0; i < n; i++) stage.push(x);
+}
+
+// A step gets through on its 2nd sample, a single sample never does
+void test_median3_step() {
+	Filters::Median<3> median;
+	settle(median, 100, 5);
+	TEST_ASSERT_EQUAL_INT(100, median.push(200));
+	TEST_ASSERT_EQUAL_INT(200, median.push(200));
+	TEST_ASSERT_EQUAL_INT(200, median.push(200));
+
+	TEST_ASSERT_EQUAL_INT(200, median.push(900));
+	TEST_ASSERT_EQUAL_INT(200, median.push(200));
+	TEST_ASSERT_EQUAL_INT(200, median.push(-50));
+	TEST_ASSERT_EQUAL_INT(200, median.push(200));
+}
+
+// Held at the old median until the step is the majority of the window, on its 4th sample
+void test_hampel7_step() {
+	Filters::Hampel<7> hampel;
+	const int32_t	   noisy[] = {30, 31, 30, 29, 30, 31, 30};
+	for (int32_t x : noisy) TEST_ASSERT_EQUAL_INT(x, hampel.push(x));
+
+	TEST_ASSERT_EQUAL_INT(30, hampel.push(60));
+	TEST_ASSERT_EQUAL_INT(30, hampel.push(60));
+	TEST_ASSERT_EQUAL_INT(31, hampel.push(60)); // median of 29 30 31 30 60 60 60
+	TEST_ASSERT_EQUAL_INT(60, hampel.push(60));
+	TEST_ASSERT_EQUAL_INT(61, hampel.push(61));
+	TEST_ASSERT_EQUAL_UINT32(3, hampel.replaced);
+}
+
+void test_hampel7_spikes() {
+	Filters::Hampel<7> hampel;
+	const int32_t	   noisy[] = {30, 31, 30, 29, 30, 31, 30, 29, 30, 31, 30, 29, 30, 31};
+	uint32_t		   spikes  = 0;
+	for (uint8_t i = 0; i < sizeof(noisy) / sizeof(noisy[0]); i++) {
+		if (i % 4 == 3) {
+			TEST_ASSERT_EQUAL_INT(30, hampel.push(i % 8 == 3 ? 900 : 0)); // a spike either way is the median
+			spikes++;
+		}
+		TEST_ASSERT_EQUAL_INT(noisy[i], hampel.push(noisy[i]));
+	}
+	TEST_ASSERT_EQUAL_UINT32(spikes, hampel.replaced);
+
+	// Noise within FLOOR of a flat signal is never touched
+	Filters::Hampel<7> flat;
+	settle(flat, 30, 7);
+	TEST_ASSERT_EQUAL_INT(32, flat.push(32));
+	TEST_ASSERT_EQUAL_INT(28, flat.push(28));
+	TEST_ASSERT_EQUAL_UINT32(0, flat.replaced);
+}
+
+// Reaches the new level exactly, however small the step, without overshoot
+static void emaStep(int32_t from, int32_t to) {
+	Filters::Ema<3> ema;
+	settle(ema, from, 1);
+	int32_t out = from, n = 0;
+	while (out != to && n < 100) {
+		int32_t next = ema.push(to);
+		TEST_ASSERT_TRUE_MESSAGE(to > from ? next >= out && next <= to : next <= out && next >= to, "not monotonic");
+		out = next;
+		n++;
+	}
+	TEST_ASSERT_EQUAL_INT_MESSAGE(to, out, "stalled short of the step");
+	TEST_ASSERT_TRUE_MESSAGE(n <= 60, "too slow");
+	for (uint8_t i = 0; i < 20; i++) TEST_ASSERT_EQUAL_INT(to, ema.push(to));
+}
+
+void test_ema3_converges() {
+	emaStep(400, 401);
+	emaStep(401, 400);
+	emaStep(400, 1000);
+	emaStep(1000, 400);
+	emaStep(2137, 2138); // 0.01 deg C
+	emaStep(-5, 5);
+	emaStep(5, -5);
+
+	// A quarter of the step after two samples, alpha = 1/8
+	Filters::Ema<3> ema;
+	ema.push(0);
+	ema.push(800);
+	TEST_ASSERT_EQUAL_INT(188, ema.push(800));
+}
+
+// Output only moves once the input is D or more away from it
+void test_deadband_holds() {
+	Filters::Deadband<3> deadband;
+	TEST_ASSERT_EQUAL_INT(100, deadband.push(100));
+	TEST_ASSERT_EQUAL_INT(100, deadband.push(102));
+	TEST_ASSERT_EQUAL_INT(100, deadband.push(98));
+	TEST_ASSERT_EQUAL_INT(100, deadband.push(101));
+	TEST_ASSERT_EQUAL_INT(103, deadband.push(103));
+	TEST_ASSERT_EQUAL_INT(103, deadband.push(101));
+	TEST_ASSERT_EQUAL_INT(100, deadband.push(100));
+	TEST_ASSERT_EQUAL_INT(97, deadband.push(97));
+
+	deadband.reset();
+	TEST_ASSERT_EQUAL_INT(50, deadband.push(50));
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_median3_step);
+	RUN_TEST(test_hampel7_step);
+	RUN_TEST(test_hampel7_spikes);
+	RUN_TEST(test_ema3_converges);
+	RUN_TEST(test_deadband_holds);
+	return UNITY_END();
+}
@@ -0,0 +1,133 @@
+// OpenMetrics rendering: non-finite values, over-long lines and heap use
+#include <unity.h>
+
+#include <stdlib.h>
+
+#include <new>
+
+#include "Metrics.hpp"
+
+// Count heap allocations, a scrape must not make any
+static uint32_t allocations = 0;
+
+void *operator new(size_t size) {
+	allocations++;
+	if (void *p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static char	  out[8192];
+static size_t outLen = 0;
+static size_t chunks = 0;
+
+static void sink(const char *data, size_t len) {
+	TEST_ASSERT_TRUE_MESSAGE(outLen + len < sizeof(out), "output too long for the test");
+	memcpy(out + outLen, data, len);
+	outLen += len;
+	out[outLen] = 0;
+	chunks++;
+}
+
+// clang-format off
+static const Metrics::Family families[] = {
+	{"test_plain", Metrics::GAUGE, "A finite value", [](double &v) { v = 21.5; return true; }, nullptr},
+	{"test_skipped", Metrics::GAUGE, "No value yet", [](double &) { return false; }, nullptr},
+	{"test_nan", Metrics::GAUGE, "Not a number", [](double &v) { v = NAN; return true; }, nullptr},
+	{"test_up", Metrics::GAUGE, "Positive infinity", [](double &v) { v = INFINITY; return true; }, nullptr},
+	{"test_down", Metrics::GAUGE, "Negative infinity", [](double &v) { v = -INFINITY; return true; }, nullptr},
+	{"test_count", Metrics::COUNTER, "A counter", [](double &v) { v = 43200; return true; }, nullptr},
+	{"test_labels", Metrics::COUNTER, "One label set too long for a line", nullptr, [](Metrics::Writer &w, const Metrics::Family &f) {
+		char labels[Metrics::Writer::LINE];
+		memset(labels, 'x', sizeof(labels) - 1);
+		labels[sizeof(labels) - 1] = 0;
+		w.header(f);
+		w.sample(f, "_total", "port=\"pm1006\"", 1);
+		w.sample(f, "_total", labels, 2);
+		w.sample(f, "_total", "port=\"mhz19b\"", 3); }},
+};
+// clang-format on
+
+// Returns the lines dropped
+static uint32_t render(size_t bufSize) {
+	static char buf[1024];
+	outLen = chunks = 0;
+	out[0]			= 0;
+	Metrics::Writer writer(buf, bufSize, sink);
+	Metrics::render(families, writer);
+	return writer.dropped;
+}
+
+static bool has(const char *line) {
+	return strstr(out, line) != nullptr;
+}
+
+void test_non_finite_values() {
+	render(512);
+	TEST_ASSERT_TRUE(has("test_plain{device=\"air_sensor\",location=\"home\"} 21.5\n"));
+	TEST_ASSERT_TRUE(has("test_nan{device=\"air_sensor\",location=\"home\"} NaN\n"));
+	TEST_ASSERT_TRUE(has("test_up{device=\"air_sensor\",location=\"home\"} +Inf\n"));
+	TEST_ASSERT_TRUE(has("test_down{device=\"air_sensor\",location=\"home\"} -Inf\n"));
+	TEST_ASSERT_TRUE(has("test_count_total{device=\"air_sensor\",location=\"home\"} 43200\n"));
+	TEST_ASSERT_TRUE(!has(" inf\n") && !has(" -inf\n") && !has(" nan\n"));
+	TEST_ASSERT_TRUE(!has("test_skipped"));
+}
+
+// The long sample is left out whole and counted, its neighbours are untouched
+void test_long_line_dropped() {
+	TEST_ASSERT_EQUAL_UINT32(1, render(512));
+	TEST_ASSERT_TRUE(has("test_labels_total{device=\"air_sensor\",location=\"home\",port=\"pm1006\"} 1\n"));
+	TEST_ASSERT_TRUE(has("test_labels_total{device=\"air_sensor\",location=\"home\",port=\"mhz19b\"} 3\n"));
+	TEST_ASSERT_TRUE(!has("xxxx"));
+
+	// Every line is whole: a comment or name{labels} value
+	for (const char *line = out; *line;) {
+		const char *end = strchr(line, '\n');
+		TEST_ASSERT_NOT_NULL(end);
+		TEST_ASSERT_TRUE_MESSAGE(line[0] == '#' || (memchr(line, '{', end - line) && memchr(line, '}', end - line)), "malformed line");
+		line = end + 1;
+	}
+	TEST_ASSERT_TRUE(outLen >= 6 && !strcmp(out + outLen - 6, "# EOF\n"));
+}
+
+// Flushing in small pieces gives the same text as one big buffer
+void test_buffer_sizes() {
+	render(1024);
+	static char whole[sizeof(out)];
+	memcpy(whole, out, outLen + 1);
+	TEST_ASSERT_EQUAL_UINT32(1, chunks);
+
+	const size_t sizes[] = {1, 7, 64, 200};
+	for (size_t size : sizes) {
+		render(size);
+		TEST_ASSERT_EQUAL_STRING(whole, out);
+		TEST_ASSERT_TRUE(chunks >= outLen / size);
+	}
+}
+
+void test_no_allocations() {
+	render(64); // anything lazily set up by libc happens here
+	uint32_t before = allocations;
+	for (uint8_t i = 0; i < 100; i++) render(64);
+	TEST_ASSERT_EQUAL_UINT32(before, allocations);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_non_finite_values);
+	RUN_TEST(test_long_line_dropped);
+	RUN_TEST(test_buffer_sizes);
+	RUN_TEST(test_no_allocations);
+	return UNITY_END();
+}
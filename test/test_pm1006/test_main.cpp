@@ -0,0 +1,167 @@
+// PM1006 frame decoder on corrupted and shifted streams
+#include <unity.h>
+
+#include <vector>
+
+#include "PM1006.hpp"
+#include "Sim.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes frame(uint16_t pm25) {
+	Bytes f(PM1006::FRAME_LEN, 0);
+	memcpy(f.data(), PM1006::HEADER, sizeof(PM1006::HEADER));
+	f[5]		= pm25 >> 8;
+	f[6]		= pm25 & 0xFF;
+	uint8_t sum = 0;
+	for (uint8_t i = 0; i < PM1006::FRAME_LEN - 1; i++) sum += f[i];
+	f[PM1006::FRAME_LEN - 1] = -sum;
+	return f;
+}
+
+// Sum of a truncated frame topped up to FRAME_LEN with the bytes that follow it
+static uint8_t checksum(const Bytes &truncated, const Bytes &after) {
+	uint8_t sum = 0;
+	for (uint8_t b : truncated) sum += b;
+	for (uint8_t i = 0; i < PM1006::FRAME_LEN - truncated.size(); i++) sum += after[i];
+	return sum;
+}
+
+static void append(Bytes &stream, const Bytes &bytes) {
+	stream.insert(stream.end(), bytes.begin(), bytes.end());
+}
+
+struct Run {
+	PM1006::FrameDecoder  decoder;
+	std::vector<uint16_t> decoded;
+
+	Run(const Bytes &stream) {
+		for (uint8_t b : stream) {
+			if (decoder.push(b)) decoded.push_back(decoder.pm25());
+		}
+		// Every byte went into a good frame or was discarded
+		TEST_ASSERT_EQUAL_UINT32_MESSAGE(stream.size(), decoder.framesOk * PM1006::FRAME_LEN + decoder.bytesDiscarded + decoder.idx, "bytes unaccounted for");
+	}
+};
+
+void test_clean_stream() {
+	Bytes stream;
+	for (uint16_t pm = 0; pm < 50; pm++) append(stream, frame(pm));
+	Run run(stream);
+	TEST_ASSERT_EQUAL_UINT32(50, run.decoded.size());
+	for (uint16_t pm = 0; pm < 50; pm++) TEST_ASSERT_EQUAL_UINT32(pm, run.decoded[pm]);
+	TEST_ASSERT_EQUAL_UINT32(0, run.decoder.bytesDiscarded);
+}
+
+// Joined mid-frame, like after a reset with the sensor already talking
+void test_shifted_start() {
+	for (uint8_t skip = 1; skip < PM1006::FRAME_LEN; skip++) {
+		Bytes first = frame(11), stream(first.begin() + skip, first.end());
+		append(stream, frame(12));
+		append(stream, frame(13));
+		Run run(stream);
+		TEST_ASSERT_EQUAL_UINT32(2, run.decoded.size());
+		TEST_ASSERT_EQUAL_UINT32(12, run.decoded[0]);
+		TEST_ASSERT_EQUAL_UINT32(13, run.decoded[1]);
+	}
+}
+
+// A frame cut short swallows the next header, resync has to find it again
+void test_truncated_frames() {
+	for (uint8_t keep = 1; keep < PM1006::FRAME_LEN; keep++) {
+		Bytes cut = frame(35), stream(cut.begin(), cut.begin() + keep);
+		append(stream, frame(36));
+		stream.insert(stream.end(), cut.begin(), cut.begin() + keep);
+		append(stream, frame(37));
+		Run run(stream);
+		TEST_ASSERT_EQUAL_UINT32(2, run.decoded.size());
+		TEST_ASSERT_EQUAL_UINT32(36, run.decoded[0]);
+		TEST_ASSERT_EQUAL_UINT32(37, run.decoded[1]);
+		TEST_ASSERT_EQUAL_UINT32(2 * keep, run.decoder.bytesDiscarded);
+	}
+}
+
+void test_stray_header_byte() {
+	Bytes stream = {0x16};
+	append(stream, frame(40));
+	append(stream, {0x16, 0x16, 0x11});
+	append(stream, frame(41));
+
+	// Inside a frame it shifts the rest of it, the checksum catches that
+	Bytes shifted = frame(42);
+	shifted.insert(shifted.begin() + 8, 0x16);
+	append(stream, shifted);
+	append(stream, frame(43));
+
+	Run run(stream);
+	TEST_ASSERT_EQUAL_UINT32(3, run.decoded.size());
+	TEST_ASSERT_EQUAL_UINT32(40, run.decoded[0]);
+	TEST_ASSERT_EQUAL_UINT32(41, run.decoded[1]);
+	TEST_ASSERT_EQUAL_UINT32(43, run.decoded[2]);
+	TEST_ASSERT_EQUAL_UINT32(1, run.decoder.checksumErrors);
+}
+
+void test_bad_checksums_back_to_back() {
+	Bytes stream;
+	for (uint8_t i = 0; i < 4; i++) {
+		Bytes bad = frame(50 + i);
+		bad[PM1006::FRAME_LEN - 1] ^= 1 << i;
+		append(stream, bad);
+	}
+	append(stream, frame(60));
+
+	Run run(stream);
+	TEST_ASSERT_EQUAL_UINT32(1, run.decoded.size());
+	TEST_ASSERT_EQUAL_UINT32(60, run.decoded[0]);
+	TEST_ASSERT_EQUAL_UINT32(4, run.decoder.checksumErrors);
+	TEST_ASSERT_EQUAL_UINT32(4 * PM1006::FRAME_LEN, run.decoder.bytesDiscarded);
+}
+
+// All of the above at random between good frames, none of which may be lost
+void test_mixed_faults() {
+	Sim::Random			  rng(7);
+	Bytes				  stream;
+	std::vector<uint16_t> sent;
+	for (uint16_t n = 0; n < 2000; n++) {
+		Bytes	 bad  = frame(rng.next() % 1000);
+		uint16_t next = rng.next() % 1000;
+		switch (rng.next() % 5) {
+		case 0: // truncated
+			bad.resize(1 + rng.next() % (PM1006::FRAME_LEN - 1));
+			if (checksum(bad, frame(next)) == 0) break; // 1 in 256 pass with the next frame's bytes, no decoder can tell
+			append(stream, bad);
+			break;
+		case 1: // stray header byte
+			stream.push_back(0x16);
+			break;
+		case 2: // bad checksum
+			bad[PM1006::FRAME_LEN - 1] ^= 1 + rng.next() % 255;
+			append(stream, bad);
+			break;
+		case 3: // line noise, never a header byte
+			for (uint8_t i = rng.next() % 8; i; i--) stream.push_back(0x17 + rng.next() % 0xE0);
+			break;
+		}
+		sent.push_back(next);
+		append(stream, frame(next));
+	}
+
+	Run run(stream);
+	TEST_ASSERT_EQUAL_UINT32(sent.size(), run.decoded.size());
+	for (size_t i = 0; i < sent.size(); i++) TEST_ASSERT_EQUAL_UINT32(sent[i], run.decoded[i]);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_clean_stream);
+	RUN_TEST(test_shifted_start);
+	RUN_TEST(test_truncated_frames);
+	RUN_TEST(test_stray_header_byte);
+	RUN_TEST(test_bad_checksums_back_to_back);
+	RUN_TEST(test_mixed_faults);
+	return UNITY_END();
+}
@@ -0,0 +1,86 @@
+// SampleLog recovery after the power is cut at every byte of a page write
+#include <unity.h>
+
+#include <vector>
+
+#include "SampleLog.hpp"
+#include "Sim.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+static const uint32_t PAGES		 = 4 * SampleLog::PAGES_PER_SECTOR;
+static const uint32_t PAGE_BYTES = sizeof(SampleLog::PageHeader) + SampleLog::RECORDS_PER_PAGE * sizeof(SampleLog::Record);
+
+// One record a second, the value is the time so the replay can be checked against it
+static void fill(SampleLog::Log<Sim::Flash> &log, uint32_t &t, uint32_t pages) {
+	for (uint32_t i = 0; i < pages * SampleLog::RECORDS_PER_PAGE; i++, t++) log.append(0, t, (int16_t)t);
+}
+
+// Write torn pages in, cut the power cut bytes into its write, reboot and carry on
+static void cutAt(uint32_t torn, uint32_t cut) {
+	char at[48];
+	snprintf(at, sizeof(at), "page %u, byte %u", torn, cut);
+
+	Sim::Flash				  flash(PAGES * SampleLog::PAGE);
+	SampleLog::Log<Sim::Flash> before(flash);
+	before.recover();
+
+	uint32_t t = 0;
+	flash.cutPowerAfter(torn * PAGE_BYTES + cut);
+	fill(before, t, torn + 2);
+	const uint32_t lastKept = torn * SampleLog::RECORDS_PER_PAGE - 1;
+
+	flash.restorePower();
+	SampleLog::Log<Sim::Flash> after(flash);
+	after.recover();
+	const uint32_t resumed = t + 1000;
+	t					   = resumed;
+	fill(after, t, 20);
+
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, flash.violations, at);
+
+	std::vector<uint32_t> times;
+	after.replay([&](uint8_t, uint32_t time, int16_t value) {
+		TEST_ASSERT_EQUAL_UINT32_MESSAGE(time, (uint16_t)value, at);
+		times.push_back(time);
+	});
+	for (size_t i = 1; i < times.size(); i++) TEST_ASSERT_TRUE_MESSAGE(times[i] > times[i - 1], at);
+
+	// Everything written after the reboot, and before the cut up to the torn page
+	size_t n = 0;
+	while (n < times.size() && times[n] < resumed) n++;
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(20 * SampleLog::RECORDS_PER_PAGE, times.size() - n, at);
+	TEST_ASSERT_TRUE_MESSAGE(n > 0 && times[n - 1] == lastKept, at);
+}
+
+static void cutEveryByte(uint32_t torn) {
+	for (uint32_t cut = 0; cut < PAGE_BYTES; cut++) cutAt(torn, cut);
+}
+
+void test_torn_mid_sector() {
+	cutEveryByte(5);
+}
+
+void test_torn_last_page_of_sector() {
+	cutEveryByte(SampleLog::PAGES_PER_SECTOR - 1);
+}
+
+void test_torn_first_page_of_sector() {
+	cutEveryByte(SampleLog::PAGES_PER_SECTOR);
+}
+
+void test_torn_after_wrap() {
+	cutEveryByte(PAGES);
+	cutEveryByte(PAGES + 6);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_torn_mid_sector);
+	RUN_TEST(test_torn_last_page_of_sector);
+	RUN_TEST(test_torn_first_page_of_sector);
+	RUN_TEST(test_torn_after_wrap);
+	return UNITY_END();
+}
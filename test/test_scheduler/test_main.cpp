@@ -0,0 +1,123 @@
+// Scheduler firing times against a fake millisecond clock
+#include <unity.h>
+
+#include <vector>
+
+#include "Scheduler.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+static uint32_t				 clockMs;
+static std::vector<uint32_t> fired[3]; // times each job ran at
+static std::vector<uint8_t>	 order;	   // which job ran, in order
+
+template <uint8_t JOB>
+static void record() {
+	fired[JOB].push_back(clockMs);
+	order.push_back(JOB);
+}
+
+static void reset() {
+	for (std::vector<uint32_t> &f : fired) f.clear();
+	order.clear();
+}
+
+// run() every millisecond in [from, to)
+template <uint8_t N>
+static void tick(Scheduler<N> &scheduler, uint32_t from, uint32_t to) {
+	for (clockMs = from; clockMs != to; clockMs++) scheduler.run(clockMs);
+}
+
+// Jobs sharing a period fire at their own offset, never drifting
+void test_phase() {
+	reset();
+	Scheduler<4> scheduler;
+	scheduler.add("a", record<0>, 1000, 0, 5000);
+	scheduler.add("b", record<1>, 1000, 250, 5000);
+	scheduler.add("c", record<2>, 1000, 500, 5000);
+	tick(scheduler, 5000, 15000);
+
+	for (uint8_t job = 0; job < 3; job++) {
+		TEST_ASSERT_EQUAL_UINT32(10, fired[job].size());
+		for (uint32_t k = 0; k < fired[job].size(); k++) TEST_ASSERT_EQUAL_UINT32(5000 + job * 250 + k * 1000, fired[job][k]);
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, scheduler.jobs[0].maxLate);
+}
+
+// Jitter delays each run within [grid, grid + jitter), the grid itself stays put
+void test_jitter() {
+	reset();
+	Scheduler<2> scheduler;
+	scheduler.add("a", record<0>, 1000, 100, 0, 200);
+	tick(scheduler, 0, 100000);
+
+	TEST_ASSERT_EQUAL_UINT32(100, fired[0].size());
+	uint32_t low = UINT32_MAX, high = 0;
+	for (uint32_t k = 0; k < fired[0].size(); k++) {
+		uint32_t offset = fired[0][k] - (100 + k * 1000);
+		TEST_ASSERT_TRUE_MESSAGE(offset < 200, "outside the jitter window");
+		low	 = offset < low ? offset : low;
+		high = offset > high ? offset : high;
+	}
+	TEST_ASSERT_TRUE_MESSAGE(high - low > 100, "jitter not spread");
+	TEST_ASSERT_EQUAL_UINT32(0, scheduler.jobs[0].skipped);
+}
+
+// A loop() stalled for 2.6 periods runs the job once, late, then goes back to its grid
+void test_late_job_keeps_grid() {
+	reset();
+	Scheduler<2> scheduler;
+	scheduler.add("a", record<0>, 1000, 0, 0);
+	tick(scheduler, 0, 2001);
+	tick(scheduler, 4600, 7001);
+
+	const uint32_t expected[] = {0, 1000, 2000, 4600, 5000, 6000, 7000};
+	TEST_ASSERT_EQUAL_UINT32(sizeof(expected) / sizeof(expected[0]), fired[0].size());
+	for (uint8_t k = 0; k < fired[0].size(); k++) TEST_ASSERT_EQUAL_UINT32(expected[k], fired[0][k]);
+
+	const Scheduler<2>::Job &job = scheduler.jobs[0];
+	TEST_ASSERT_EQUAL_UINT32(1, job.skipped);	 // 4600 stands in for 3000, 4000 is skipped
+	TEST_ASSERT_EQUAL_UINT32(1600, job.maxLate);
+	TEST_ASSERT_EQUAL_UINT32(0, job.lastLate);
+}
+
+// Several jobs overdue at once run earliest deadline first, each once
+void test_overdue_order() {
+	reset();
+	Scheduler<4> scheduler;
+	scheduler.add("c", record<2>, 1000, 300, 0);
+	scheduler.add("a", record<0>, 1000, 100, 0);
+	scheduler.add("b", record<1>, 1000, 200, 0);
+
+	clockMs = 2500;
+	TEST_ASSERT_EQUAL_UINT32(3, scheduler.run(clockMs));
+	TEST_ASSERT_EQUAL_UINT32(3, order.size());
+	for (uint8_t i = 0; i < 3; i++) TEST_ASSERT_EQUAL_UINT32(i, order[i]);
+	TEST_ASSERT_EQUAL_UINT32(600, scheduler.idleFor(clockMs)); // a is next at 3100
+	TEST_ASSERT_EQUAL_UINT32(0, scheduler.run(clockMs));
+}
+
+// millis() rolling over leaves the grid alone
+void test_wraparound() {
+	reset();
+	Scheduler<2> scheduler;
+	const uint32_t start = UINT32_MAX - 2500;
+	scheduler.add("a", record<0>, 1000, 0, start);
+	tick(scheduler, start, start + 5000);
+
+	TEST_ASSERT_EQUAL_UINT32(5, fired[0].size());
+	for (uint32_t k = 0; k < fired[0].size(); k++) TEST_ASSERT_EQUAL_UINT32(start + k * 1000, fired[0][k]);
+	TEST_ASSERT_EQUAL_UINT32(0, scheduler.jobs[0].maxLate);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_phase);
+	RUN_TEST(test_jitter);
+	RUN_TEST(test_late_job_keeps_grid);
+	RUN_TEST(test_overdue_order);
+	RUN_TEST(test_wraparound);
+	return UNITY_END();
+}
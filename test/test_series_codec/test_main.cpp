@@ -0,0 +1,156 @@
+// SeriesCodec round trip: a recorded week encoded per tier, decoded the way tools/history2csv.py does
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "History.hpp"
+#include "SeriesCodec.hpp"
+#include "Sim.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+static History::Store history;
+
+struct Out {
+	std::string bytes;
+	void		write(const char *data, size_t len) { bytes.append(data, len); }
+};
+
+struct Row {
+	uint32_t t;
+	int16_t	 min, max, mean;
+};
+
+struct Decoded {
+	uint8_t			 channel, flags;
+	uint32_t		 period, scale;
+	std::vector<Row> rows;
+};
+
+struct Reader {
+	const std::string &data;
+	size_t			   pos = 0;
+
+	uint8_t byte() {
+		TEST_ASSERT_TRUE_MESSAGE(pos < data.size(), "read past the end");
+		return data[pos++];
+	}
+
+	uint32_t varint() {
+		uint32_t value = 0;
+		for (uint8_t shift = 0;; shift += 7) {
+			uint8_t b = byte();
+			value |= (uint32_t)(b & 0x7F) << shift;
+			if (b < 0x80) return value;
+		}
+	}
+
+	int32_t zigzag() {
+		uint32_t v = varint();
+		return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+	}
+};
+
+static Decoded decode(const std::string &data) {
+	Decoded d;
+	Reader	r{data};
+	TEST_ASSERT_TRUE_MESSAGE(data.compare(0, 4, SeriesCodec::MAGIC, 4) == 0, "magic");
+	r.pos	   = 4;
+	d.channel  = r.byte();
+	d.flags	   = r.byte();
+	d.period   = r.varint();
+	d.scale	   = r.varint();
+	d.rows.resize(r.varint());
+
+	int32_t delta = 0;
+	for (size_t i = 0; i < d.rows.size(); i++) {
+		if (i == 0) {
+			d.rows[i].t = r.varint();
+			continue;
+		}
+		delta		= i == 1 ? r.zigzag() : delta + r.zigzag();
+		d.rows[i].t = d.rows[i - 1].t + delta;
+	}
+
+	auto column = [&](int16_t Row::*field) {
+		int32_t prev = 0;
+		for (Row &row : d.rows) row.*field = prev += r.zigzag();
+	};
+	column(&Row::mean);
+	if (d.flags & SeriesCodec::FLAG_MIN_MAX) {
+		column(&Row::min);
+		column(&Row::max);
+	} else {
+		for (Row &row : d.rows) row.min = row.max = row.mean;
+	}
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(data.size(), r.pos, "trailing bytes");
+	return d;
+}
+
+// Encode one channel at res like /history?format=bin and compare with the store row by row
+static void roundTrip(History::Channel ch, uint32_t res, size_t expectRows) {
+	uint32_t period = history.period(res);
+	bool	 minMax = period > history.series[ch].raw.period;
+	auto	 rows	= [&](auto fn) { history.forEach(ch, 0, res, fn); };
+
+	Out out;
+	TEST_ASSERT_EQUAL_UINT32(expectRows, SeriesCodec::encode(out, ch, period, minMax, rows));
+
+	Decoded d = decode(out.bytes);
+	TEST_ASSERT_EQUAL_INT(ch, d.channel);
+	TEST_ASSERT_EQUAL_INT(minMax, d.flags & SeriesCodec::FLAG_MIN_MAX);
+	TEST_ASSERT_EQUAL_UINT32(period, d.period);
+	TEST_ASSERT_EQUAL_UINT32((uint32_t)History::CHANNELS[ch].scale, d.scale);
+	TEST_ASSERT_EQUAL_UINT32(expectRows, d.rows.size());
+
+	size_t i = 0;
+	rows([&](uint32_t t, const History::Bucket &b) {
+		const Row &row = d.rows[i++];
+		TEST_ASSERT_EQUAL_UINT32(t, row.t);
+		TEST_ASSERT_EQUAL_INT(b.min, row.min);
+		TEST_ASSERT_EQUAL_INT(b.max, row.max);
+		TEST_ASSERT_EQUAL_INT(b.mean, row.mean);
+	});
+}
+
+void test_raw_hour() {
+	for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) roundTrip((History::Channel)ch, 10, 360);
+}
+
+void test_minute_day() {
+	for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) roundTrip((History::Channel)ch, 60, 1440);
+}
+
+void test_quarter_week() {
+	for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) roundTrip((History::Channel)ch, 900, 672);
+}
+
+// A gap in the samples shows up as a change in the time deltas
+void test_gap() {
+	const uint32_t start = 1699999980; // on a minute
+	History::Store gapped;
+	for (uint32_t t = 0; t < 3600; t += 10) {
+		if (t < 1200 || t >= 1800) gapped.ingest(History::CO2, start + t, 400 + t / 10);
+	}
+
+	Out out;
+	SeriesCodec::encode(out, History::CO2, 60, true, [&](auto fn) { gapped.forEach(History::CO2, 0, 60, fn); });
+	Decoded d = decode(out.bytes);
+	TEST_ASSERT_EQUAL_UINT32(50, d.rows.size());
+	TEST_ASSERT_EQUAL_UINT32(start + 1140, d.rows[19].t);
+	TEST_ASSERT_EQUAL_UINT32(start + 1800, d.rows[20].t);
+}
+
+int main() {
+	Sim::recordWeek(history, 1700000000);
+
+	UNITY_BEGIN();
+	RUN_TEST(test_raw_hour);
+	RUN_TEST(test_minute_day);
+	RUN_TEST(test_quarter_week);
+	RUN_TEST(test_gap);
+	return UNITY_END();
+}
@@ -0,0 +1,89 @@
+// What /config accepts, and what it shows
+#include <unity.h>
+
+#include <stdarg.h>
+#include <string>
+
+#include "Settings.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+struct StringOut {
+	std::string text;
+
+	void printf(const char *format, ...) {
+		char	buf[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buf, sizeof(buf), format, args);
+		va_end(args);
+		text += buf;
+	}
+};
+
+// The firmware URLs take https or nothing, a plain http one is refused and the old value stays
+void test_update_urls_https_only() {
+	const Settings::Field *update	= Settings::find("update_url");
+	const Settings::Field *manifest = Settings::find("ota_manifest");
+	TEST_ASSERT_NOT_NULL(update);
+	TEST_ASSERT_NOT_NULL(manifest);
+
+	TEST_ASSERT_TRUE(Settings::set(*update, "https://mirror.lan/bin_version.txt"));
+	TEST_ASSERT_EQUAL_STRING("https://mirror.lan/bin_version.txt", Settings::updateUrl);
+	TEST_ASSERT_FALSE(Settings::set(*update, "http://evil.lan/bin_version.txt"));
+	TEST_ASSERT_FALSE(Settings::set(*update, "HTTP://evil.lan/bin_version.txt"));
+	TEST_ASSERT_FALSE(Settings::set(*update, "evil.lan/bin_version.txt"));
+	TEST_ASSERT_EQUAL_STRING("https://mirror.lan/bin_version.txt", Settings::updateUrl);
+
+	TEST_ASSERT_FALSE(Settings::set(*manifest, "http://evil.lan/air.manifest"));
+	TEST_ASSERT_TRUE(Settings::set(*manifest, "https://mirror.lan/air.manifest"));
+	TEST_ASSERT_TRUE(Settings::set(*manifest, "")); // turns the download off
+	TEST_ASSERT_EQUAL_STRING("", Settings::otaManifestUrl);
+}
+
+// The push server is the owner's, plain http is up to them
+void test_push_url_takes_http() {
+	const Settings::Field *push = Settings::find("push_url");
+	TEST_ASSERT_TRUE(Settings::set(*push, "http://influx:8086/api/v2/write"));
+	TEST_ASSERT_EQUAL_STRING("http://influx:8086/api/v2/write", Settings::pushUrl);
+	TEST_ASSERT_TRUE(Settings::set(*push, ""));
+}
+
+void test_values_that_do_not_fit() {
+	const Settings::Field *check = Settings::find("update_check_s");
+	TEST_ASSERT_NULL(Settings::find("plain"));
+	TEST_ASSERT_FALSE(Settings::set(*check, "59"));
+	TEST_ASSERT_FALSE(Settings::set(*check, "60s"));
+	TEST_ASSERT_FALSE(Settings::set(*check, ""));
+	TEST_ASSERT_TRUE(Settings::set(*check, "60"));
+	TEST_ASSERT_EQUAL_UINT32(60, Settings::updateCheckSecs);
+
+	std::string longUrl = "https://mirror.lan/" + std::string(sizeof(Settings::updateUrl), 'a');
+	TEST_ASSERT_FALSE(Settings::set(*Settings::find("update_url"), longUrl.c_str()));
+}
+
+// The token is masked and a PEM shows its first line, every setting on one line of its own
+void test_report() {
+	Settings::set(*Settings::find("push_token"), "secret");
+	Settings::set(*Settings::find("push_ca"), "-----BEGIN CERTIFICATE-----\nMIIB\n-----END CERTIFICATE-----\n");
+	StringOut out;
+	Settings::report(out);
+
+	TEST_ASSERT_TRUE(out.text.find("push_token=***\n") != std::string::npos);
+	TEST_ASSERT_TRUE(out.text.find("secret") == std::string::npos);
+	TEST_ASSERT_TRUE(out.text.find("push_ca=-----BEGIN CERTIFICATE-----\npush_flush_s=") != std::string::npos);
+	size_t lines = 0;
+	for (char c : out.text) lines += c == '\n';
+	TEST_ASSERT_EQUAL(sizeof(Settings::FIELDS) / sizeof(Settings::FIELDS[0]), lines);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_update_urls_https_only);
+	RUN_TEST(test_push_url_takes_http);
+	RUN_TEST(test_values_that_do_not_fit);
+	RUN_TEST(test_report);
+	return UNITY_END();
+}
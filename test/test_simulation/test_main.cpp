@@ -0,0 +1,222 @@
+// A simulated day through the whole pipeline: every reading the devices produced has to come out of it
+#include <unity.h>
+
+#include "Simulation.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_uarts() {
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, pmUart.overruns, "PM1006 UART overruns");
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, mhzUart.overruns, "MH-Z19B UART overruns");
+}
+
+void test_pm1006() {
+	TEST_ASSERT_TRUE_MESSAGE(pmDevice.sent - pmDevice.corrupted - SerialCom::decoder.framesOk <= 1, "PM1006 frames lost"); // the last one may still be on the wire
+}
+
+void test_mhz19b() {
+	const MHZ19B  &mhz19b	 = fw->mhz19b;
+	const uint32_t intervals = endUs / (INTERVAL * 1000000ULL);
+	const uint32_t warmup	 = MHZ19B::WARMUP_MS / (INTERVAL * 1000);
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(mhzDevice.corrupted, mhz19b.errors, "MH-Z19B corrupt replies not all rejected");
+	TEST_ASSERT_TRUE_MESSAGE(mhz19b.timeouts == 0 && mhzDevice.badCommands == 0, "MH-Z19B command errors");
+	TEST_ASSERT_TRUE_MESSAGE(mhz19b.seq + mhzDevice.corrupted + warmup + 1 >= intervals, "MH-Z19B readings missing");
+	TEST_ASSERT_TRUE_MESSAGE(mhz19b.replies + 1 >= 2 * mhz19b.seq + mhzDevice.corrupted && mhz19b.co2Unlimited && mhz19b.overflows == 0,
+							 "MH-Z19B unclamped readings missing");
+	TEST_ASSERT_TRUE_MESSAGE(mhz19b.latencyMaxUs > Sim::MHZ19BDevice::LATENCY_US && mhz19b.latencyMaxUs < MHZ19B::TIMEOUT_MS * 1000, "MH-Z19B round trip latency off");
+	TEST_ASSERT_TRUE_MESSAGE(abs(mhz19b.temperature - world.temperature(endUs)) <= 2, "MH-Z19B temperature off the simulated air");
+	TEST_ASSERT_TRUE_MESSAGE(mhzDevice.zeroed == 1 && mhzDevice.span == 2000, "MH-Z19B calibration commands not sent");
+}
+
+void test_si7021() {
+	const uint32_t intervals = endUs / (INTERVAL * 1000000ULL);
+	TEST_ASSERT_TRUE_MESSAGE(fw->si7021.errors == 0 && fw->si7021.seq + 1 >= intervals, "Si7021 readings missing");
+}
+
+void test_flash_log() {
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, flash.violations, "flash programmed without erase");
+	TEST_ASSERT_TRUE_MESSAGE(sampleLog.pagesWritten > sampleLog.pages ? replayed <= logged : replayed == logged, "flash log replay mismatch");
+}
+
+void test_led() {
+	TEST_ASSERT_TRUE_MESSAGE(led.updates > 0, "LED never updated");
+}
+
+void test_scrape_windows() {
+	for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) {
+		TEST_ASSERT_TRUE_MESSAGE(scraped[ch].count == recorded[ch] && (!recorded[ch] || scraped[ch].max == highest[ch]), "scrape windows lost readings");
+	}
+}
+
+void test_events() {
+	const uint32_t published = events.nextId - 1;
+	TEST_ASSERT_TRUE_MESSAGE(fastReader.events == published && fastReader.gaps == 0, "/events subscriber missed events");
+	TEST_ASSERT_TRUE_MESSAGE(slowReader.events + events.dropped == published && events.rejected == 1, "/events backlog or slot limit broken");
+	TEST_ASSERT_TRUE_MESSAGE(resumed && resumedReader.gaps == 0 && resumedReader.lastId == published, "/events did not resume from Last-Event-ID");
+}
+
+void test_push() {
+	TEST_ASSERT_TRUE_MESSAGE(pusher.sent + pusher.dropped + pusher.rejected + pusher.queued() == pushed && pushServer.lines == pusher.sent, "push samples unaccounted for");
+	TEST_ASSERT_TRUE_MESSAGE(pushServer.malformed == 0 && pushServer.disorder == 0, "push lines malformed or out of order");
+	TEST_ASSERT_TRUE_MESSAGE(droppedEarly == 0 && pusher.queued() < 50, "push queue didn't ride out the short outage or drain");
+}
+
+void test_update_check() {
+	TEST_ASSERT_TRUE_MESSAGE(versionServer.bodies == 2 && updateChecker.results[UpdateCheck::NOT_MODIFIED] + 2 == versionServer.requests, "version file fetched while unchanged");
+	TEST_ASSERT_TRUE_MESSAGE(!availableBeforeRelease && updateChecker.available && !strcmp(updateChecker.latest, "4.1.0"), "new version not detected");
+}
+
+void test_firmware_download() {
+	TEST_ASSERT_TRUE_MESSAGE(updater.state == Updater::READY && otaSlot.violations == 0 && !memcmp(otaSlot.data.data(), fileServer.image.data(), fileServer.image.size()),
+							 "firmware image not downloaded intact");
+	TEST_ASSERT_TRUE_MESSAGE(updater.restarts == 1 && fileServer.served < fileServer.image.size() * 2, "firmware download not resumed");
+	TEST_ASSERT_TRUE_MESSAGE(updater.deltaFallbacks == 1 && updater.deltas == 0, "broken delta not replaced by the full image");
+	TEST_ASSERT_TRUE_MESSAGE(updater.failures[Updater::VERSION] == 1, "manifest trailing the version file not refused, or not tried again");
+}
+
+// A manifest for the running firmware or for another version than the check reported is refused before
+// any of the image is fetched
+void test_firmware_wrong_version() {
+	static FileServer					 staleServer;
+	static Sim::Flash					 staleSlot(0x140000);
+	Updater::Job<FileServer, Sim::Flash> staleUpdate(staleServer, staleSlot, simClock);
+	staleServer.publish(100000, options.seed);
+	staleServer.trailsUntil = UINT64_MAX;
+	for (const char *expected : {"4.1.0", (const char *)nullptr}) {
+		staleUpdate.start("http://files/air.manifest", expected, FW_VERSION);
+		while (staleUpdate.busy()) staleUpdate.step();
+	}
+	staleUpdate.start("http://files/air.manifest", "4.2.0");
+	staleServer.trailsUntil = 0;
+	while (staleUpdate.busy()) staleUpdate.step();
+	TEST_ASSERT_TRUE_MESSAGE(staleUpdate.state == Updater::FAILED && staleUpdate.failures[Updater::VERSION] == 3 && staleServer.served == 0,
+							 "manifest for the wrong version accepted");
+}
+
+// An intact delta is all that's fetched
+void test_firmware_delta() {
+	static FileServer					 deltaServer;
+	static Sim::Flash					 deltaSlot(0x140000);
+	Updater::Job<FileServer, Sim::Flash> deltaUpdate(deltaServer, deltaSlot, simClock);
+	deltaServer.publish(0, options.seed + 1, &runningImage);
+	deltaUpdate.running = &runningSlot;
+	deltaUpdate.start("http://files/air.manifest");
+	while (deltaUpdate.busy()) deltaUpdate.step();
+	TEST_ASSERT_TRUE_MESSAGE(deltaUpdate.state == Updater::READY && deltaUpdate.deltas == 1 && deltaServer.served == deltaServer.delta.size() &&
+								 !memcmp(deltaSlot.data.data(), deltaServer.image.data(), deltaServer.image.size()),
+							 "firmware delta not applied");
+}
+
+// An image that doesn't match its manifest is never READY
+void test_firmware_corrupt() {
+	static FileServer					 badServer;
+	static Sim::Flash					 badSlot(0x140000);
+	Updater::Job<FileServer, Sim::Flash> badUpdate(badServer, badSlot, simClock);
+	badServer.publish(100000, options.seed);
+	badServer.image[50000] ^= 1;
+	badUpdate.start("http://files/air.manifest");
+	while (badUpdate.busy()) badUpdate.step();
+	TEST_ASSERT_TRUE_MESSAGE(badUpdate.state == Updater::FAILED && badUpdate.failures[Updater::DIGEST] == 1, "corrupt firmware image accepted");
+}
+
+void test_readings_ring() {
+	TEST_ASSERT_TRUE_MESSAGE(Pipeline::readings.dropped == 0 && Pipeline::readings.depth() == 0, "readings dropped or left in the ring");
+}
+
+void test_rolling_windows() {
+	float dayLow, dayPeak, dayMean;
+	bool  daySeen = SlidingWindow::get(History::CO2, SlidingWindow::DAY, START_TIME + simClock.millis() / 1000, dayLow, dayPeak, dayMean);
+	TEST_ASSERT_TRUE_MESSAGE(daySeen && History::scale(History::CO2, dayPeak) <= highest[History::CO2] && dayLow <= dayMean && dayMean <= dayPeak,
+							 "CO2 24h window inconsistent with the readings");
+}
+
+void test_notifications() {
+	for (const Notify::Gate &g : Notify::gates) {
+		TEST_ASSERT_TRUE_MESSAGE(g.sent + 1 >= (endUs - beginUs) / 1000 / g.policy.heartbeatMs, "notification heartbeat missed");
+	}
+}
+
+void test_filters_follow_air() {
+	TEST_ASSERT_TRUE_MESSAGE(fabsf(Pipeline::co2Filter.get() - world.co2(endUs)) < 50 && fabsf(Pipeline::pm25Filter.get() - world.pm25(endUs)) < 5,
+							 "filtered CO2 or PM2.5 off the simulated air");
+	TEST_ASSERT_TRUE_MESSAGE(fabsf(Pipeline::temperatureFilter.get() - world.temperature(endUs)) < 0.5f && fabsf(Pipeline::humidityFilter.get() - world.humidity(endUs)) < 2,
+							 "filtered climate off the simulated air");
+}
+
+// After a reboot the filters start from the last logged values: what the sensor read, without the offset the
+// log has on top, and only where no live reading came in first
+void test_filters_seeded_after_reboot() {
+	offsets[History::TEMPERATURE] = 2;
+	Pipeline::readings.push({History::TEMPERATURE, 23, 23}, simClock.micros());
+	Pipeline::drainReadings(); // logged as 25
+
+	rebootHistory();
+	Pipeline::restoreHistory();
+	Pipeline::co2Filter.push(800); // the acquisition task beat the seeds to it
+	Pipeline::seedFilters();
+	offsets[History::TEMPERATURE] = 0;
+
+	TEST_ASSERT_TRUE_MESSAGE(fabsf(Pipeline::temperatureFilter.get() - 23) < 0.01f, "temperature filter seeded with the offset on top");
+	TEST_ASSERT_TRUE_MESSAGE(Pipeline::co2Filter.count == 1 && Pipeline::co2Filter.get() == 800, "seed pushed behind a live reading");
+	TEST_ASSERT_TRUE_MESSAGE(Pipeline::pm25Filter.count == 1 && Pipeline::humidityFilter.count == 1, "empty filters not seeded");
+}
+
+// The closed buckets of all three tiers at now, minus the oldest one the next sample may push out
+static std::vector<int16_t> buckets(const History::Store &store, History::Channel ch, uint32_t now) {
+	const History::Series &s = store.series[ch];
+	std::vector<int16_t>	 out;
+	for (uint32_t res : {s.raw.period, s.minute.period, s.quarter.period}) {
+		uint32_t length = res == s.raw.period ? s.raw.length : res == s.minute.period ? s.minute.length : s.quarter.length;
+		uint32_t before = now - now % res;
+		store.forEach(ch, before - (length - 2) * res, res, [&](uint32_t t, const History::Bucket &b) {
+			if (t < before) out.insert(out.end(), {(int16_t)(t / res), b.min, b.max, b.mean});
+		});
+	}
+	return out;
+}
+
+// A reboot once the clock has synced: the log has to be back in the RAM history before the first
+// reading after it goes in, or every tier drops the older records
+void test_history_restored_after_reboot() {
+	static History::Store live;
+	const uint32_t		  now = START_TIME + simClock.millis() / 1000;
+	live					  = Pipeline::history;
+
+	rebootHistory();
+	Pipeline::recordSample(History::CO2, 800);
+	for (uint8_t ch = 0; ch < History::CHANNEL_COUNT; ch++) {
+		std::vector<int16_t> expected = buckets(live, (History::Channel)ch, now);
+		TEST_ASSERT_TRUE_MESSAGE(expected.size() > 100, "no history to restore");
+		TEST_ASSERT_TRUE_MESSAGE(buckets(Pipeline::history, (History::Channel)ch, now) == expected, "history not restored after a reboot");
+	}
+}
+
+int main() {
+	if (simulate(Options())) return 2;
+	report();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_uarts);
+	RUN_TEST(test_pm1006);
+	RUN_TEST(test_mhz19b);
+	RUN_TEST(test_si7021);
+	RUN_TEST(test_flash_log);
+	RUN_TEST(test_led);
+	RUN_TEST(test_scrape_windows);
+	RUN_TEST(test_events);
+	RUN_TEST(test_push);
+	RUN_TEST(test_update_check);
+	RUN_TEST(test_firmware_download);
+	RUN_TEST(test_firmware_delta);
+	RUN_TEST(test_firmware_corrupt);
+	RUN_TEST(test_firmware_wrong_version);
+	RUN_TEST(test_readings_ring);
+	RUN_TEST(test_rolling_windows);
+	RUN_TEST(test_notifications);
+	RUN_TEST(test_filters_follow_air);
+	RUN_TEST(test_filters_seeded_after_reboot);
+	RUN_TEST(test_history_restored_after_reboot); // last, it replaces the history
+	return UNITY_END();
+}
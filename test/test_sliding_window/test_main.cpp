@@ -0,0 +1,80 @@
+// Sliding windows against a brute-force scan of every sample still in them
+#include <unity.h>
+
+#include <vector>
+
+#include "Sim.hpp"
+#include "SlidingWindow.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+struct Sample {
+	uint32_t t;
+	int16_t	 value;
+};
+
+static std::vector<Sample> samples;
+
+template <uint16_t SLOTS, uint32_t SLOT_SECS>
+static void compare(SlidingWindow::Window<SLOTS, SLOT_SECS> &window, uint32_t t) {
+	uint32_t newest = t / SLOT_SECS;
+	int16_t	 min = INT16_MAX, max = INT16_MIN;
+	int64_t	 sum   = 0;
+	uint32_t count = 0;
+	for (const Sample &s : samples) {
+		if (s.t / SLOT_SECS + SLOTS <= newest) continue;
+		min = s.value < min ? s.value : min;
+		max = s.value > max ? s.value : max;
+		sum += s.value;
+		count++;
+	}
+
+	SlidingWindow::Summary got = window.summary(t);
+	TEST_ASSERT_EQUAL_UINT32(count, got.count);
+	if (!count) return;
+	TEST_ASSERT_EQUAL_INT(min, got.min);
+	TEST_ASSERT_EQUAL_INT(max, got.max);
+	TEST_ASSERT_FLOAT_WITHIN(0.01f, (float)sum / count, got.mean);
+}
+
+// Random values and gaps, some longer than the window, with queries in between and after the last sample
+template <uint16_t SLOTS, uint32_t SLOT_SECS>
+static void check(uint32_t seed) {
+	static SlidingWindow::Window<SLOTS, SLOT_SECS> window;
+	Sim::Random									   random(seed);
+	uint32_t									   t = random.next() % 100000;
+	window.reset();
+	samples.clear();
+
+	for (uint32_t i = 0; i < 20000; i++) {
+		uint32_t r = random.next() % 1000;
+		t += r < 900 ? random.next() % (SLOT_SECS / 2 + 1) : r < 995 ? random.next() % (SLOTS * SLOT_SECS / 4) : SLOTS * SLOT_SECS + random.next() % 1000;
+		int16_t value = (int16_t)(random.next() % 4001) - 2000;
+		window.add(t, value);
+		samples.push_back({t, value});
+		if (random.next() % 8 == 0) compare(window, t);
+	}
+	for (uint16_t i = 0; i <= SLOTS + 1; i++) compare(window, t + i * SLOT_SECS);
+}
+
+void test_hour() {
+	check<60, 60>(1);
+}
+
+void test_day() {
+	check<96, 900>(2);
+}
+
+void test_week() {
+	check<84, 7200>(3);
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_hour);
+	RUN_TEST(test_day);
+	RUN_TEST(test_week);
+	return UNITY_END();
+}
@@ -0,0 +1,51 @@
+// The readings ring between two real threads, the way the cores share it
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+
+#include "SpscRing.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+// Whatever was accepted comes out once and in order, the rest is counted as dropped. Either side yields
+// when it can't get on, a single core runner would spend its time slices spinning otherwise, and the
+// consumer now and then so the ring fills up
+void test_ring_across_threads() {
+	constexpr static const uint32_t COUNT = 1000000;
+	static SpscRing<uint32_t, 64>	ring;
+	uint32_t						popped = 0, disorder = 0;
+	std::atomic<bool>				done{false};
+
+	std::thread producer([&]() {
+		for (uint32_t i = 1; i <= COUNT; i++) {
+			if (!ring.push(i, 0)) std::this_thread::yield(); // dropped, let the consumer catch up
+		}
+		done = true;
+	});
+
+	uint32_t last = 0;
+	for (uint32_t v; !done || ring.depth();) {
+		if (!ring.pop(v, 0)) {
+			std::this_thread::yield();
+			continue;
+		}
+		if (v <= last) disorder++;
+		last = v;
+		if (++popped % 4096 == 0) std::this_thread::yield();
+	}
+	producer.join();
+
+	printf("ring pushed=%u dropped=%u popped=%u max_queued=%u\n", (unsigned)ring.pushed, (unsigned)ring.dropped, (unsigned)popped, (unsigned)ring.highWater);
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, disorder, "items repeated or reordered across threads");
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(ring.pushed, popped, "accepted items lost");
+	TEST_ASSERT_EQUAL_UINT32_MESSAGE(COUNT, ring.pushed + ring.dropped, "items neither accepted nor dropped");
+}
+
+int main() {
+	UNITY_BEGIN();
+	RUN_TEST(test_ring_across_threads);
+	return UNITY_END();
+}
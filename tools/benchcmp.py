@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Compare two benchmark result files written by the native build's --bench.
+
+    benchcmp.py bench-1.4.3.json bench-1.4.4.json [--threshold 10]
+
+Exits with 1 when a benchmark got slower by more than the threshold (in
+percent) or started allocating, so it can gate a release.
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data["firmware"], {b["name"]: b for b in data["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10, help="allowed slowdown in percent")
+    args = parser.parse_args()
+
+    old_version, old = load(args.old)
+    new_version, new = load(args.new)
+
+    print(f"{'benchmark':28} {old_version:>12} {new_version:>12} {'change':>8}")
+    regressions = 0
+    for name in sorted(old.keys() | new.keys()):
+        if name not in old or name not in new:
+            side = old_version if name in old else new_version
+            print(f"{name:28} {'only in ' + side:>34}")
+            continue
+
+        a, b = old[name], new[name]
+        change = (b["ns_per_op"] / a["ns_per_op"] - 1) * 100 if a["ns_per_op"] else 0
+        flag = ""
+        if change > args.threshold:
+            flag = "  SLOWER"
+        if b["allocs_per_op"] > a["allocs_per_op"]:
+            flag += "  ALLOCATES"
+        if flag:
+            regressions += 1
+        print(f"{name:28} {a['ns_per_op']:10.1f}ns {b['ns_per_op']:10.1f}ns {change:+7.1f}%{flag}")
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Decode the binary /history export (SeriesCodec.hpp) to CSV.
+
+    history2csv.py http://DEVICE_IP/history?channel=co2&res=900&format=bin
+    history2csv.py export.bin > export.csv
+    curl -s ... | history2csv.py -
+"""
+import sys
+import urllib.request
+
+MAGIC = b"AQH1"
+FLAG_MIN_MAX = 0x01
+CHANNELS = ["co2", "pm25", "temperature", "humidity", "light"]
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        shift = value = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if b < 0x80:
+                return value
+
+    def zigzag(self):
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+
+def decode(data):
+    if data[:4] != MAGIC:
+        raise ValueError("not a history export")
+    r = Reader(data)
+    r.pos = 4
+    channel = r.byte()
+    flags = r.byte()
+    period = r.varint()
+    scale = r.varint()
+    count = r.varint()
+
+    times = []
+    delta = 0
+    for i in range(count):
+        if i == 0:
+            times.append(r.varint())
+        elif i == 1:
+            delta = r.zigzag()
+            times.append(times[-1] + delta)
+        else:
+            delta += r.zigzag()
+            times.append(times[-1] + delta)
+
+    def column():
+        values, prev = [], 0
+        for _ in range(count):
+            prev += r.zigzag()
+            values.append(prev / scale)
+        return values
+
+    mean = column()
+    if flags & FLAG_MIN_MAX:
+        low, high = column(), column()
+    else:
+        low = high = mean
+
+    name = CHANNELS[channel] if channel < len(CHANNELS) else str(channel)
+    return name, period, list(zip(times, low, high, mean))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    src = sys.argv[1]
+    if src.startswith("http://") or src.startswith("https://"):
+        data = urllib.request.urlopen(src).read()
+    elif src == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(src, "rb") as f:
+            data = f.read()
+
+    name, period, rows = decode(data)
+    print(f"# channel={name} period={period}s", file=sys.stderr)
+    print("time,min,max,mean")
+    for t, low, high, mean in rows:
+        print(f"{t},{low:g},{high:g},{mean:g}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""Makes a delta from one firmware image to the next (format in include/DeltaPatch.hpp).
+
+    ota_delta.py OLD NEW PATCH >> NEW_BASE.manifest
+    ota_delta.py --apply OLD PATCH OUT
+
+OLD is the image devices run now, as published with the previous release.
+The first form writes PATCH and prints the manifest lines that offer it
+(see ota_manifest.py); devices running anything but OLD fetch the full
+image. The second rebuilds the new image from a patch, to check one on the
+host; the firmware's own decoder runs with the native simulation's
+--apply-delta.
+"""
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+MAGIC = b"ADP1"
+LITERAL, COPY_OLD, COPY_NEW = 0, 1, 2
+KEY = 8  # bytes hashed to find match candidates
+MIN_MATCH = 12  # a copy op costs up to 11 bytes
+CANDIDATES = 4  # positions kept per key
+
+
+def varint(v):
+    out = bytearray()
+    while v >= 0x80:
+        out.append(v & 0x7F | 0x80)
+        v >>= 7
+    out.append(v)
+    return out
+
+
+def match_length(a, i, b, j, limit):
+    n = 0
+    while n < limit:
+        step = min(64, limit - n)
+        if a[i + n : i + n + step] == b[j + n : j + n + step]:
+            n += step
+            continue
+        while a[i + n] == b[j + n]:
+            n += 1
+        break
+    return n
+
+
+def index(table, data, pos):
+    key = data[pos : pos + KEY]
+    slots = table.setdefault(key, [])
+    slots.append(pos)
+    if len(slots) > CANDIDATES:
+        del slots[0]
+
+
+def diff(old, new):
+    """Greedy LZ77 over both images, copies from the old one tried first at the
+    offset the last one ended (code that only moved keeps matching there)."""
+    old_index = {}
+    for pos in range(0, len(old) - KEY + 1):
+        index(old_index, old, pos)
+    new_index = {}
+
+    ops = bytearray()
+    literal = bytearray()
+    expected = None  # where in the old image the last old copy continues
+
+    def flush():
+        if literal:
+            ops.extend(bytes([LITERAL]) + varint(len(literal)) + literal)
+            literal.clear()
+
+    i = 0
+    while i < len(new):
+        limit = len(new) - i
+        best_len, best_op, best_at = 0, None, 0
+        if expected is not None and expected < len(old):
+            n = match_length(new, i, old, expected, min(limit, len(old) - expected))
+            if n >= MIN_MATCH:
+                best_len, best_op, best_at = n, COPY_OLD, expected
+        key = new[i : i + KEY]
+        if best_len < 256 and len(key) == KEY:
+            for pos in old_index.get(key, ()):
+                n = match_length(new, i, old, pos, min(limit, len(old) - pos))
+                if n > best_len:
+                    best_len, best_op, best_at = n, COPY_OLD, pos
+            for pos in new_index.get(key, ()):
+                n = match_length(new, i, new, pos, limit)  # may run into itself, the decoder repeats
+                if n > best_len + 2:  # distances cost about as much as offsets
+                    best_len, best_op, best_at = n, COPY_NEW, pos
+
+        if best_len < MIN_MATCH:
+            if len(key) == KEY:
+                index(new_index, new, i)
+            literal.append(new[i])
+            i += 1
+            continue
+
+        flush()
+        if best_op == COPY_OLD:
+            ops.extend(bytes([COPY_OLD]) + varint(best_len) + varint(best_at))
+            expected = best_at + best_len
+        else:
+            ops.extend(bytes([COPY_NEW]) + varint(best_len) + varint(i - best_at))
+        for pos in range(i, min(i + best_len, len(new) - KEY + 1), 16):
+            index(new_index, new, pos)
+        i += best_len
+    flush()
+    return bytes(ops)
+
+
+def header(old, new):
+    return MAGIC + struct.pack("<I", len(old)) + hashlib.sha256(old).digest() + struct.pack("<I", len(new)) + hashlib.sha256(new).digest()
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def apply(old, patch):
+    if patch[:4] != MAGIC:
+        sys.exit("not a delta")
+    old_size, old_sha = struct.unpack_from("<I", patch, 4)[0], patch[8:40]
+    new_size, new_sha = struct.unpack_from("<I", patch, 40)[0], patch[44:76]
+    if len(old) != old_size or hashlib.sha256(old).digest() != old_sha:
+        sys.exit("delta is for another image")
+
+    out = bytearray()
+    pos = 76
+    while pos < len(patch):
+        op = patch[pos]
+        length, pos = read_varint(patch, pos + 1)
+        if op == LITERAL:
+            out += patch[pos : pos + length]
+            pos += length
+        elif op == COPY_OLD:
+            at, pos = read_varint(patch, pos)
+            out += old[at : at + length]
+        elif op == COPY_NEW:
+            distance, pos = read_varint(patch, pos)
+            for _ in range(length):
+                out.append(out[-distance])
+        else:
+            sys.exit(f"bad op {op} at {pos - 1}")
+    if len(out) != new_size or hashlib.sha256(out).digest() != new_sha:
+        sys.exit("delta doesn't rebuild the new image")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--apply", action="store_true", help="rebuild OUT from OLD and PATCH")
+    parser.add_argument("old")
+    parser.add_argument("second", metavar="NEW|PATCH")
+    parser.add_argument("third", metavar="PATCH|OUT")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.second, "rb") as f:
+        second = f.read()
+
+    if args.apply:
+        with open(args.third, "wb") as f:
+            f.write(apply(old, second))
+        return
+
+    patch = header(old, second) + diff(old, second)
+    with open(args.third, "wb") as f:
+        f.write(patch)
+    print(f"{len(second)} byte image, {len(patch)} byte delta", file=sys.stderr)
+    print(f"delta_url={os.path.basename(args.third)}")
+    print(f"delta_base_size={len(old)}")
+    print(f"delta_base_sha256={hashlib.sha256(old).hexdigest()}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""Writes the manifest the device checks a firmware image against.
+
+    ota_manifest.py IMAGE VERSION [--url URL] > IMAGE_BASE.manifest
+
+The image url defaults to the image's file name, which the device resolves
+next to the manifest. Publish both files together, e.g.
+
+    ota_manifest.py .pio/build/esp32dev_v4/firmware.bin 4.1.0 \\
+        --url esp32_air_quality_v4.bin > esp32_air_quality_v4.manifest
+
+extra_script.py does this for every firmware build, next to the .bin it
+copies into the project directory.
+"""
+import argparse
+import hashlib
+import os
+
+
+def manifest(image, version, url=None):
+    with open(image, "rb") as f:
+        data = f.read()
+
+    return (f"version={version}\n"
+            f"size={len(data)}\n"
+            f"sha256={hashlib.sha256(data).hexdigest()}\n"
+            f"url={url or os.path.basename(image)}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("image")
+    parser.add_argument("version")
+    parser.add_argument("--url", help="image url, absolute or relative to the manifest")
+    args = parser.parse_args()
+
+    print(manifest(args.image, args.version, args.url), end="")
+
+
+if __name__ == "__main__":
+    main()
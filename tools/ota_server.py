@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Serves firmware images with Range support, to try OTA updates locally.
+
+    ota_server.py DIR [--port 8080] [--drop-every BYTES] [--ignore-range]
+
+Put the image and its manifest (see ota_manifest.py) in DIR and point the
+device at them:
+
+    curl -X POST "http://DEVICE_IP/config?ota_manifest=http://HOST:8080/esp32_air_quality_v4.manifest"
+
+--drop-every closes the connection after that many bytes of a response so
+the device has to resume, --ignore-range answers Range requests with the
+whole file so it has to start over.
+"""
+import argparse
+import os
+import re
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+
+class Files(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive, the device reuses its connection
+
+    def do_GET(self):
+        path = os.path.join(self.server.root, os.path.basename(self.path.split("?")[0]))
+        if not os.path.isfile(path):
+            self.reply(404)
+            return
+        with open(path, "rb") as f:
+            data = f.read()
+
+        start = 0
+        match = re.match(r"bytes=(\d+)-$", self.headers.get("Range", ""))
+        if match and not self.server.ignore_range:
+            start = int(match.group(1))
+            if start >= len(data):
+                self.reply(416)
+                return
+
+        self.send_response(206 if start else 200)
+        self.send_header("Content-Length", str(len(data) - start))
+        if start:
+            self.send_header("Content-Range", f"bytes {start}-{len(data) - 1}/{len(data)}")
+        self.end_headers()
+
+        body = data[start:]
+        drop = self.server.drop_every
+        if drop and len(body) > drop:
+            self.wfile.write(body[:drop])
+            self.close_connection = True
+            print(f"{self.path} from {start}: dropped after {drop} bytes")
+            return
+        self.wfile.write(body)
+        print(f"{self.path} from {start}: {len(body)} bytes")
+
+    def reply(self, status):
+        self.send_response(status)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("dir")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--drop-every", type=int, default=0, help="close responses after this many bytes")
+    parser.add_argument("--ignore-range", action="store_true", help="always send the whole file")
+    args = parser.parse_args()
+
+    server = HTTPServer(("", args.port), Files)
+    server.root = args.dir
+    server.drop_every = args.drop_every
+    server.ignore_range = args.ignore_range
+    print(f"serving {args.dir} on :{args.port}")
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Stand-in for the InfluxDB write endpoint, to try the push exporter locally.
+
+    push_sink.py [--port 8086] [--fail-every N]
+
+Point the device at it and watch the batches arrive:
+
+    curl -X POST "http://DEVICE_IP/config?push_url=http://HOST:8086/api/v2/write"
+
+Prints one line per sample with the request it came in. Stop the script to
+simulate an outage, or use --fail-every to answer every Nth request with a
+503 so the device backs off and retries.
+"""
+import argparse
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+
+class Sink(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive, the device reuses its connection
+    requests = 0
+
+    def do_POST(self):
+        Sink.requests += 1
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode()
+
+        if self.server.fail_every and Sink.requests % self.server.fail_every == 0:
+            print(f"#{Sink.requests} failed on purpose ({len(body.splitlines())} lines)")
+            self.reply(503)
+            return
+
+        for line in body.splitlines():
+            print(f"#{Sink.requests} {line}")
+        self.reply(204)
+
+    def reply(self, status):
+        self.send_response(status)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=8086)
+    parser.add_argument("--fail-every", type=int, default=0, help="answer every Nth request with 503")
+    args = parser.parse_args()
+
+    server = HTTPServer(("", args.port), Sink)
+    server.fail_every = args.fail_every
+    print(f"listening on :{args.port}")
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()